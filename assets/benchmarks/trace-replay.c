@@ -0,0 +1,270 @@
+/*
+ * Selection Event Trace Replay
+ *
+ * Feeds a trace recorded by an agent daemon (ZES_TRACE=<file>, see "Event
+ * trace" in common/zes-agent-core.h) back through the shared publish path
+ * — write_primary(), hist_record() and the metrics — in a private cache
+ * directory, with the recorded inter-event timing:
+ *
+ *   x11, xwayland, wsl  every read publishes (seq always bumps)
+ *   wayland             a read publishes only when its (len, hash) differs
+ *                       from the previous one
+ *
+ * With -c the PRIMARY coalescing window (ZES_COALESCE_MS) is applied on
+ * top, so a trace captured without it shows what a given window would
+ * have saved.  Without payloads in the trace each read is replaced by
+ * deterministic bytes derived from its hash, so equal (len, hash) pairs
+ * replay as equal text.
+ *
+ * Results are printed as one JSON object so runs can be stored and
+ * diffed like the x11-latency benchmark's.
+ */
+
+#define _GNU_SOURCE
+
+#define MET_AGENT "replay"
+#define ZES_MAX_PAYLOAD (1024 * 1024)
+
+#include "zes-agent-core.h"
+
+#define MAX_REPLAY_RECORD (64 * 1024 * 1024)
+
+enum replay_mode { MODE_ALWAYS, MODE_DEDUPE };
+
+struct replay_read {
+    bool pending;
+    uint64_t hash;
+    size_t len;
+    char *body;               /* the record's MIME type and payload */
+    const char *data;         /* stored payload within body, or NULL */
+};
+
+static enum replay_mode mode = MODE_ALWAYS;
+static unsigned long seq_counter = 0;
+static size_t last_len = 0;
+static uint64_t last_hash = 0;
+static unsigned long n_notify = 0, n_read = 0, n_publish = 0;
+static unsigned long n_dedupe = 0, n_coalesced = 0;
+
+/* Fill buf with bytes derived from hash (xorshift64*), printable so the
+   history ring sees text. */
+static void synth_text(char *buf, size_t len, uint64_t hash) {
+    uint64_t x = hash ? hash : ZES_P64_1;
+    for (size_t i = 0; i < len; i++) {
+        x ^= x >> 12;
+        x ^= x << 25;
+        x ^= x >> 27;
+        buf[i] = (char)(' ' + (x * 0x2545F4914F6CDD1DULL >> 56) % 95);
+    }
+}
+
+/* Publish one read as the agent would, timed as one selection event. */
+static void replay_publish(const struct replay_read *rd) {
+    long long start = monotonic_us();
+    if (mode == MODE_DEDUPE && rd->len == last_len && rd->hash == last_hash) {
+        n_dedupe++;
+        return;
+    }
+
+    char *text = NULL;
+    if (rd->len > 0) {
+        text = arena_reserve(rd->len + 1);
+        if (!text) return;
+        if (rd->data)
+            memcpy(text, rd->data, rd->len);
+        else
+            synth_text(text, rd->len, rd->hash);
+        text[rd->len] = '\0';
+    }
+
+    seq_counter++;
+    write_primary(text ? text : "", rd->len, seq_counter);
+    hist_record(text, rd->len);
+    last_len = rd->len;
+    last_hash = rd->hash;
+    n_publish++;
+
+    met_events++;
+    met_bytes += rd->len;
+    met_record(&met_event, monotonic_us() - start);
+}
+
+/* Sleep until the trace's t_us (scaled by speed) on the replay clock. */
+static void replay_wait_until(long long origin_us, uint64_t t_us, double speed) {
+    if (speed <= 0) return;
+    long long due = origin_us + (long long)((double)t_us / speed);
+    long long now = monotonic_us();
+    if (due > now) usleep((useconds_t)(due - now));
+}
+
+/* met_percentile_us() reports bucket upper bounds; never past the max. */
+static unsigned long long hist_pct(const struct met_hist *h, unsigned int pct) {
+    unsigned long long v = met_percentile_us(h, pct);
+    return v < h->max_us ? v : h->max_us;
+}
+
+static void clear_cache_dir(void) {
+    unlink(primary_path);
+    unlink(seq_path);
+    rmdir(cache_dir);
+}
+
+int main(int argc, char *argv[]) {
+    const char *trace_path = NULL;
+    const char *mode_arg = NULL;
+    long coalesce_ms = 0;
+    double speed = 1.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) mode_arg = argv[++i];
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) coalesce_ms = strtol(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) speed = strtod(argv[++i], NULL);
+        else if (strcmp(argv[i], "-f") == 0) speed = 0;
+        else trace_path = argv[i];
+    }
+    if (!trace_path || coalesce_ms < 0 || coalesce_ms > 1000 || speed < 0) {
+        fprintf(stderr, "Usage: %s [-m x11|xwayland|wayland|wsl] [-c coalesce-ms (0-1000)] "
+                        "[-s speed | -f] <trace-file>\n", argv[0]);
+        return 1;
+    }
+
+    FILE *fp = fopen(trace_path, "rb");
+    if (!fp) {
+        perror(trace_path);
+        return 1;
+    }
+    char hdr[16];
+    if (fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr) ||
+        memcmp(hdr, TRACE_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s: not a selection trace\n", trace_path);
+        fclose(fp);
+        return 1;
+    }
+    char agent[9];
+    memcpy(agent, hdr + 8, 8);
+    agent[8] = '\0';
+    if (!mode_arg) mode_arg = agent;
+    if (strcmp(mode_arg, "wayland") == 0) {
+        mode = MODE_DEDUPE;
+    } else if (strcmp(mode_arg, "x11") != 0 && strcmp(mode_arg, "xwayland") != 0 &&
+               strcmp(mode_arg, "wsl") != 0) {
+        fprintf(stderr, "%s: unknown mode '%s'\n", trace_path, mode_arg);
+        fclose(fp);
+        return 1;
+    }
+
+    char dir[512];
+    const char *tmp = getenv("XDG_RUNTIME_DIR");
+    snprintf(dir, sizeof(dir), "%s/zes-trace-replay-%d",
+             tmp && *tmp ? tmp : "/tmp", (int)getpid());
+    if (ensure_cache_dir(dir) != 0) {
+        fprintf(stderr, "Cannot create cache directory %s\n", dir);
+        fclose(fp);
+        return 1;
+    }
+    fd_primary = open(primary_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    fd_seq     = open(seq_path,    O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+
+    long long coalesce_us = coalesce_ms * 1000LL;
+    long long due_us = 0;                 /* trace time of the pending flush */
+    struct replay_read rd = { false, 0, 0, NULL, NULL };
+    struct zes_trace_rec rec;
+    uint64_t end_us = 0;
+    bool truncated = false;
+    /* Spacing of the recorded reads: on Mutter a static selection is only
+       re-read on the Wayland agent's backoff timer. */
+    uint64_t last_read_us = 0, gap_last_us = 0, gap_max_us = 0;
+
+    met_start_us = monotonic_us();
+    long long origin = met_start_us;
+    size_t got;
+    while ((got = fread(&rec, 1, sizeof(rec), fp)) == sizeof(rec)) {
+        size_t extra = (size_t)rec.mime_len + rec.data_len;
+        if (rec.data_len > rec.len || extra > MAX_REPLAY_RECORD) {
+            truncated = true;
+            break;
+        }
+
+        /* A coalesced read is due before this record: publish it at its
+           deadline, with whatever the source held then. */
+        if (due_us && (long long)rec.t_us >= due_us) {
+            replay_wait_until(origin, (uint64_t)due_us, speed);
+            if (rd.pending) replay_publish(&rd);
+            rd.pending = false;
+            due_us = 0;
+        }
+        replay_wait_until(origin, rec.t_us, speed);
+        end_us = rec.t_us;
+
+        /* MIME type, then payload; a short read means the agent died
+           mid-record. */
+        char *body = extra ? malloc(extra) : NULL;
+        if (extra && (!body || fread(body, 1, extra, fp) != extra)) {
+            free(body);
+            truncated = true;
+            break;
+        }
+
+        if (rec.type == TRACE_NOTIFY) {
+            free(body);
+            n_notify++;
+            if (coalesce_us && !due_us)
+                due_us = (long long)rec.t_us + coalesce_us;
+        } else if (rec.type == TRACE_READ) {
+            if (n_read > 0) {
+                gap_last_us = rec.t_us - last_read_us;
+                if (gap_last_us > gap_max_us) gap_max_us = gap_last_us;
+            }
+            last_read_us = rec.t_us;
+            n_read++;
+            met_record(&met_wait, rec.wait_us);
+            if (rd.pending) n_coalesced++;
+            rd.pending = true;
+            rd.hash = rec.hash;
+            rd.len = rec.len;
+            free(rd.body);
+            rd.body = body;
+            rd.data = rec.data_len ? body + rec.mime_len : NULL;
+            if (!due_us) {
+                replay_publish(&rd);
+                rd.pending = false;
+            }
+        } else {
+            free(body);
+        }
+    }
+    if (got != 0 || ferror(fp)) truncated = true;
+    if (rd.pending) replay_publish(&rd);
+    fclose(fp);
+    free(rd.body);
+    long long elapsed = monotonic_us() - met_start_us;
+
+    printf("{\n");
+    printf("  \"benchmark\": \"trace-replay\",\n");
+    printf("  \"trace_agent\": \"%s\",\n", agent);
+    printf("  \"mode\": \"%s\",\n", mode_arg);
+    printf("  \"coalesce_ms\": %ld,\n", coalesce_ms);
+    printf("  \"trace_ms\": %.3f,\n", end_us / 1000.0);
+    printf("  \"replay_ms\": %.3f,\n", elapsed / 1000.0);
+    printf("  \"truncated\": %s,\n", truncated ? "true" : "false");
+    printf("  \"notifies\": %lu,\n", n_notify);
+    printf("  \"reads\": %lu,\n", n_read);
+    printf("  \"publishes\": %lu,\n", n_publish);
+    printf("  \"deduped\": %lu,\n", n_dedupe);
+    printf("  \"coalesced\": %lu,\n", n_coalesced);
+    printf("  \"bytes\": %llu,\n", met_bytes);
+    printf("  \"read_gap_ms\": {\"last\": %.3f, \"max\": %.3f},\n",
+           gap_last_us / 1000.0, gap_max_us / 1000.0);
+    printf("  \"recorded_wait_us\": {\"p50\": %llu, \"p99\": %llu, \"max\": %llu},\n",
+           hist_pct(&met_wait, 50), hist_pct(&met_wait, 99),
+           met_wait.max_us);
+    printf("  \"publish_us\": {\"p50\": %llu, \"p99\": %llu, \"max\": %llu}\n",
+           hist_pct(&met_event, 50), hist_pct(&met_event, 99),
+           met_event.max_us);
+    printf("}\n");
+
+    if (fd_primary >= 0) close(fd_primary);
+    if (fd_seq >= 0) close(fd_seq);
+    clear_cache_dir();
+    return truncated ? 1 : 0;
+}
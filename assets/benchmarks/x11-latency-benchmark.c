@@ -0,0 +1,396 @@
+/*
+ * X11 End-to-End Latency Benchmark
+ *
+ * Measures the paths the shell actually waits on, against a running
+ * zes-x11-selection-agent daemon started in a private cache directory:
+ *
+ *   propagation  XSetSelectionOwner(PRIMARY) by a synthetic owner window
+ *                until the new text is in <cache_dir>/primary
+ *   paste        socket "GET" round trip, with the synthetic window owning
+ *                CLIPBOARD (what the paste widget does on every keystroke)
+ *   idle         daemon context switches per second while nothing happens
+ *
+ * Results are printed as one JSON object (p50/p99/max per path) so runs
+ * can be stored and diffed to track regressions.
+ */
+
+#define _GNU_SOURCE
+
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NANO_PER_SEC 1000000000L
+#define SAMPLE_TIMEOUT_MS 1000
+
+typedef struct {
+    double *samples;   /* milliseconds */
+    int count;
+    int missed;        /* iterations that hit SAMPLE_TIMEOUT_MS */
+} latency_result;
+
+static Display *dpy;
+static Window owner;
+static Atom xa_primary, xa_clipboard, xa_targets, xa_utf8, xa_text;
+static char *primary_text, *clipboard_text;
+static size_t primary_len, clipboard_len;
+
+static char cache_dir[512];
+static char primary_path[600], sock_path[600], pid_path[600];
+
+static double get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / (double)NANO_PER_SEC;
+}
+
+/* ── Synthetic selection owner ───────────────────────────────────────── */
+
+static void serve_selection_request(XSelectionRequestEvent *req) {
+    XSelectionEvent ev = {0};
+    ev.type = SelectionNotify;
+    ev.requestor = req->requestor;
+    ev.selection = req->selection;
+    ev.target = req->target;
+    ev.time = req->time;
+    ev.property = None;
+
+    const char *data = req->selection == xa_primary ? primary_text : clipboard_text;
+    size_t len = req->selection == xa_primary ? primary_len : clipboard_len;
+    Atom prop = req->property != None ? req->property : req->target;
+
+    if (data && req->target == xa_targets) {
+        Atom targets[] = { xa_targets, xa_utf8, XA_STRING, xa_text };
+        XChangeProperty(dpy, req->requestor, prop, XA_ATOM, 32, PropModeReplace,
+                        (unsigned char *)targets, 4);
+        ev.property = prop;
+    } else if (data && (req->target == xa_utf8 || req->target == XA_STRING ||
+                        req->target == xa_text)) {
+        XChangeProperty(dpy, req->requestor, prop, req->target, 8, PropModeReplace,
+                        (const unsigned char *)data, (int)len);
+        ev.property = prop;
+    }
+    XSendEvent(dpy, req->requestor, False, 0, (XEvent *)&ev);
+    XFlush(dpy);
+}
+
+/* Answer every queued SelectionRequest for our window. */
+static void pump_x_events(void) {
+    while (XPending(dpy)) {
+        XEvent ev;
+        XNextEvent(dpy, &ev);
+        if (ev.type == SelectionRequest)
+            serve_selection_request(&ev.xselectionrequest);
+    }
+}
+
+/* Distinct text per iteration so the agent's duplicate suppression never
+   swallows a sample. */
+static void make_payload(char **buf, size_t *len, size_t size, const char *tag, int i) {
+    free(*buf);
+    *buf = malloc(size + 1);
+    int n = snprintf(*buf, size + 1, "zes-%s-%d-", tag, i);
+    if ((size_t)n > size) n = (int)size;
+    for (size_t k = (size_t)n; k < size; k++) (*buf)[k] = (char)('a' + k % 26);
+    (*buf)[size] = '\0';
+    *len = size;
+}
+
+/* ── Agent lifecycle ─────────────────────────────────────────────────── */
+
+static pid_t read_agent_pid(void) {
+    FILE *f = fopen(pid_path, "r");
+    if (!f) return 0;
+    int pid = 0;
+    if (fscanf(f, "%d", &pid) != 1) pid = 0;
+    fclose(f);
+    return (pid_t)pid;
+}
+
+/* Start the agent daemon on our cache directory and wait until its socket
+   is accepting requests. */
+static pid_t start_agent(const char *agent_path) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        int nul = open("/dev/null", O_RDWR);
+        if (nul >= 0) { dup2(nul, STDOUT_FILENO); dup2(nul, STDERR_FILENO); }
+        execl(agent_path, agent_path, cache_dir, (char *)NULL);
+        _exit(127);
+    }
+    if (pid < 0) return 0;
+    int status;
+    waitpid(pid, &status, 0);   /* parent exits once daemon() has forked */
+
+    struct stat st;
+    for (int i = 0; i < 200; i++) {
+        pid_t daemon_pid = read_agent_pid();
+        if (daemon_pid > 0 && stat(sock_path, &st) == 0) return daemon_pid;
+        usleep(10000);
+    }
+    return 0;
+}
+
+/* ── Propagation: owner change → primary cache file ─────────────────── */
+
+static int primary_matches(void) {
+    int fd = open(primary_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    char *buf = malloc(primary_len + 1);
+    ssize_t n = read(fd, buf, primary_len + 1);
+    close(fd);
+    int ok = n == (ssize_t)primary_len && memcmp(buf, primary_text, primary_len) == 0;
+    free(buf);
+    return ok;
+}
+
+static latency_result bench_propagation(size_t size, int iterations) {
+    latency_result res = { calloc((size_t)iterations, sizeof(double)), 0, 0 };
+
+    int in = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (in < 0 || inotify_add_watch(in, cache_dir, IN_MODIFY | IN_CLOSE_WRITE |
+                                                   IN_MOVED_TO) < 0) {
+        if (in >= 0) close(in);
+        res.missed = iterations;
+        return res;
+    }
+
+    for (int i = 0; i < iterations; i++) {
+        make_payload(&primary_text, &primary_len, size, "primary", i);
+
+        double start = get_time();
+        XSetSelectionOwner(dpy, xa_primary, owner, CurrentTime);
+        XFlush(dpy);
+
+        int done = 0;
+        while (!done) {
+            double left = SAMPLE_TIMEOUT_MS - (get_time() - start) * 1000;
+            if (left <= 0) break;
+            struct pollfd pfds[2] = {
+                { ConnectionNumber(dpy), POLLIN, 0 },
+                { in, POLLIN, 0 },
+            };
+            pump_x_events();
+            if (poll(pfds, 2, (int)left + 1) < 0 && errno != EINTR) break;
+            if (pfds[0].revents & POLLIN) pump_x_events();
+            if (pfds[1].revents & POLLIN) {
+                char evbuf[4096];
+                while (read(in, evbuf, sizeof(evbuf)) > 0) {}
+                done = primary_matches();
+            }
+        }
+
+        if (done) res.samples[res.count++] = (get_time() - start) * 1000;
+        else res.missed++;
+        usleep(2000);   /* let the agent return to idle between samples */
+    }
+
+    close(in);
+    return res;
+}
+
+/* ── Paste: socket GET round trip with us owning CLIPBOARD ──────────── */
+
+static int sock_get(double start) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) return 0;
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock_path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return 0;
+    }
+    if (write(fd, "GET 0\n", 6) != 6) { close(fd); return 0; }
+
+    /* Keep serving our CLIPBOARD while the agent converts from us. */
+    char *reply = malloc(clipboard_len + 64);
+    size_t have = 0, want = 0;
+    int ok = 0;
+    for (;;) {
+        double left = SAMPLE_TIMEOUT_MS - (get_time() - start) * 1000;
+        if (left <= 0) break;
+        struct pollfd pfds[2] = {
+            { ConnectionNumber(dpy), POLLIN, 0 },
+            { fd, POLLIN, 0 },
+        };
+        pump_x_events();
+        if (poll(pfds, 2, (int)left + 1) < 0 && errno != EINTR) break;
+        if (pfds[0].revents & POLLIN) pump_x_events();
+        if (!(pfds[1].revents & (POLLIN | POLLHUP))) continue;
+
+        ssize_t n = read(fd, reply + have, clipboard_len + 64 - have);
+        if (n <= 0) break;
+        have += (size_t)n;
+        char *nl = memchr(reply, '\n', have);
+        if (!nl) continue;
+        if (memcmp(reply, "OK ", 3) != 0) break;
+        want = (size_t)(nl - reply) + 1 + strtoul(reply + 3, NULL, 10);
+        if (have >= want) {
+            ok = want - ((size_t)(nl - reply) + 1) == clipboard_len &&
+                 memcmp(nl + 1, clipboard_text, clipboard_len) == 0;
+            break;
+        }
+    }
+    free(reply);
+    close(fd);
+    return ok;
+}
+
+static latency_result bench_paste(size_t size, int iterations) {
+    latency_result res = { calloc((size_t)iterations, sizeof(double)), 0, 0 };
+
+    for (int i = 0; i < iterations; i++) {
+        make_payload(&clipboard_text, &clipboard_len, size, "clipboard", i);
+        XSetSelectionOwner(dpy, xa_clipboard, owner, CurrentTime);
+        XFlush(dpy);
+
+        double start = get_time();
+        if (sock_get(start)) res.samples[res.count++] = (get_time() - start) * 1000;
+        else res.missed++;
+    }
+    return res;
+}
+
+/* ── Idle wakeups: context switches of the daemon over a quiet window ─ */
+
+static long ctxt_switches(pid_t pid) {
+    char path[64], line[256];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    long total = 0, v;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "voluntary_ctxt_switches: %ld", &v) == 1 ||
+            sscanf(line, "nonvoluntary_ctxt_switches: %ld", &v) == 1)
+            total += v;
+    }
+    fclose(f);
+    return total;
+}
+
+static double bench_idle(pid_t pid, int seconds) {
+    long before = ctxt_switches(pid);
+    double start = get_time();
+    sleep((unsigned)seconds);
+    long after = ctxt_switches(pid);
+    if (before < 0 || after < 0) return -1;
+    return (after - before) / (get_time() - start);
+}
+
+/* ── Reporting ───────────────────────────────────────────────────────── */
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of sorted samples. */
+static double percentile(const latency_result *r, int pct) {
+    if (r->count == 0) return 0;
+    int rank = (r->count * pct + 99) / 100;
+    if (rank < 1) rank = 1;
+    return r->samples[rank - 1];
+}
+
+static void print_latency(const char *name, latency_result *r, int last) {
+    qsort(r->samples, (size_t)r->count, sizeof(double), cmp_double);
+    printf("  \"%s_ms\": {\"samples\": %d, \"missed\": %d, "
+           "\"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f}%s\n",
+           name, r->count, r->missed, percentile(r, 50), percentile(r, 99),
+           r->count ? r->samples[r->count - 1] : 0.0, last ? "" : ",");
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 200;
+    size_t size = 64;
+    int idle_seconds = 5;
+    const char *agent_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) size = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) idle_seconds = atoi(argv[++i]);
+        else agent_path = argv[i];
+    }
+    if (!agent_path || iterations <= 0 || size < 16 || size > 65536 || idle_seconds < 0) {
+        fprintf(stderr, "Usage: %s [-n iterations] [-s bytes (16-65536)] "
+                        "[-i idle-seconds] <agent-path>\n", argv[0]);
+        return 1;
+    }
+
+    dpy = XOpenDisplay(NULL);
+    if (!dpy) {
+        fprintf(stderr, "Cannot open X display\n");
+        return 1;
+    }
+    owner = XCreateSimpleWindow(dpy, DefaultRootWindow(dpy), 0, 0, 1, 1, 0, 0, 0);
+    xa_primary = XA_PRIMARY;
+    xa_clipboard = XInternAtom(dpy, "CLIPBOARD", False);
+    xa_targets = XInternAtom(dpy, "TARGETS", False);
+    xa_utf8 = XInternAtom(dpy, "UTF8_STRING", False);
+    xa_text = XInternAtom(dpy, "TEXT", False);
+
+    const char *tmp = getenv("XDG_RUNTIME_DIR");
+    snprintf(cache_dir, sizeof(cache_dir), "%s/zes-latency-bench-%d",
+             tmp && *tmp ? tmp : "/tmp", (int)getpid());
+    snprintf(primary_path, sizeof(primary_path), "%s/primary", cache_dir);
+    snprintf(sock_path, sizeof(sock_path), "%s/agent.sock", cache_dir);
+    snprintf(pid_path, sizeof(pid_path), "%s/agent.pid", cache_dir);
+    if (mkdir(cache_dir, 0700) != 0 && errno != EEXIST) {
+        perror("mkdir");
+        return 1;
+    }
+
+    pid_t agent = start_agent(agent_path);
+    if (agent <= 0) {
+        fprintf(stderr, "Agent did not start (no %s)\n", sock_path);
+        return 1;
+    }
+
+    latency_result prop = bench_propagation(size, iterations);
+    latency_result paste = bench_paste(size, iterations);
+    double idle = idle_seconds > 0 ? bench_idle(agent, idle_seconds) : -1;
+
+    printf("{\n");
+    printf("  \"benchmark\": \"x11-latency\",\n");
+    printf("  \"payload_bytes\": %zu,\n", size);
+    printf("  \"iterations\": %d,\n", iterations);
+    print_latency("propagation", &prop, 0);
+    print_latency("paste", &paste, 0);
+    printf("  \"idle\": {\"seconds\": %d, \"wakeups_per_sec\": %.2f}\n", idle_seconds, idle);
+    printf("}\n");
+
+    kill(agent, SIGTERM);
+    for (int i = 0; i < 100 && kill(agent, 0) == 0; i++) usleep(10000);
+    unlink(primary_path);
+    unlink(pid_path);
+    unlink(sock_path);
+    char path[600];
+    const char *leftovers[] = { "seq", "ring", "agent.stats", "agent.metrics" };
+    for (size_t i = 0; i < sizeof(leftovers) / sizeof(leftovers[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, leftovers[i]);
+        unlink(path);
+    }
+    rmdir(cache_dir);
+
+    free(prop.samples);
+    free(paste.samples);
+    free(primary_text);
+    free(clipboard_text);
+    XDestroyWindow(dpy, owner);
+    XCloseDisplay(dpy);
+
+    return prop.count > 0 && paste.count > 0 ? 0 : 1;
+}
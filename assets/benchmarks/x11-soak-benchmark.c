@@ -0,0 +1,537 @@
+/*
+ * X11 Daemon Soak Benchmark
+ *
+ * Drives a running zes-x11-selection-agent (or zes-xwayland-agent) daemon,
+ * started in a private cache directory, through a long mix of events:
+ *
+ *   primary        XSetSelectionOwner(PRIMARY) by a synthetic owner window,
+ *                  until the new text is in <cache_dir>/primary
+ *   paste          socket "GET" round trip with the window owning CLIPBOARD
+ *   copy           `agent <cache_dir> --copy-clipboard` (handed to the
+ *                  daemon with SET)
+ *   copy-fallback  `agent <cache_dir>/none --copy-clipboard`, which finds
+ *                  no daemon there and forks its own clipboard server
+ *
+ * Payload sizes vary from a few bytes up to -m.  The daemon's RSS and open
+ * fds, and the number of lingering --copy-clipboard servers, are sampled
+ * from /proc.  The run fails if, after the warm-up, RSS grows by more than
+ * the slack, if the fd count grows, or if servers outlive their ownership.
+ *
+ * Results are printed as one JSON object, like x11-latency-benchmark's.
+ */
+
+#define _GNU_SOURCE
+
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NANO_PER_SEC 1000000000L
+#define SAMPLE_TIMEOUT_MS 1000
+#define PRIMARY_CAP (1024 * 1024)   /* the agents' MAX_SELECTION_SIZE */
+#define WARMUP_PCT 20               /* samples before this point set the baseline */
+
+typedef struct {
+    unsigned long event;
+    long rss_kb;
+    int fds;
+    int servers;                    /* lingering --copy-clipboard servers */
+} soak_sample;
+
+static Display *dpy;
+static Window owner;
+static Atom xa_primary, xa_clipboard, xa_targets, xa_utf8, xa_text;
+static char *primary_text, *clipboard_text;
+static size_t primary_len, clipboard_len;
+static const char *agent_path;
+
+static char cache_dir[512];
+static char primary_path[600], sock_path[600], pid_path[600];
+static char fallback_dir[600];      /* never has a daemon socket */
+
+static unsigned long n_primary, n_paste, n_copy, n_fallback, n_missed;
+
+static double get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / (double)NANO_PER_SEC;
+}
+
+/* ── Synthetic selection owner ───────────────────────────────────────── */
+
+static void serve_selection_request(XSelectionRequestEvent *req) {
+    XSelectionEvent ev = {0};
+    ev.type = SelectionNotify;
+    ev.requestor = req->requestor;
+    ev.selection = req->selection;
+    ev.target = req->target;
+    ev.time = req->time;
+    ev.property = None;
+
+    const char *data = req->selection == xa_primary ? primary_text : clipboard_text;
+    size_t len = req->selection == xa_primary ? primary_len : clipboard_len;
+    Atom prop = req->property != None ? req->property : req->target;
+
+    if (data && req->target == xa_targets) {
+        Atom targets[] = { xa_targets, xa_utf8, XA_STRING, xa_text };
+        XChangeProperty(dpy, req->requestor, prop, XA_ATOM, 32, PropModeReplace,
+                        (unsigned char *)targets, 4);
+        ev.property = prop;
+    } else if (data && (req->target == xa_utf8 || req->target == XA_STRING ||
+                        req->target == xa_text)) {
+        XChangeProperty(dpy, req->requestor, prop, req->target, 8, PropModeReplace,
+                        (const unsigned char *)data, (int)len);
+        ev.property = prop;
+    }
+    XSendEvent(dpy, req->requestor, False, 0, (XEvent *)&ev);
+    XFlush(dpy);
+}
+
+/* Answer every queued SelectionRequest for our window. */
+static void pump_x_events(void) {
+    while (XPending(dpy)) {
+        XEvent ev;
+        XNextEvent(dpy, &ev);
+        if (ev.type == SelectionRequest)
+            serve_selection_request(&ev.xselectionrequest);
+    }
+}
+
+/* Distinct text per event so the agent's duplicate suppression never
+   swallows one. */
+static void make_payload(char **buf, size_t *len, size_t size, const char *tag,
+                         unsigned long i) {
+    free(*buf);
+    *buf = malloc(size + 1);
+    int n = snprintf(*buf, size + 1, "zes-%s-%lu-", tag, i);
+    if ((size_t)n > size) n = (int)size;
+    for (size_t k = (size_t)n; k < size; k++) (*buf)[k] = (char)('a' + k % 26);
+    (*buf)[size] = '\0';
+    *len = size;
+}
+
+/* Mostly short selections, some medium, a few up to max: each class shows
+   up within the first events, so the warm-up sees the high-water mark. */
+static size_t pick_size(unsigned long i, size_t max) {
+    static uint64_t x = 0x9E3779B97F4A7C15ULL;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    uint64_t r = x * 0x2545F4914F6CDD1DULL;
+    size_t size;
+    if (i % 1000 == 3)          size = max;
+    else if (r % 100 < 70)      size = 16 + r / 100 % 4080;
+    else if (r % 100 < 95)      size = 4096 + r / 100 % 61440;
+    else                        size = 65536 + r / 100 % max;
+    return size < max ? size : max;
+}
+
+/* ── Agent lifecycle ─────────────────────────────────────────────────── */
+
+static pid_t read_agent_pid(void) {
+    FILE *f = fopen(pid_path, "r");
+    if (!f) return 0;
+    int pid = 0;
+    if (fscanf(f, "%d", &pid) != 1) pid = 0;
+    fclose(f);
+    return (pid_t)pid;
+}
+
+/* Start the agent daemon on our cache directory and wait until its socket
+   is accepting requests. */
+static pid_t start_agent(void) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        int nul = open("/dev/null", O_RDWR);
+        if (nul >= 0) { dup2(nul, STDOUT_FILENO); dup2(nul, STDERR_FILENO); }
+        execl(agent_path, agent_path, cache_dir, (char *)NULL);
+        _exit(127);
+    }
+    if (pid < 0) return 0;
+    int status;
+    waitpid(pid, &status, 0);   /* parent exits once daemon() has forked */
+
+    struct stat st;
+    for (int i = 0; i < 200; i++) {
+        pid_t daemon_pid = read_agent_pid();
+        if (daemon_pid > 0 && stat(sock_path, &st) == 0) return daemon_pid;
+        usleep(10000);
+    }
+    return 0;
+}
+
+/* ── /proc sampling ──────────────────────────────────────────────────── */
+
+static long proc_rss_kb(pid_t pid) {
+    char path[64], line[256];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    long rss = -1;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "VmRSS: %ld", &rss) == 1) break;
+    fclose(f);
+    return rss;
+}
+
+static int proc_fd_count(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/fd", (int)pid);
+    DIR *d = opendir(path);
+    if (!d) return -1;
+    int n = 0;
+    struct dirent *de;
+    while ((de = readdir(d)))
+        if (de->d_name[0] != '.') n++;
+    closedir(d);
+    return n;
+}
+
+/* Processes running agent_path with --copy-clipboard (the daemon itself
+   and our short-lived clients are not counted once they have exited). */
+static int count_copy_servers(void) {
+    DIR *d = opendir("/proc");
+    if (!d) return -1;
+    int n = 0;
+    struct dirent *de;
+    char path[300], buf[4096];
+    while ((de = readdir(d))) {
+        if (de->d_name[0] < '0' || de->d_name[0] > '9') continue;
+        snprintf(path, sizeof(path), "/proc/%s/cmdline", de->d_name);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        ssize_t len = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (len <= 0) continue;
+        buf[len] = '\0';
+        if (strcmp(buf, agent_path) != 0) continue;
+        for (char *arg = buf; arg < buf + len; arg += strlen(arg) + 1)
+            if (strcmp(arg, "--copy-clipboard") == 0) { n++; break; }
+    }
+    closedir(d);
+    return n;
+}
+
+/* ── Events ──────────────────────────────────────────────────────────── */
+
+static int primary_matches(void) {
+    int fd = open(primary_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    char *buf = malloc(primary_len + 1);
+    ssize_t n = read(fd, buf, primary_len + 1);
+    close(fd);
+    int ok = n == (ssize_t)primary_len && memcmp(buf, primary_text, primary_len) == 0;
+    free(buf);
+    return ok;
+}
+
+static int event_primary(int in, size_t size, unsigned long i) {
+    make_payload(&primary_text, &primary_len, size, "primary", i);
+    double start = get_time();
+    XSetSelectionOwner(dpy, xa_primary, owner, CurrentTime);
+    XFlush(dpy);
+
+    for (;;) {
+        double left = SAMPLE_TIMEOUT_MS - (get_time() - start) * 1000;
+        if (left <= 0) return 0;
+        struct pollfd pfds[2] = {
+            { ConnectionNumber(dpy), POLLIN, 0 },
+            { in, POLLIN, 0 },
+        };
+        pump_x_events();
+        if (poll(pfds, 2, (int)left + 1) < 0 && errno != EINTR) return 0;
+        if (pfds[0].revents & POLLIN) pump_x_events();
+        if (pfds[1].revents & POLLIN) {
+            char evbuf[4096];
+            while (read(in, evbuf, sizeof(evbuf)) > 0) {}
+            if (primary_matches()) return 1;
+        }
+    }
+}
+
+static int event_paste(size_t size, unsigned long i) {
+    make_payload(&clipboard_text, &clipboard_len, size, "clipboard", i);
+    XSetSelectionOwner(dpy, xa_clipboard, owner, CurrentTime);
+    XFlush(dpy);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) return 0;
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    size_t path_len = strlen(sock_path);
+    if (path_len >= sizeof(addr.sun_path)) { close(fd); return 0; }
+    memcpy(addr.sun_path, sock_path, path_len + 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return 0;
+    }
+    if (write(fd, "GET 0\n", 6) != 6) { close(fd); return 0; }
+
+    /* Keep serving our CLIPBOARD while the agent converts from us; only
+       the reply header and length are checked. */
+    double start = get_time();
+    char head[64];
+    size_t have = 0, body = 0, want = 0;
+    int ok = 0;
+    for (;;) {
+        double left = SAMPLE_TIMEOUT_MS - (get_time() - start) * 1000;
+        if (left <= 0) break;
+        struct pollfd pfds[2] = {
+            { ConnectionNumber(dpy), POLLIN, 0 },
+            { fd, POLLIN, 0 },
+        };
+        pump_x_events();
+        if (poll(pfds, 2, (int)left + 1) < 0 && errno != EINTR) break;
+        if (pfds[0].revents & POLLIN) pump_x_events();
+        if (!(pfds[1].revents & (POLLIN | POLLHUP))) continue;
+
+        char buf[65536];
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) break;
+        size_t off = 0;
+        if (!want) {
+            while (off < (size_t)n && have < sizeof(head) - 1 && buf[off] != '\n')
+                head[have++] = buf[off++];
+            if (off == (size_t)n) continue;
+            head[have] = '\0';
+            off++;
+            if (memcmp(head, "OK ", 3) != 0) break;
+            want = strtoul(head + 3, NULL, 10);
+            if (want != clipboard_len) break;
+        }
+        body += (size_t)n - off;
+        if (body >= want) { ok = 1; break; }
+    }
+    close(fd);
+    return ok;
+}
+
+/* Run `agent <dir> --copy-clipboard` with size bytes on stdin. */
+static int event_copy(size_t size, unsigned long i, int fallback) {
+    make_payload(&clipboard_text, &clipboard_len, size, "copy", i);
+    int pipefd[2];
+    if (pipe(pipefd) < 0) return 0;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(pipefd[1]);
+        dup2(pipefd[0], STDIN_FILENO);
+        close(pipefd[0]);
+        int nul = open("/dev/null", O_RDWR);
+        if (nul >= 0) { dup2(nul, STDOUT_FILENO); dup2(nul, STDERR_FILENO); }
+        execl(agent_path, agent_path, fallback ? fallback_dir : cache_dir,
+              "--copy-clipboard", (char *)NULL);
+        _exit(127);
+    }
+    close(pipefd[0]);
+    if (pid < 0) { close(pipefd[1]); return 0; }
+    size_t off = 0;
+    while (off < clipboard_len) {
+        ssize_t n = write(pipefd[1], clipboard_text + off, clipboard_len - off);
+        if (n <= 0) break;
+        off += (size_t)n;
+    }
+    close(pipefd[1]);
+    int status;
+    waitpid(pid, &status, 0);   /* the fallback server forks and detaches */
+    pump_x_events();
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/* ── Reporting ───────────────────────────────────────────────────────── */
+
+static void take_sample(soak_sample *s, pid_t agent, unsigned long event) {
+    s->event = event;
+    s->rss_kb = proc_rss_kb(agent);
+    s->fds = proc_fd_count(agent);
+    s->servers = count_copy_servers();
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long events = 100000;
+    size_t max_size = PRIMARY_CAP;
+    int nsamples = 50;
+    long slack_kb = 1024;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) events = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) max_size = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) nsamples = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) slack_kb = atol(argv[++i]);
+        else agent_path = argv[i];
+    }
+    if (!agent_path || events < 1000 || max_size < 4096 || max_size > 64UL * 1024 * 1024 ||
+        nsamples < 10 || (unsigned long)nsamples > events / 10 || slack_kb < 0) {
+        fprintf(stderr, "Usage: %s [-n events (>= 1000)] [-m max-bytes (4096-67108864)] "
+                        "[-k samples (10 to events/10)] [-g rss-slack-kb] <agent-path>\n",
+                argv[0]);
+        return 1;
+    }
+
+    dpy = XOpenDisplay(NULL);
+    if (!dpy) {
+        fprintf(stderr, "Cannot open X display\n");
+        return 1;
+    }
+    owner = XCreateSimpleWindow(dpy, DefaultRootWindow(dpy), 0, 0, 1, 1, 0, 0, 0);
+    xa_primary = XA_PRIMARY;
+    xa_clipboard = XInternAtom(dpy, "CLIPBOARD", False);
+    xa_targets = XInternAtom(dpy, "TARGETS", False);
+    xa_utf8 = XInternAtom(dpy, "UTF8_STRING", False);
+    xa_text = XInternAtom(dpy, "TEXT", False);
+
+    const char *tmp = getenv("XDG_RUNTIME_DIR");
+    snprintf(cache_dir, sizeof(cache_dir), "%s/zes-soak-bench-%d",
+             tmp && *tmp ? tmp : "/tmp", (int)getpid());
+    snprintf(primary_path, sizeof(primary_path), "%s/primary", cache_dir);
+    snprintf(sock_path, sizeof(sock_path), "%s/agent.sock", cache_dir);
+    snprintf(pid_path, sizeof(pid_path), "%s/agent.pid", cache_dir);
+    snprintf(fallback_dir, sizeof(fallback_dir), "%s/none", cache_dir);
+    if (mkdir(cache_dir, 0700) != 0 && errno != EEXIST) {
+        perror("mkdir");
+        return 1;
+    }
+
+    pid_t agent = start_agent();
+    if (agent <= 0) {
+        fprintf(stderr, "Agent did not start (no %s)\n", sock_path);
+        return 1;
+    }
+
+    int in = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (in < 0 || inotify_add_watch(in, cache_dir, IN_MODIFY | IN_CLOSE_WRITE |
+                                                   IN_MOVED_TO) < 0) {
+        perror("inotify");
+        kill(agent, SIGTERM);
+        return 1;
+    }
+
+    soak_sample *samples = calloc((size_t)nsamples + 1, sizeof(*samples));
+    unsigned long every = events / (unsigned long)nsamples;
+    int taken = 0, peak_servers = 0;
+    int alive = 1;
+    double start = get_time();
+
+    for (unsigned long i = 0; i < events && alive; i++) {
+        size_t size = pick_size(i, max_size);
+        switch (i % 16) {
+        case 5: case 13:
+            n_paste++;
+            if (!event_paste(size, i)) n_missed++;
+            break;
+        case 7:
+            n_copy++;
+            if (!event_copy(size, i, 0)) n_missed++;
+            break;
+        case 15:
+            n_fallback++;
+            if (!event_copy(size, i, 1)) n_missed++;
+            break;
+        default:
+            n_primary++;
+            if (!event_primary(in, size < PRIMARY_CAP ? size : PRIMARY_CAP, i)) n_missed++;
+            break;
+        }
+        if ((i + 1) % every == 0 && taken < nsamples) {
+            take_sample(&samples[taken], agent, i + 1);
+            if (samples[taken].servers > peak_servers) peak_servers = samples[taken].servers;
+            alive = samples[taken].rss_kb >= 0;
+            taken++;
+        }
+    }
+
+    /* Take CLIPBOARD back so every fallback server loses its ownership,
+       then give them time to exit. */
+    XSetSelectionOwner(dpy, xa_clipboard, owner, CurrentTime);
+    XFlush(dpy);
+    int final_servers = -1;
+    for (int t = 0; t < 200; t++) {
+        pump_x_events();
+        final_servers = count_copy_servers();
+        if (final_servers == 0) break;
+        usleep(10000);
+    }
+    soak_sample end;
+    take_sample(&end, agent, events);
+    double elapsed = get_time() - start;
+
+    /* Baseline: highest RSS and fd count up to the end of the warm-up. */
+    long base_rss = 0, peak_rss = 0;
+    int base_fds = 0;
+    int warm = taken * WARMUP_PCT / 100;
+    if (warm < 1) warm = 1;
+    for (int s = 0; s < taken; s++) {
+        if (s < warm) {
+            if (samples[s].rss_kb > base_rss) base_rss = samples[s].rss_kb;
+            if (samples[s].fds > base_fds) base_fds = samples[s].fds;
+        }
+        if (samples[s].rss_kb > peak_rss) peak_rss = samples[s].rss_kb;
+    }
+    long allowed_rss = base_rss + (base_rss / 10 > slack_kb ? base_rss / 10 : slack_kb);
+
+    const char *failures[4];
+    int nfail = 0;
+    if (!alive || end.rss_kb < 0) failures[nfail++] = "agent_died";
+    if (alive && end.rss_kb > allowed_rss) failures[nfail++] = "rss_growth";
+    if (alive && end.fds > base_fds) failures[nfail++] = "fd_growth";
+    if (final_servers != 0) failures[nfail++] = "lingering_copy_servers";
+
+    printf("{\n");
+    printf("  \"benchmark\": \"x11-soak\",\n");
+    printf("  \"events\": %lu,\n", events);
+    printf("  \"max_payload_bytes\": %zu,\n", max_size);
+    printf("  \"duration_s\": %.1f,\n", elapsed);
+    printf("  \"counts\": {\"primary\": %lu, \"paste\": %lu, \"copy\": %lu, "
+           "\"copy_fallback\": %lu, \"missed\": %lu},\n",
+           n_primary, n_paste, n_copy, n_fallback, n_missed);
+    printf("  \"rss_kb\": {\"baseline\": %ld, \"allowed\": %ld, \"peak\": %ld, \"final\": %ld},\n",
+           base_rss, allowed_rss, peak_rss, end.rss_kb);
+    printf("  \"fds\": {\"baseline\": %d, \"final\": %d},\n", base_fds, end.fds);
+    printf("  \"copy_servers\": {\"peak\": %d, \"final\": %d},\n", peak_servers, final_servers);
+    printf("  \"samples\": [");
+    for (int s = 0; s < taken; s++)
+        printf("%s[%lu, %ld, %d, %d]", s ? ", " : "", samples[s].event,
+               samples[s].rss_kb, samples[s].fds, samples[s].servers);
+    printf("],\n");
+    printf("  \"verdict\": \"%s\",\n", nfail ? "fail" : "pass");
+    printf("  \"failures\": [");
+    for (int f = 0; f < nfail; f++) printf("%s\"%s\"", f ? ", " : "", failures[f]);
+    printf("]\n");
+    printf("}\n");
+
+    close(in);
+    kill(agent, SIGTERM);
+    for (int i = 0; i < 100 && kill(agent, 0) == 0; i++) usleep(10000);
+    unlink(primary_path);
+    unlink(pid_path);
+    unlink(sock_path);
+    char path[600];
+    const char *leftovers[] = { "seq", "ring", "agent.stats", "agent.metrics" };
+    for (size_t i = 0; i < sizeof(leftovers) / sizeof(leftovers[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, leftovers[i]);
+        unlink(path);
+    }
+    rmdir(cache_dir);
+
+    free(samples);
+    free(primary_text);
+    free(clipboard_text);
+    XDestroyWindow(dpy, owner);
+    XCloseDisplay(dpy);
+
+    return nfail ? 1 : 0;
+}
@@ -0,0 +1,1279 @@
+// Copyright (c) 2025 Michael Matta
+// Homepage: https://github.com/Michael-Matta1/zsh-edit-select
+//
+// Shared daemon core for the selection agents (X11, Wayland, XWayland,
+// WSL, and the portable subset for macOS)
+//
+// Everything the agents used to carry as identical copies lives here once:
+// cache-directory layout and path globals, the signal self-pipe, the
+// primary/seq publish, the content hash and selection history, the scratch
+// arena, metrics and --stats, the event trace, the readiness handshake,
+// stdin capture, the daemon socket API and the OSC 52 encoder.
+// Every definition is static inline, so each agent compiles its own
+// specialised copy, the compiler inlines the hot path (write_primary,
+// zes_hash64, sock_reply) into the backend's event loop, and helpers an
+// agent never calls cost nothing.  The file is header-only; there is no
+// library to link.
+//
+// Before including it, an agent defines:
+//   MET_AGENT        name reported on the metrics "agent" line;
+//   ZES_MAX_PAYLOAD  cap on stdin capture and socket request payloads;
+//   ZES_CORE_RING    (optional) enable the shared-memory ring publish path,
+//                    which also needs MAX_SELECTION_SIZE (slot size);
+//   ZES_CORE_PORTABLE (optional) keep only the pure POSIX pieces: content
+//                    hash, metrics counters and formatting, the readiness
+//                    handshake, stdin capture and OSC 52.  The cache
+//                    layout, publish, history, arena, trace and socket
+//                    code are Linux-only and left out, so the macOS agent
+//                    keeps its own.
+// Backend-specific state (display connection, watched selections, the
+// socket verb handler) stays in the agent.
+
+#ifndef ZES_AGENT_CORE_H
+#define ZES_AGENT_CORE_H
+
+#ifndef MET_AGENT
+#error "define MET_AGENT before including zes-agent-core.h"
+#endif
+#ifndef ZES_MAX_PAYLOAD
+#error "define ZES_MAX_PAYLOAD before including zes-agent-core.h"
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#ifndef ZES_CORE_PORTABLE
+/* Cache-directory filenames.
+   PRIMARY_FILE / SEQ_FILE: selected text and change counter.
+   PID_FILE: daemon PID for liveness checks.
+   SOCK_FILE: daemon request socket (see "Daemon socket API").
+   METRICS_FILE: metrics dump written on SIGUSR1 (see "Metrics").
+   RING_FILE: opt-in shared-memory ring replacing PRIMARY_FILE / SEQ_FILE. */
+#define PRIMARY_FILE "primary"
+#define SEQ_FILE "seq"
+#define PID_FILE "agent.pid"
+#define SOCK_FILE "agent.sock"
+#define METRICS_FILE "agent.metrics"
+#ifdef ZES_CORE_RING
+#define RING_FILE "ring"
+#endif
+
+static volatile sig_atomic_t running = 1;
+static char cache_dir[512];
+static char primary_path[560];
+static char seq_path[560];
+static char pid_path[560];
+static char sock_path[560];
+static char metrics_path[560];
+#ifdef ZES_CORE_RING
+static char ring_path[560];
+#endif
+
+/* Persistent fds for write_primary() daemon hot path.
+   Opened once after daemon() in run_daemon(); reused for all subsequent writes.
+   -1 = not yet open (pre-daemon initial write uses the open/write/close fallback). */
+static int fd_primary = -1;
+static int fd_seq     = -1;
+
+/* Self-pipe: signal handlers write one byte to wake_pipe[1] so the event
+   loop can block in poll() with no timeout and still see a signal at once,
+   even one that lands between the running check and poll(). */
+static int wake_pipe[2] = { -1, -1 };
+
+static inline void wake_loop(void) {
+    if (wake_pipe[1] < 0) return;
+    int saved_errno = errno;
+    ssize_t r = write(wake_pipe[1], "", 1);   /* full pipe: already woken */
+    (void)r;
+    errno = saved_errno;
+}
+
+static inline void wake_drain(void) {
+    char buf[64];
+    while (read(wake_pipe[0], buf, sizeof(buf)) > 0) {}
+}
+
+/* SIGTERM / SIGINT handler — sets the flag that exits the event loop. */
+static inline void signal_handler(int sig) {
+    (void)sig;
+    running = 0;
+    wake_loop();
+}
+
+/* Resolve cache directory path (argument > XDG_RUNTIME_DIR > /dev/shm > HOME)
+   and populate path globals without touching the filesystem.
+   Returns 0 on success. */
+static inline int resolve_cache_dir(const char *dir) {
+    if (dir && dir[0]) {
+        snprintf(cache_dir, sizeof(cache_dir), "%s", dir);
+    } else {
+        /* Cache location priority:
+           1. XDG_RUNTIME_DIR/<uid> — tmpfs, survives logout cleanup by PAM.
+           2. /dev/shm — in-memory tmpfs on Linux; fast for short-lived modes.
+           3. HOME/.cache — persistent fallback for non-standard environments. */
+        const char *runtime = getenv("XDG_RUNTIME_DIR");
+        if (runtime) {
+            snprintf(cache_dir, sizeof(cache_dir), "%s/zsh-edit-select-%d",
+                     runtime, (int)getuid());
+        } else if (access("/dev/shm", W_OK | X_OK) == 0) {
+            snprintf(cache_dir, sizeof(cache_dir),
+                     "/dev/shm/zsh-edit-select-%d", (int)getuid());
+        } else {
+            const char *home = getenv("HOME");
+            if (!home) return -1;
+            snprintf(cache_dir, sizeof(cache_dir),
+                     "%s/.cache/zsh-edit-select", home);
+        }
+    }
+
+    snprintf(primary_path, sizeof(primary_path), "%s/%s", cache_dir, PRIMARY_FILE);
+    snprintf(seq_path, sizeof(seq_path), "%s/%s", cache_dir, SEQ_FILE);
+    snprintf(pid_path, sizeof(pid_path), "%s/%s", cache_dir, PID_FILE);
+    snprintf(sock_path, sizeof(sock_path), "%s/%s", cache_dir, SOCK_FILE);
+#ifdef ZES_CORE_RING
+    snprintf(ring_path, sizeof(ring_path), "%s/%s", cache_dir, RING_FILE);
+#endif
+    snprintf(metrics_path, sizeof(metrics_path), "%s/%s", cache_dir, METRICS_FILE);
+    return 0;
+}
+
+/* resolve_cache_dir(), then create the directory.  Returns 0 on success. */
+static inline int ensure_cache_dir(const char *dir) {
+    if (resolve_cache_dir(dir) != 0)
+        return -1;
+
+    struct stat st;
+    if (stat(cache_dir, &st) == -1) {
+        if (mkdir(cache_dir, 0700) == -1 && errno != EEXIST)
+            return -1;
+    }
+    return 0;
+}
+
+#ifdef ZES_CORE_RING
+/* ------------------------------------------------------------------ */
+/*  Shared-memory ring                                                */
+/* ------------------------------------------------------------------ */
+/* Header (offset 0, RING_HDR_SIZE bytes) is one space-padded ASCII line so
+ * zsh can parse it with sysread and ${=hdr}:
+ *     "<gen> <offset> <len>\n"
+ * gen is a seqlock counter: odd while a publish is in progress, even once
+ * the slot at <offset> holds <len> valid bytes.  It is derived from the
+ * seq counter (2 * seq) so it keeps increasing across daemon restarts.
+ * A reader takes the header, copies the slot, and re-reads the header;
+ * the copy is valid only if both reads are identical with an even gen.
+ * Publishing always targets the slot after the current one, so a reader
+ * still copying the previous value is not overwritten mid-read. */
+
+/* Ring geometry: a 64-byte header followed by RING_SLOTS slots of
+   MAX_SELECTION_SIZE bytes.  The file is sparse on tmpfs, so only slots
+   that have held a selection consume memory. */
+#define RING_HDR_SIZE 64
+#define RING_SLOTS 4
+#define RING_SLOT_SIZE MAX_SELECTION_SIZE
+
+/* Shared-memory ring mapping (NULL = file layout in use) and the slot the
+   next publish writes to. */
+static char *ring_map = NULL;
+static size_t ring_map_size = 0;
+static unsigned int ring_next_slot = 0;
+
+/* Create, size and map RING_FILE.  Returns 0 on success, -1 otherwise
+   (the caller then stays on the primary/seq file layout). */
+static inline int ring_open(void) {
+    size_t size = RING_HDR_SIZE + (size_t)RING_SLOTS * RING_SLOT_SIZE;
+    int fd = open(ring_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        unlink(ring_path);
+        return -1;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    /* The mapping keeps the file alive; the fd is no longer needed. */
+    close(fd);
+    if (map == MAP_FAILED) {
+        unlink(ring_path);
+        return -1;
+    }
+    ring_map = map;
+    ring_map_size = size;
+    return 0;
+}
+
+static inline void ring_close(void) {
+    if (!ring_map) return;
+    munmap(ring_map, ring_map_size);
+    ring_map = NULL;
+    unlink(ring_path);
+}
+
+/* Format and store the header line.  The release fence orders all prior
+   slot writes before the header bytes that announce them. */
+static inline void ring_store_header(unsigned long gen, size_t off, size_t len) {
+    char hdr[RING_HDR_SIZE];
+    int n = snprintf(hdr, sizeof(hdr), "%20lu %10zu %10zu", gen, off, len);
+    memset(hdr + n, ' ', sizeof(hdr) - 1 - (size_t)n);
+    hdr[sizeof(hdr) - 1] = '\n';
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(ring_map, hdr, sizeof(hdr));
+}
+
+/* Publish one selection: mark the header odd, copy into the next slot,
+   then store the even header pointing at it.  No syscalls. */
+static inline void ring_publish(const char *data, size_t len, unsigned long seq) {
+    if (len > RING_SLOT_SIZE) len = RING_SLOT_SIZE;
+    size_t off = RING_HDR_SIZE + (size_t)ring_next_slot * RING_SLOT_SIZE;
+    ring_next_slot = (ring_next_slot + 1) % RING_SLOTS;
+
+    ring_store_header(2 * seq - 1, off, 0);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if (len > 0 && data)
+        memcpy(ring_map + off, data, len);
+    ring_store_header(2 * seq, off, len);
+}
+#endif /* ZES_CORE_RING */
+
+/* ------------------------------------------------------------------ */
+/*  Cache publish                                                     */
+/* ------------------------------------------------------------------ */
+/* (len, zes_hash64()) of the text the primary file holds, as recorded by
+   write_primary_hashed(); any other write_primary() forgets it. */
+static bool primary_known = false;
+static size_t primary_known_len = 0;
+static uint64_t primary_known_hash = 0;
+
+/* Write only the sequence number through the persistent fd_seq, for
+   callers whose primary file already holds the content. */
+static inline void write_seq(unsigned long seq) {
+    char buf[24];
+    int n = snprintf(buf, sizeof(buf), "%lu\n", seq);
+    ssize_t r = pwrite(fd_seq, buf, (size_t)n, 0);
+    (void)r;
+    (void)!ftruncate(fd_seq, (off_t)n);
+}
+
+/* Write selection text to PRIMARY cache and the sequence number to SEQ.
+   Uses the shared-memory ring when mapped (ZES_CORE_RING only), persistent
+   fds in daemon mode, open/write/close otherwise. */
+static inline void write_primary(const char *data, size_t len, unsigned long seq) {
+    primary_known = false;
+#ifdef ZES_CORE_RING
+    if (ring_map) {
+        ring_publish(data, len, seq);
+        return;
+    }
+#endif
+    if (fd_primary >= 0) {
+        /* Persistent-fd hot path: seek to start, write new content, then
+           truncate to correct length.  ftruncate is mandatory — without it,
+           content that shrinks between events (e.g. "hello world" → "hi")
+           leaves stale bytes at the end that the shell reads as part of the
+           new selection.  (void)! discards the result without tripping
+           -Wunused-result on glibc. */
+        if (len > 0 && data) {
+            ssize_t r = pwrite(fd_primary, data, len, 0);
+            (void)r;
+        }
+        (void)!ftruncate(fd_primary, (off_t)len);
+
+        /* primary must be fully committed before seq is touched —
+           seq's mtime is the shell's only per-keypress detection signal. */
+        write_seq(seq);
+        return;
+    }
+
+    /* Fallback path: used for the pre-daemon() initial write (fd_primary is
+       still -1 at that point) and if open() failed after daemon().
+       All short-lived modes (--oneshot, --get-clipboard, --copy-clipboard,
+       --clear-primary) also use this path since they never open persistent fds. */
+    int fd = open(primary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+    if (len > 0 && data) {
+        ssize_t r = write(fd, data, len);
+        (void)r;
+    }
+    close(fd);
+
+    fd = open(seq_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        char buf[24];
+        int n = snprintf(buf, sizeof(buf), "%lu\n", seq);
+        ssize_t r = write(fd, buf, n);
+        (void)r;
+        close(fd);
+    }
+}
+
+#endif /* !ZES_CORE_PORTABLE */
+
+/* ------------------------------------------------------------------ */
+/*  Selection history                                                 */
+/* ------------------------------------------------------------------ */
+/* ── Content hash ─────────────────────────────────────────────────────
+ * Streaming XXH64.  Every agent, macOS included, uses this one
+ * implementation so a selection hashes identically on every backend;
+ * change detection compares (length, hash) instead of keeping a second
+ * copy of the text.
+ * Feed data with zes_hash_update() as it arrives and read the result
+ * with zes_hash_digest(); zes_hash64() is the one-shot form. */
+
+#define ZES_P64_1 0x9E3779B185EBCA87ULL
+#define ZES_P64_2 0xC2B2AE3D27D4EB4FULL
+#define ZES_P64_3 0x165667B19E3779F9ULL
+#define ZES_P64_4 0x85EBCA77C2B2AE63ULL
+#define ZES_P64_5 0x27D4EB2F165667C5ULL
+
+struct zes_hash_state {
+    uint64_t v[4];
+    uint64_t total;
+    unsigned char buf[32];
+    size_t buf_len;
+};
+
+static inline uint64_t zes_rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t zes_read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint32_t zes_read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static inline uint64_t zes_hash_round(uint64_t acc, uint64_t input) {
+    acc += input * ZES_P64_2;
+    acc = zes_rotl64(acc, 31);
+    return acc * ZES_P64_1;
+}
+
+static inline uint64_t zes_hash_merge(uint64_t acc, uint64_t val) {
+    acc ^= zes_hash_round(0, val);
+    return acc * ZES_P64_1 + ZES_P64_4;
+}
+
+static inline void zes_hash_reset(struct zes_hash_state *st) {
+    st->v[0] = ZES_P64_1 + ZES_P64_2;
+    st->v[1] = ZES_P64_2;
+    st->v[2] = 0;
+    st->v[3] = 0 - ZES_P64_1;
+    st->total = 0;
+    st->buf_len = 0;
+}
+
+static inline void zes_hash_update(struct zes_hash_state *st, const void *data, size_t len) {
+    const unsigned char *p = data;
+    st->total += len;
+
+    if (st->buf_len + len < 32) {
+        if (len) memcpy(st->buf + st->buf_len, p, len);
+        st->buf_len += len;
+        return;
+    }
+    if (st->buf_len) {
+        size_t fill = 32 - st->buf_len;
+        memcpy(st->buf + st->buf_len, p, fill);
+        for (int i = 0; i < 4; i++)
+            st->v[i] = zes_hash_round(st->v[i], zes_read64(st->buf + i * 8));
+        p += fill;
+        len -= fill;
+        st->buf_len = 0;
+    }
+    while (len >= 32) {
+        st->v[0] = zes_hash_round(st->v[0], zes_read64(p));
+        st->v[1] = zes_hash_round(st->v[1], zes_read64(p + 8));
+        st->v[2] = zes_hash_round(st->v[2], zes_read64(p + 16));
+        st->v[3] = zes_hash_round(st->v[3], zes_read64(p + 24));
+        p += 32;
+        len -= 32;
+    }
+    if (len) memcpy(st->buf, p, len);
+    st->buf_len = len;
+}
+
+static inline uint64_t zes_hash_digest(const struct zes_hash_state *st) {
+    uint64_t h;
+    if (st->total >= 32) {
+        h = zes_rotl64(st->v[0], 1) + zes_rotl64(st->v[1], 7) +
+            zes_rotl64(st->v[2], 12) + zes_rotl64(st->v[3], 18);
+        for (int i = 0; i < 4; i++)
+            h = zes_hash_merge(h, st->v[i]);
+    } else {
+        h = ZES_P64_5;
+    }
+    h += st->total;
+
+    const unsigned char *p = st->buf;
+    size_t len = st->buf_len;
+    while (len >= 8) {
+        h ^= zes_hash_round(0, zes_read64(p));
+        h = zes_rotl64(h, 27) * ZES_P64_1 + ZES_P64_4;
+        p += 8;
+        len -= 8;
+    }
+    if (len >= 4) {
+        h ^= (uint64_t)zes_read32(p) * ZES_P64_1;
+        h = zes_rotl64(h, 23) * ZES_P64_2 + ZES_P64_3;
+        p += 4;
+        len -= 4;
+    }
+    while (len--) {
+        h ^= (*p++) * ZES_P64_5;
+        h = zes_rotl64(h, 11) * ZES_P64_1;
+    }
+    h ^= h >> 33;
+    h *= ZES_P64_2;
+    h ^= h >> 29;
+    h *= ZES_P64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline uint64_t zes_hash64(const void *data, size_t len) {
+    struct zes_hash_state st;
+    zes_hash_reset(&st);
+    zes_hash_update(&st, data, len);
+    return zes_hash_digest(&st);
+}
+
+#ifndef ZES_CORE_PORTABLE
+/* write_primary() for agents that bump seq on every read, so a reselect
+   of the same text still fires in the shell.  When (len, hash) match what
+   the primary file already holds only seq is rewritten, which spares a
+   pwrite of up to ZES_MAX_PAYLOAD per reselect.  The file's size is
+   checked too, since the shell truncates it directly on some clear paths.
+   hash is zes_hash64() of data. */
+static inline void write_primary_hashed(const char *data, size_t len,
+                                        unsigned long seq, uint64_t hash) {
+    bool ring = false;
+#ifdef ZES_CORE_RING
+    ring = ring_map != NULL;
+#endif
+    struct stat st;
+    if (!ring && fd_primary >= 0 && primary_known &&
+        len == primary_known_len && hash == primary_known_hash &&
+        fstat(fd_primary, &st) == 0 && (size_t)st.st_size == len) {
+        write_seq(seq);
+        return;
+    }
+    write_primary(data, len, seq);
+    primary_known = !ring && fd_primary >= 0;
+    primary_known_len = len;
+    primary_known_hash = hash;
+}
+
+/* The last HIST_ENTRIES distinct PRIMARY/CLIPBOARD texts, newest first,
+ * served as "entry k" by the socket HIST verb.  Text lives in one static
+ * arena used as a circular byte log: an entry is written at hist_tail
+ * (wrapping to 0 when it would run past the end) and every entry whose
+ * bytes it overlaps is evicted.  Memory is capped at HIST_ARENA_SIZE for
+ * the whole session and no entry is ever malloc'd.  Recording a text
+ * that is already present moves it to the front instead of copying it
+ * again (its bytes stay where they are, so it is evicted when the tail
+ * next wraps over them). */
+#define HIST_ENTRIES 32
+#define HIST_ARENA_SIZE (2 * 1024 * 1024)
+#define HIST_MAX_ENTRY (HIST_ARENA_SIZE / 4)
+
+struct hist_entry {
+    size_t off;
+    size_t len;
+    uint64_t hash;
+};
+
+static char hist_arena[HIST_ARENA_SIZE];
+static struct hist_entry hist[HIST_ENTRIES];  /* hist[0] is the newest */
+static unsigned int hist_count = 0;
+static size_t hist_tail = 0;
+
+static inline void hist_remove(unsigned int i) {
+    memmove(&hist[i], &hist[i + 1], (hist_count - i - 1) * sizeof(hist[0]));
+    hist_count--;
+}
+
+/* Record a text as the newest history entry.  Empty texts and texts
+   larger than HIST_MAX_ENTRY are ignored. */
+static inline void hist_record(const char *data, size_t len) {
+    if (!data || len == 0 || len > HIST_MAX_ENTRY) return;
+    uint64_t h = zes_hash64(data, len);
+
+    for (unsigned int i = 0; i < hist_count; i++) {
+        if (hist[i].hash == h && hist[i].len == len &&
+            memcmp(hist_arena + hist[i].off, data, len) == 0) {
+            struct hist_entry e = hist[i];
+            memmove(&hist[1], &hist[0], i * sizeof(hist[0]));
+            hist[0] = e;
+            return;
+        }
+    }
+
+    if (hist_tail + len > HIST_ARENA_SIZE) hist_tail = 0;
+    size_t start = hist_tail, end = hist_tail + len;
+    for (unsigned int i = hist_count; i-- > 0;) {
+        if (hist[i].off < end && start < hist[i].off + hist[i].len)
+            hist_remove(i);
+    }
+    if (hist_count == HIST_ENTRIES) hist_count--;  /* drop the oldest */
+
+    memcpy(hist_arena + start, data, len);
+    memmove(&hist[1], &hist[0], hist_count * sizeof(hist[0]));
+    hist[0] = (struct hist_entry){ .off = start, .len = len, .hash = h };
+    hist_count++;
+    hist_tail = end;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Scratch arena                                                     */
+/* ------------------------------------------------------------------ */
+/* Daemon-mode selection reads land in one anonymous mapping that lives as
+ * long as the daemon instead of a fresh malloc per event.  arena_reserve()
+ * grows it by doubling with mremap(), which keeps the contents but may move
+ * them, so callers re-fetch the pointer after every call.  Once an event's
+ * text is no longer needed, arena_trim() hands the pages above
+ * max(keep, ZES_ARENA_KEEP) back with MADV_DONTNEED: the address range
+ * stays reserved and a small selection touches no allocator and makes no
+ * syscall, while one large paste does not pin its RSS for the rest of the
+ * session.  arena_high (largest reservation) and arena_trims are reported
+ * in the metrics.  Only one reader may hold the arena at a time; the event
+ * loops are single-threaded and finish each read before the next. */
+#define ZES_ARENA_KEEP (256 * 1024)
+
+static char *arena = NULL;
+static size_t arena_cap = 0;      /* mapped bytes */
+static size_t arena_dirty = 0;    /* bytes possibly resident since the last trim */
+static size_t arena_high = 0;
+static unsigned long arena_trims = 0;
+
+static inline char *arena_reserve(size_t need) {
+    if (need > arena_cap) {
+        size_t cap = arena_cap ? arena_cap : 64 * 1024;
+        while (cap < need) cap *= 2;
+        void *p = arena
+            ? mremap(arena, arena_cap, cap, MREMAP_MAYMOVE)
+            : mmap(NULL, cap, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) return NULL;
+        arena = p;
+        arena_cap = cap;
+    }
+    if (need > arena_dirty) arena_dirty = need;
+    if (need > arena_high) arena_high = need;
+    return arena;
+}
+
+static inline void arena_trim(size_t keep) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t floor = keep > ZES_ARENA_KEEP ? keep : ZES_ARENA_KEEP;
+    floor = (floor + page - 1) / page * page;
+    if (arena_dirty <= floor || arena_cap <= floor) return;
+    madvise(arena + floor, arena_cap - floor, MADV_DONTNEED);
+    arena_dirty = floor;
+    arena_trims++;
+}
+
+/* free() for buffers that may be the arena: the arena is trimmed instead. */
+static inline void scratch_free(char *p) {
+    if (p && p == arena) arena_trim(0);
+    else free(p);
+}
+#endif /* !ZES_CORE_PORTABLE */
+
+/* ------------------------------------------------------------------ */
+/*  Metrics                                                           */
+/* ------------------------------------------------------------------ */
+static inline long long monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Counters and two fixed-bucket latency histograms, kept in the same
+ * format by every agent so their output can be compared directly:
+ *   wait   time blocked on the selection source (each agent says what
+ *          that is next to its MET_AGENT);
+ *   event  total handling time of one selection change, wait included,
+ *          so event - wait is the agent's own cost.
+ * Bucket i counts samples under 2^i us; the last bucket is open-ended.
+ * Reported by the socket STATS verb and, on SIGUSR1, written to
+ * METRICS_FILE, which is what --stats prints. */
+#define MET_BUCKETS 20
+#define MET_TEXT_MAX 2048
+struct met_hist {
+    unsigned long count;
+    unsigned long long total_us;
+    unsigned long long max_us;
+    unsigned long bucket[MET_BUCKETS];
+};
+static struct met_hist met_wait, met_event;
+static unsigned long met_events = 0;        /* selection events handled */
+static unsigned long long met_bytes = 0;    /* selection bytes read */
+static unsigned long met_timeouts = 0;      /* reads abandoned at their deadline */
+static unsigned long met_oversize = 0;      /* selections cut at the size cap */
+static long long met_start_us = 0;
+#ifndef ZES_CORE_PORTABLE
+static volatile sig_atomic_t met_dump_pending = 0;
+#endif
+
+static inline void met_record(struct met_hist *h, long long us) {
+    if (us < 0) us = 0;
+    unsigned int b = 0;
+    while (b < MET_BUCKETS - 1 && us >= (1LL << b))
+        b++;
+    h->bucket[b]++;
+    h->count++;
+    h->total_us += (unsigned long long)us;
+    if ((unsigned long long)us > h->max_us)
+        h->max_us = (unsigned long long)us;
+}
+
+/* Upper bound (us) of the histogram bucket holding the pct-th percentile. */
+static inline unsigned long long met_percentile_us(const struct met_hist *h, unsigned int pct) {
+    unsigned long want = (h->count * pct + 99) / 100, seen = 0;
+    for (unsigned int b = 0; b < MET_BUCKETS; b++) {
+        seen += h->bucket[b];
+        if (want > 0 && seen >= want)
+            return b < MET_BUCKETS - 1 ? (1ULL << b) : h->max_us;
+    }
+    return 0;
+}
+
+static inline void met_append(char *buf, size_t size, size_t *n, const char *fmt, ...) {
+    if (*n + 1 >= size) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int r = vsnprintf(buf + *n, size - *n, fmt, ap);
+    va_end(ap);
+    if (r > 0) *n += (size_t)r;
+    if (*n >= size) *n = size - 1;
+}
+
+static inline void met_append_hist(char *buf, size_t size, size_t *n, const char *name,
+                            const struct met_hist *h) {
+    met_append(buf, size, n, "%s_us count %lu mean %llu p50 %llu p99 %llu max %llu\n%s_hist",
+               name, h->count, h->count ? h->total_us / h->count : 0,
+               met_percentile_us(h, 50), met_percentile_us(h, 99), h->max_us, name);
+    for (unsigned int b = 0; b < MET_BUCKETS; b++)
+        met_append(buf, size, n, " %lu", h->bucket[b]);
+    met_append(buf, size, n, "\n");
+}
+
+/* Render every metric as one "key value..." line.  Returns the length. */
+static inline size_t met_format(char *buf, size_t size) {
+    size_t n = 0;
+    buf[0] = '\0';
+    met_append(buf, size, &n,
+               "agent %s\nuptime_s %lld\nevents %lu\nbytes %llu\n"
+               "timeouts %lu\noversize %lu\n",
+               MET_AGENT, (monotonic_us() - met_start_us) / 1000000,
+               met_events, met_bytes, met_timeouts, met_oversize);
+#ifndef ZES_CORE_PORTABLE
+    met_append(buf, size, &n, "arena_high_bytes %zu\narena_trims %lu\n",
+               arena_high, arena_trims);
+#endif
+    met_append_hist(buf, size, &n, "wait", &met_wait);
+    met_append_hist(buf, size, &n, "event", &met_event);
+    return n;
+}
+
+/* Write the metrics to path through a temp file and rename(), so --stats
+   never reads a partial dump. */
+static inline void met_dump_to(const char *path) {
+    char buf[MET_TEXT_MAX], tmp[600];
+    size_t n = met_format(buf, sizeof(buf));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+    bool ok = write(fd, buf, n) == (ssize_t)n;
+    close(fd);
+    if (!ok || rename(tmp, path) != 0) unlink(tmp);
+}
+
+/* --stats body: send SIGUSR1 to the daemon named in pid_file and print
+   the metrics file it writes in response.  dir is only for the error. */
+static inline int met_request_dump(const char *pid_file, const char *metrics_file,
+                                   const char *dir) {
+    int pid = 0;
+    FILE *f = fopen(pid_file, "r");
+    if (f) {
+        if (fscanf(f, "%d", &pid) != 1) pid = 0;
+        fclose(f);
+    }
+    if (pid <= 0 || kill((pid_t)pid, 0) != 0) {
+        fprintf(stderr, "No running agent daemon in %s\n", dir);
+        return 1;
+    }
+    unlink(metrics_file);
+    if (kill((pid_t)pid, SIGUSR1) != 0)
+        return 1;
+    for (int i = 0; i < 200; i++) {
+        int fd = open(metrics_file, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            char buf[MET_TEXT_MAX];
+            ssize_t n = read(fd, buf, sizeof(buf));
+            close(fd);
+            if (n <= 0) return 1;
+            fwrite(buf, 1, (size_t)n, stdout);
+            return 0;
+        }
+        usleep(10000);
+    }
+    fprintf(stderr, "Agent daemon did not answer SIGUSR1\n");
+    return 1;
+}
+
+#ifndef ZES_CORE_PORTABLE
+/* SIGUSR1 handler — the event loop writes METRICS_FILE on its next pass. */
+static inline void met_signal_handler(int sig) {
+    (void)sig;
+    met_dump_pending = 1;
+    wake_loop();
+}
+
+static inline void met_dump_file(void) {
+    met_dump_to(metrics_path);
+}
+
+/* --stats: print the running daemon's METRICS_FILE. */
+static inline int run_stats(const char *cache_dir_arg) {
+    if (resolve_cache_dir(cache_dir_arg) != 0)
+        return 1;
+    return met_request_dump(pid_path, metrics_path, cache_dir);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Event trace                                                       */
+/* ------------------------------------------------------------------ */
+/* With ZES_TRACE=<file> a daemon appends one record per selection
+ * notification and per selection read, so a user's lag report can come
+ * with the exact event timing behind it;
+ * assets/benchmarks/trace-replay.c feeds such a file back through the
+ * publish path offline.  The file starts with TRACE_MAGIC and the 8-byte,
+ * NUL-padded MET_AGENT name, followed by records in host byte order:
+ *   struct zes_trace_rec, then mime_len bytes of MIME type / X target
+ *   (the one requested; empty for a notification), then data_len payload
+ *   bytes.
+ * Payloads are only stored with ZES_TRACE_PAYLOAD=1; otherwise len and
+ * the zes_hash64() of the text stand in for it, which is enough to replay
+ * the change detection: equal (len, hash) pairs replay as equal text. */
+#define TRACE_MAGIC "ZESTRC1\n"
+#define TRACE_NOTIFY 1    /* the selection changed owner or offer */
+#define TRACE_READ   2    /* the text was read (len 0: empty or failed) */
+
+struct zes_trace_rec {
+    uint64_t t_us;        /* monotonic, since the trace was opened */
+    uint64_t hash;        /* zes_hash64() of the text, 0 when empty */
+    uint32_t len;         /* text bytes read */
+    uint32_t wait_us;     /* time blocked on the source for this read */
+    uint32_t data_len;    /* payload bytes stored after the MIME type */
+    uint16_t type;        /* TRACE_NOTIFY or TRACE_READ */
+    uint16_t mime_len;
+};
+
+static int trace_fd = -1;
+static bool trace_payload = false;
+static long long trace_start_us = 0;
+
+/* Open ZES_TRACE if set.  Called before daemon(), so a relative path
+   names a file in the shell's working directory. */
+static inline void trace_open(void) {
+    const char *path = getenv("ZES_TRACE");
+    if (!path || !*path) return;
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (trace_fd < 0) return;
+    const char *payload_env = getenv("ZES_TRACE_PAYLOAD");
+    trace_payload = payload_env && strcmp(payload_env, "1") == 0;
+    char hdr[16] = TRACE_MAGIC;
+    size_t name_len = strlen(MET_AGENT);
+    memcpy(hdr + 8, MET_AGENT, name_len < 8 ? name_len : 8);
+    if (write(trace_fd, hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr)) {
+        close(trace_fd);
+        trace_fd = -1;
+        return;
+    }
+    trace_start_us = monotonic_us();
+}
+
+/* Append one record; a failed write ends the trace. */
+static inline void trace_record(uint16_t type, const char *mime,
+                                const char *data, size_t len, uint64_t hash,
+                                long long wait_us) {
+    if (trace_fd < 0) return;
+    size_t mime_len = mime ? strlen(mime) : 0;
+    if (mime_len > UINT16_MAX) mime_len = UINT16_MAX;
+    struct zes_trace_rec rec = {
+        .t_us = (uint64_t)(monotonic_us() - trace_start_us),
+        .hash = len ? hash : 0,
+        .len = (uint32_t)len,
+        .wait_us = wait_us > 0 ? (uint32_t)wait_us : 0,
+        .data_len = trace_payload && data ? (uint32_t)len : 0,
+        .type = type,
+        .mime_len = (uint16_t)mime_len,
+    };
+    struct iovec iov[3] = {
+        { &rec, sizeof(rec) },
+        { (void *)mime, mime_len },
+        { (void *)data, rec.data_len },
+    };
+    ssize_t want = (ssize_t)(sizeof(rec) + mime_len + rec.data_len);
+    if (writev(trace_fd, iov, 3) != want) {
+        close(trace_fd);
+        trace_fd = -1;
+    }
+}
+
+static inline void trace_close(void) {
+    if (trace_fd < 0) return;
+    close(trace_fd);
+    trace_fd = -1;
+}
+
+#endif /* !ZES_CORE_PORTABLE */
+
+/* ------------------------------------------------------------------ */
+/*  Readiness handshake                                               */
+/* ------------------------------------------------------------------ */
+/* The shell starts the daemon with ZES_READY_FD naming the write end of a
+ * pipe it blocks on (sd_notify style), instead of polling for the seq file.
+ * ready_fd_take() runs before daemon() (on macOS, before the spawned
+ * worker's own /dev/null redirect): it moves that fd above stdio, where
+ * that redirection cannot close it, and hides it from anything the agent
+ * execs.  ready_notify() runs once the agent is really
+ * serving — detached, first selection read published, socket listening —
+ * and writes "READY\n" and closes the pipe.  An agent that dies before
+ * that closes it too, so the shell sees EOF at once instead of waiting out
+ * its deadline. */
+static int ready_fd = -1;
+
+static inline void ready_fd_take(void) {
+    const char *v = getenv("ZES_READY_FD");
+    if (!v || !*v) return;
+    char *end;
+    long fd = strtol(v, &end, 10);
+    unsetenv("ZES_READY_FD");
+    if (*end || fd < 0 || fd > 1024) return;
+    ready_fd = fcntl((int)fd, F_DUPFD_CLOEXEC, 3);
+    if (ready_fd >= 0 && fd > STDERR_FILENO) close((int)fd);
+}
+
+static inline void ready_notify(void) {
+    if (ready_fd < 0) return;
+    /* The shell may have given up and closed its end. */
+    void (*old_pipe)(int) = signal(SIGPIPE, SIG_IGN);
+    (void)!write(ready_fd, "READY\n", 6);
+    signal(SIGPIPE, old_pipe);
+    close(ready_fd);
+    ready_fd = -1;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Input capture                                                     */
+/* ------------------------------------------------------------------ */
+/* Read all of stdin into a malloc'd buffer.  Used by --copy-clipboard and
+ * --osc52 to capture the text before it is handed to a daemon or served
+ * directly.  Input longer than ZES_MAX_PAYLOAD is an error (NULL), not a
+ * silent cut: the buffer is grown to one byte past the cap, so reaching
+ * that byte means there was more. */
+static inline char *read_all_stdin(size_t *out_len) {
+    size_t capacity = 4096, total = 0;
+    *out_len = 0;
+    char *buf = malloc(capacity);
+    if (!buf) return NULL;
+
+    while (1) {
+        if (total == capacity) {
+            if (capacity > ZES_MAX_PAYLOAD) break;
+            capacity = capacity * 2 > ZES_MAX_PAYLOAD ? (size_t)ZES_MAX_PAYLOAD + 1
+                                                      : capacity * 2;
+            char *nb = realloc(buf, capacity);
+            if (!nb) { free(buf); return NULL; }
+            buf = nb;
+        }
+        ssize_t n = read(STDIN_FILENO, buf + total, capacity - total);
+        if (n > 0) total += (size_t)n;
+        else if (n < 0 && errno == EINTR) continue;
+        else break;
+    }
+    if (total > ZES_MAX_PAYLOAD) {
+        fprintf(stderr, "Input exceeds %zu bytes\n", (size_t)ZES_MAX_PAYLOAD);
+        free(buf);
+        return NULL;
+    }
+    *out_len = total;
+    return buf;
+}
+
+#ifndef ZES_CORE_PORTABLE
+/* ------------------------------------------------------------------ */
+/*  Daemon socket API                                                 */
+/* ------------------------------------------------------------------ */
+/* One request per connection on SOCK_FILE:
+ *   request:   "<VERB> <len>\n" followed by <len> payload bytes
+ *   response:  "OK <len>\n" followed by <len> payload bytes, or "ERR\n"
+ * The verbs a daemon answers are listed in its own agent source. */
+
+/* Create the non-blocking listening socket at path.  A stale socket file
+   left by a crashed daemon is unlinked first — the shell only launches a
+   daemon after the PID-file liveness check fails, so no live process is
+   bound to it.  Returns the fd, or -1 (the daemon then runs without the
+   API). */
+static inline int sock_listen_at(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) return -1;
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(fd, 8) != 0) {
+        close(fd);
+        return -1;
+    }
+    (void)chmod(path, 0600);
+    return fd;
+}
+
+/* sock_listen_at() on the cache directory's SOCK_FILE. */
+static inline int sock_listen(void) {
+    return sock_listen_at(sock_path);
+}
+
+/* Send the whole buffer.  MSG_NOSIGNAL keeps a shell that hung up early
+   from killing the daemon with SIGPIPE. */
+static inline int sock_send_all(int fd, const char *buf, size_t len) {
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = send(fd, buf + off, len - off, MSG_NOSIGNAL);
+        if (n > 0) { off += (size_t)n; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        return -1;
+    }
+    return 0;
+}
+
+/* Write an "OK <len>" response followed by the payload, or "ERR". */
+static inline void sock_reply(int fd, bool ok, const char *data, size_t len) {
+    char hdr[32];
+    int n = ok ? snprintf(hdr, sizeof(hdr), "OK %zu\n", len)
+               : snprintf(hdr, sizeof(hdr), "ERR\n");
+    if (sock_send_all(fd, hdr, (size_t)n) == 0 && ok && len > 0)
+        sock_send_all(fd, data, len);
+}
+
+/* Read one request header into verb and its payload into a malloc'd buffer
+ * (NULL when the length is 0).  The client socket carries a receive timeout,
+ * so a stalled writer cannot wedge the event loop.  Returns 0 on success,
+ * -1 for a short read or a malformed or oversize length (answered ERR). */
+static inline int sock_read_request(int fd, char *verb, size_t verb_size,
+                             char **payload, size_t *payload_len) {
+    char hdr[64];
+    size_t have = 0;
+    char *nl = NULL;
+    while (!nl) {
+        if (have == sizeof(hdr) - 1) return -1;
+        ssize_t n = recv(fd, hdr + have, sizeof(hdr) - 1 - have, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        have += (size_t)n;
+        nl = memchr(hdr, '\n', have);
+    }
+    *nl = '\0';
+
+    size_t len = 0;
+    char *sp = strchr(hdr, ' ');
+    if (sp) {
+        *sp = '\0';
+        /* Digits only: strtoul() alone would accept a sign or leading
+           space, wrap "-1" to ULONG_MAX and stop quietly at junk. */
+        if (sp[1] < '0' || sp[1] > '9') return -1;
+        char *end;
+        errno = 0;
+        unsigned long v = strtoul(sp + 1, &end, 10);
+        if (*end || errno == ERANGE) return -1;
+        len = v;
+    }
+    if (strlen(hdr) >= verb_size || len > ZES_MAX_PAYLOAD) return -1;
+    strcpy(verb, hdr);
+
+    *payload = NULL;
+    *payload_len = 0;
+    if (len == 0) return 0;
+
+    char *buf = malloc(len + 1);
+    if (!buf) return -1;
+    /* Bytes that arrived in the same recv() as the header line. */
+    size_t off = have - (size_t)(nl + 1 - hdr);
+    if (off > len) off = len;
+    memcpy(buf, nl + 1, off);
+    while (off < len) {
+        ssize_t n = recv(fd, buf + off, len - off, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) { free(buf); return -1; }
+        off += (size_t)n;
+    }
+    buf[len] = '\0';
+    *payload = buf;
+    *payload_len = len;
+    return 0;
+}
+
+/* Client side of the socket API, used by the short-lived modes: send one
+ * request to a daemon listening on sock_path.  The response has the same
+ * "<word> <len>\n" shape as a request, so sock_read_request parses it.  On
+ * OK returns 0 and, if out is non-NULL, hands over the payload (NULL when
+ * empty).  Returns -1 when no daemon is listening or it answers ERR. */
+static inline int sock_client_request(const char *verb, const char *data, size_t len,
+                               char **out, size_t *out_len) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (!sock_path[0] || strlen(sock_path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, sock_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    /* Same 2 s bound as the shell client, so a wedged daemon cannot hang
+       the short-lived mode. */
+    struct timeval tv = { .tv_sec = 2, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    char hdr[32];
+    int n = snprintf(hdr, sizeof(hdr), "%s %zu\n", verb, len);
+    char word[8];
+    char *payload = NULL;
+    size_t payload_len = 0;
+    bool ok = connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+              sock_send_all(fd, hdr, (size_t)n) == 0 &&
+              (len == 0 || sock_send_all(fd, data, len) == 0) &&
+              sock_read_request(fd, word, sizeof(word),
+                                &payload, &payload_len) == 0 &&
+              strcmp(word, "OK") == 0;
+    close(fd);
+
+    if (!ok) {
+        free(payload);
+        return -1;
+    }
+    if (out) {
+        *out = payload;
+        *out_len = payload_len;
+    } else {
+        free(payload);
+    }
+    return 0;
+}
+
+#endif /* !ZES_CORE_PORTABLE */
+
+/* ------------------------------------------------------------------ */
+/*  OSC 52                                                            */
+/* ------------------------------------------------------------------ */
+/* Clipboard writes for SSH sessions: the text is base64-encoded into an
+ * OSC 52 sequence that the local terminal applies to its own clipboard.
+ * Inside tmux the sequence travels in a DCS passthrough with its ESC
+ * doubled.  GNU Screen drops DCS strings longer than 768 bytes, so there
+ * the sequence is cut into OSC52_SCREEN_CHUNK-character pieces, each in
+ * its own DCS.  Built by --osc52 (written to /dev/tty) and by the socket
+ * OSC52 verb (returned to the shell, which writes it itself). */
+#define OSC52_SCREEN_CHUNK 512
+
+enum osc52_frame { OSC52_PLAIN, OSC52_TMUX, OSC52_SCREEN };
+
+static const char zes_b64_table[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+/* Encode len bytes of src as padded base64 into dst, which must hold
+ * 4 * ((len + 2) / 3) bytes (no NUL is written).  Returns that length.
+ * With SSSE3 the bulk runs 12 input bytes per step: a byte shuffle and two
+ * 16-bit multiplies split each 3-byte group into four 6-bit indices, and a
+ * 16-entry offset table maps the indices to ASCII.  The scalar loop
+ * finishes the tail (and everything on other targets). */
+static inline size_t zes_b64_encode(char *dst, const unsigned char *src, size_t len) {
+    char *out = dst;
+#ifdef __SSSE3__
+    const __m128i shuf = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+                                      4, 5, 3, 4, 1, 2, 0, 1);
+    const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4,
+                                      -4, -4, -4, -4, -19, -16, 0, 0);
+    /* Each step loads 16 bytes but consumes 12. */
+    while (len >= 16) {
+        __m128i in = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)src), shuf);
+        __m128i hi = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)),
+                                     _mm_set1_epi32(0x04000040));
+        __m128i lo = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)),
+                                     _mm_set1_epi32(0x01000010));
+        __m128i idx = _mm_or_si128(hi, lo);
+        __m128i sel = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+        sel = _mm_sub_epi8(sel, _mm_cmpgt_epi8(idx, _mm_set1_epi8(25)));
+        _mm_storeu_si128((__m128i *)out,
+                         _mm_add_epi8(idx, _mm_shuffle_epi8(lut, sel)));
+        src += 12;
+        len -= 12;
+        out += 16;
+    }
+#endif
+    while (len >= 3) {
+        uint32_t v = (uint32_t)src[0] << 16 | (uint32_t)src[1] << 8 | src[2];
+        out[0] = zes_b64_table[v >> 18];
+        out[1] = zes_b64_table[(v >> 12) & 0x3f];
+        out[2] = zes_b64_table[(v >> 6) & 0x3f];
+        out[3] = zes_b64_table[v & 0x3f];
+        src += 3;
+        len -= 3;
+        out += 4;
+    }
+    if (len) {
+        uint32_t v = (uint32_t)src[0] << 16 | (len == 2 ? (uint32_t)src[1] << 8 : 0);
+        out[0] = zes_b64_table[v >> 18];
+        out[1] = zes_b64_table[(v >> 12) & 0x3f];
+        out[2] = len == 2 ? zes_b64_table[(v >> 6) & 0x3f] : '=';
+        out[3] = '=';
+        out += 4;
+    }
+    return (size_t)(out - dst);
+}
+
+/* Framing for the multiplexer this process runs under: $TMUX, then $STY. */
+static inline enum osc52_frame osc52_frame_from_env(void) {
+    const char *v = getenv("TMUX");
+    if (v && v[0]) return OSC52_TMUX;
+    v = getenv("STY");
+    if (v && v[0]) return OSC52_SCREEN;
+    return OSC52_PLAIN;
+}
+
+/* Build the complete OSC 52 sequence for data in a malloc'd buffer.
+   Returns NULL on allocation failure. */
+static inline char *osc52_build(const char *data, size_t len, enum osc52_frame frame,
+                                size_t *out_len) {
+    size_t b64_len = 4 * ((len + 2) / 3);
+    size_t chunks = frame == OSC52_SCREEN ? b64_len / OSC52_SCREEN_CHUNK + 1 : 1;
+    /* Prefix (at most 15) + suffix (3) + "ESC \ ESC P" between chunks. */
+    char *buf = malloc(b64_len + 18 + 4 * chunks);
+    if (!buf) return NULL;
+
+    static const char prefix[][16] = {
+        [OSC52_PLAIN]  = "\033]52;c;",
+        [OSC52_TMUX]   = "\033Ptmux;\033\033]52;c;",
+        [OSC52_SCREEN] = "\033P\033]52;c;",
+    };
+    size_t n = strlen(prefix[frame]);
+    memcpy(buf, prefix[frame], n);
+
+    const unsigned char *src = (const unsigned char *)data;
+    if (frame == OSC52_SCREEN) {
+        /* 3 input bytes per 4 characters, so every piece but the last
+           encodes to exactly OSC52_SCREEN_CHUNK characters. */
+        size_t piece = OSC52_SCREEN_CHUNK / 4 * 3;
+        while (len > piece) {
+            n += zes_b64_encode(buf + n, src, piece);
+            memcpy(buf + n, "\033\\\033P", 4);
+            n += 4;
+            src += piece;
+            len -= piece;
+        }
+    }
+    n += zes_b64_encode(buf + n, src, len);
+
+    if (frame == OSC52_PLAIN) {
+        buf[n++] = '\a';
+    } else {
+        memcpy(buf + n, "\a\033\\", 3);
+        n += 3;
+    }
+    *out_len = n;
+    return buf;
+}
+
+/* Write data to /dev/tty as an OSC 52 sequence framed for the enclosing
+   multiplexer.  Returns true when the whole sequence was written. */
+static inline bool osc52_write(const char *data, size_t len) {
+    size_t n = 0;
+    char *seq = osc52_build(data, len, osc52_frame_from_env(), &n);
+    if (!seq) return false;
+    int tty_fd = open("/dev/tty", O_WRONLY | O_CLOEXEC);
+    if (tty_fd < 0) {
+        free(seq);
+        return false;
+    }
+    size_t written = 0;
+    while (written < n) {
+        ssize_t r = write(tty_fd, seq + written, n - written);
+        if (r > 0) { written += (size_t)r; continue; }
+        if (r < 0 && errno == EINTR) continue;
+        break;
+    }
+    free(seq);
+    close(tty_fd);
+    return written == n;
+}
+
+/* --osc52: read stdin and write it to the terminal as OSC 52.  Needs no
+   display connection, so it works on a headless SSH host. */
+static inline int run_osc52(void) {
+    size_t len = 0;
+    char *data = read_all_stdin(&len);
+    bool ok = data && len > 0 && osc52_write(data, len);
+    free(data);
+    return ok ? 0 : 1;
+}
+
+#ifndef ZES_CORE_PORTABLE
+/* Socket OSC52 verb: payload "<frame>\n<text>" with frame "tmux", "screen"
+   or anything else for none; answers with the sequence, which the shell
+   writes to its own tty (the daemon has none). */
+static inline void osc52_sock_reply(int fd, const char *payload, size_t len) {
+    const char *nl = payload ? memchr(payload, '\n', len) : NULL;
+    if (!nl || (size_t)(nl + 1 - payload) == len) {
+        sock_reply(fd, false, NULL, 0);
+        return;
+    }
+    size_t flen = (size_t)(nl - payload);
+    enum osc52_frame frame = OSC52_PLAIN;
+    if (flen == 4 && memcmp(payload, "tmux", 4) == 0)
+        frame = OSC52_TMUX;
+    else if (flen == 6 && memcmp(payload, "screen", 6) == 0)
+        frame = OSC52_SCREEN;
+
+    size_t n = 0;
+    char *seq = osc52_build(nl + 1, len - flen - 1, frame, &n);
+    sock_reply(fd, seq != NULL, seq, seq ? n : 0);
+    free(seq);
+}
+#endif /* !ZES_CORE_PORTABLE */
+
+#endif /* ZES_AGENT_CORE_H */
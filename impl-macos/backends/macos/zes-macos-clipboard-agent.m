@@ -16,15 +16,24 @@
 //     PATH A — Accessibility API:
 //       Read kAXSelectedTextAttribute.  Works: Terminal.app, iTerm2, AppKit.
 //       Fails: GPU terminals → kAXErrorAttributeUnsupported.
-//       No clipboard involvement.
+//       No clipboard involvement.  The frontmost app's AX element, its
+//       focused element (apps that post focus changes) and whether it
+//       supports the attribute are cached per pid and dropped on app
+//       activation, so known-unsupported hosts skip straight to the
+//       watcher.
 //
 //     UNIFIED ESCALATION:
 //       1. Start unified watcher after definite MouseUp.
-//          Phase 1 (ticks 0..ESCALATION_TICK-1): check named PB + native clipboard.
-//          Phase 2 (tick ESCALATION_TICK):       inject Cmd+C (escalation).
-//          Phase 2+ (ticks >= ESCALATION_TICK):  check named PB + clipboard.
-//       2. Commit only when candidate selection is stable for SETTLE_TICKS
+//          Phase 1 (0..ESCALATION_MS):  check named PB + native clipboard.
+//          Phase 2 (at ESCALATION_MS):  inject Cmd+C (escalation).
+//          Phase 2+ (after the inject): check named PB + clipboard.
+//       2. Commit only when candidate selection is stable for SETTLE_MS
 //          (last-stable-wins), or on timeout with the latest candidate.
+//       The watcher polls densely (1 ms) right after MouseUp, the inject or
+//       a new candidate, then backs off exponentially; an AX observer on
+//       the frontmost app (kAXSelectedTextChangedNotification, where the
+//       app supports it) wakes it immediately.  Tick counts are reported
+//       by --status.
 //       This covers all terminals. Additionally, AX-empty returns can
 //       escalate for known Electron terminal hosts in ax_try().
 //
@@ -57,6 +66,7 @@
 #include <spawn.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -68,21 +78,34 @@ extern char **environ;
 
 /* ── Tunables ────────────────────────────────────────────────────────── */
 #define DRAG_PX        5.0
-#define POLL_NS        (1 * NSEC_PER_MSEC)
-#define MAX_POLL_TICKS 700            /* 700 ms safety cap for large multi-line copies */
-#define ESCALATION_TICK 75            /* Wait 75ms before invasive Cmd+C inject */
-#define SETTLE_TICKS   25             /* 25ms of quiescence before commit */
+#define MAX_POLL_MS    700            /* 700 ms safety cap for large multi-line copies */
+#define ESCALATION_MS  75             /* Wait 75ms before invasive Cmd+C inject */
+#define SETTLE_MS      25             /* 25ms of quiescence before commit */
+#define DENSE_MS       20             /* 1 ms polling this long after activity */
+#define BACKOFF_CAP_MS 8              /* Backoff ceiling without AX notifications */
+#define BACKOFF_AX_MS  32             /* ... with them (they wake the watcher) */
 #define DOUBLE_CLICK_GRACE_MS 120     /* Wait for possible third click before committing click_count=2 */
 #define TRIPLE_CLICK_GRACE_MS 80      /* Short settle window for click_count>=3 bursts */
 #define AX_ELECTRON    (-3)           /* AX-empty in Electron terminal host */
 #define MAX_SEL_SIZE   (4 * 1024 * 1024)
 #define MAX_CLIP_SIZE  (4 * 1024 * 1024)
-#define DEDUP_SIZE     4096
+
+/* Shared agent core, portable subset: content hash, metrics counters and
+   formatting, readiness handshake, stdin capture and OSC 52.  "wait" in
+   the metrics is time blocked on the source app (the AX query, and the
+   watcher run from MouseUp until its commit or timeout); "event" runs from
+   MouseUp until the cache is written. */
+#define MET_AGENT "macos"
+#define ZES_MAX_PAYLOAD MAX_CLIP_SIZE
+#define ZES_CORE_PORTABLE
+#include "zes-agent-core.h"
 
 /* ── Cache filenames ─────────────────────────────────────────────────── */
 #define PRIMARY_FILE "primary"
 #define SEQ_FILE     "seq"
 #define PID_FILE     "agent.pid"
+#define STATS_FILE   "agent.stats"
+#define METRICS_FILE "agent.metrics"
 
 /* ── Path globals ────────────────────────────────────────────────────── */
 static char g_cache_dir[512];
@@ -90,6 +113,8 @@ static char g_primary_path[560];
 static char g_seq_path[560];
 static char g_pid_path[560];
 static char g_pending_path[560];  /* exists while a watcher is active */
+static char g_stats_path[560];
+static char g_metrics_path[560];
 
 /* ── Persistent fds ──────────────────────────────────────────────────── */
 static int g_fd_primary = -1;
@@ -105,9 +130,11 @@ static volatile sig_atomic_t g_running = 1;
 static CFMachPortRef      g_tap     = NULL;
 static CFRunLoopSourceRef g_tap_rls = NULL;
 
-/* ── Dedup cache ─────────────────────────────────────────────────────── */
-static char   g_last[DEDUP_SIZE];
-static size_t g_last_len = 0;
+/* ── Dedup state ─────────────────────────────────────────────────────── */
+/* Length and zes_hash64() of the last published selection; any size is
+   deduplicated without keeping a copy of the text. */
+static size_t   g_last_len  = 0;
+static uint64_t g_last_hash = 0;
 
 /* ── Mouse-down position ─────────────────────────────────────────────── */
 static CGFloat g_down_x = 0.0;
@@ -129,6 +156,38 @@ static int           g_num_named_pb = 0;
 /* ── Watcher state ───────────────────────────────────────────────────── */
 static uint64_t          g_gen     = 0;
 static dispatch_source_t g_watcher = NULL;
+static bool              g_watcher_kick = false;  /* AX woke the watcher */
+
+/* ── AX selection observer and host cache (frontmost app) ────────────── */
+/* Everything below describes g_ax_pid and is reset by ax_observer_stop()
+   when another app is activated. */
+enum { AX_HOST_UNKNOWN, AX_HOST_TEXT, AX_HOST_UNSUPPORTED };
+static AXObserverRef  g_ax_observer = NULL;
+static AXUIElementRef g_ax_app      = NULL;
+static pid_t          g_ax_pid      = 0;
+static bool           g_ax_notify   = false;  /* app supports the notification */
+static bool           g_ax_focus_notify = false;  /* ... and focus-change notifications */
+static AXUIElementRef g_ax_focused  = NULL;   /* cached only with g_ax_focus_notify */
+static int            g_ax_host     = AX_HOST_UNKNOWN;  /* kAXSelectedTextAttribute support */
+static bool           g_ax_electron = false;  /* bundle_prefers_cmdc_fallback() */
+
+/* ── Watcher statistics (written to STATS_FILE, shown by --status) ───── */
+static unsigned long      g_stat_runs     = 0;  /* watcher runs */
+static unsigned long long g_stat_ticks    = 0;  /* timer ticks run */
+static unsigned long long g_stat_fixed    = 0;  /* ticks a fixed 1 ms timer would run */
+static unsigned long      g_stat_max      = 0;  /* most ticks in one run */
+static unsigned long      g_stat_ax_kicks = 0;  /* AX notifications that woke a run */
+static unsigned long      g_stat_ax_skips = 0;  /* MouseUps sent past AX by the host cache */
+
+/* MouseUp being handled, for the event histogram. */
+static long long met_event_start_us = 0;
+
+/* One MouseUp handled to completion (published, cleared, or nothing found). */
+static void met_event_done(size_t bytes) {
+    met_events++;
+    met_bytes += bytes;
+    met_record(&met_event, monotonic_us() - met_event_start_us);
+}
 
 /* ─────────────────────────────────────────────────────────────────────
    write_primary_content()
@@ -141,14 +200,14 @@ static dispatch_source_t g_watcher = NULL;
    ───────────────────────────────────────────────────────────────────── */
 static size_t write_primary_content(const char *utf8, size_t len) {
     if (!utf8) utf8 = "";
-    if (len > MAX_SEL_SIZE) len = MAX_SEL_SIZE;
+    if (len > MAX_SEL_SIZE) { len = MAX_SEL_SIZE; met_oversize++; }
 
     /* Repeated empty selection is a no-op. */
     if (len == 0 && g_last_len == 0) return 0;
 
     /* If previous was not empty and current is empty, return 1 to signal deselection */
     if (len == 0 && g_last_len > 0) {
-        g_last[0] = '\0'; g_last_len = 0;
+        g_last_len = 0; g_last_hash = 0;
         g_seq++;
         /* Truncate the file so reading it yields nothing */
         if (g_fd_primary >= 0) {
@@ -160,8 +219,7 @@ static size_t write_primary_content(const char *utf8, size_t len) {
         return 1;
     } else {
         /* Update normal dedup cache */
-        if (len < DEDUP_SIZE) { memcpy(g_last, utf8, len); g_last[len] = '\0'; }
-        else                  { g_last[0] = '\0'; }
+        g_last_hash = zes_hash64(utf8, len);
         g_last_len = len;
         g_seq++;
     }
@@ -237,6 +295,8 @@ static int ensure_cache_dir(const char *dir) {
     snprintf(g_seq_path,      sizeof(g_seq_path),      "%s/%s",      g_cache_dir, SEQ_FILE);
     snprintf(g_pid_path,      sizeof(g_pid_path),      "%s/%s",      g_cache_dir, PID_FILE);
     snprintf(g_pending_path,  sizeof(g_pending_path),  "%s/pending", g_cache_dir);
+    snprintf(g_stats_path,    sizeof(g_stats_path),    "%s/%s",      g_cache_dir, STATS_FILE);
+    snprintf(g_metrics_path,  sizeof(g_metrics_path),  "%s/%s",      g_cache_dir, METRICS_FILE);
     struct stat st;
     if (stat(g_cache_dir, &st) == -1)
         if (mkdir(g_cache_dir, 0700) == -1 && errno != EEXIST) return -1;
@@ -246,7 +306,7 @@ static int ensure_cache_dir(const char *dir) {
 /* clear_primary_cache() — AX reported empty selection. */
 static void clear_primary_cache(void) {
     if (g_last_len > 0) {
-        g_last[0] = '\0'; g_last_len = 0;
+        g_last_len = 0; g_last_hash = 0;
         g_seq++; write_primary("", 0, g_seq);
     }
 }
@@ -336,15 +396,49 @@ static void finalize_selection(const char *utf8, size_t len, bool delay_restore,
 
 /* Known hosts where AX often cannot expose canvas-rendered terminal selection.
    In these hosts, AX failure/empty should escalate to Path B (Cmd+C watcher). */
-static bool host_prefers_cmdc_fallback(void) {
-    NSRunningApplication *app = [[NSWorkspace sharedWorkspace] frontmostApplication];
-    NSString *bid = app.bundleIdentifier;
+static bool bundle_prefers_cmdc_fallback(NSString *bid) {
     if (!bid) return false;
     if ([bid hasPrefix:@"com.microsoft.VSCode"]) return true; /* Stable + Insiders */
     if ([bid isEqualToString:@"com.todesktop.230313mzl4w4u92"]) return true; /* Cursor */
     return false;
 }
 
+/* bundle_prefers_cmdc_fallback() for the frontmost app, cached per pid by
+   ax_observer_follow_frontmost() when the observer is running. */
+static bool host_prefers_cmdc_fallback(void) {
+    if (g_ax_pid > 0) return g_ax_electron;
+    NSRunningApplication *app = [[NSWorkspace sharedWorkspace] frontmostApplication];
+    return bundle_prefers_cmdc_fallback(app.bundleIdentifier);
+}
+
+/* Focused element of the frontmost app (+1 reference, or NULL).  Asks the
+   app element when one is attached, which skips the system-wide
+   frontmost-app lookup; *cached is set when the element came from
+   g_ax_focused, which is only kept for apps that post focus changes. */
+static AXUIElementRef ax_focused_element(bool *cached) {
+    *cached = false;
+    if (g_ax_focused) {
+        *cached = true;
+        return (AXUIElementRef)CFRetain(g_ax_focused);
+    }
+    AXUIElementRef root = g_ax_app ? (AXUIElementRef)CFRetain(g_ax_app)
+                                   : AXUIElementCreateSystemWide();
+    if (!root) return NULL;
+    AXUIElementRef focused = NULL;
+    AXError e = AXUIElementCopyAttributeValue(root, kAXFocusedUIElementAttribute,
+                                              (CFTypeRef *)&focused);
+    CFRelease(root);
+    if (e != kAXErrorSuccess || !focused) return NULL;
+    if (g_ax_focus_notify)
+        g_ax_focused = (AXUIElementRef)CFRetain(focused);
+    return focused;
+}
+
+static void ax_forget_focused(void) {
+    if (g_ax_focused) { CFRelease(g_ax_focused); g_ax_focused = NULL; }
+    g_ax_host = AX_HOST_UNKNOWN;
+}
+
 /* ─────────────────────────────────────────────────────────────────────
    PATH A — Accessibility API
    Returns:
@@ -355,24 +449,39 @@ static bool host_prefers_cmdc_fallback(void) {
    ───────────────────────────────────────────────────────────────────── */
 static int ax_try(void) {
     @autoreleasepool {
-        AXUIElementRef sw = AXUIElementCreateSystemWide();
-        if (!sw) return -2;
-
-        AXUIElementRef focused = NULL;
-        AXError e = AXUIElementCopyAttributeValue(sw, kAXFocusedUIElementAttribute,
-                                                  (CFTypeRef *)&focused);
-        CFRelease(sw);
-        if (e != kAXErrorSuccess || !focused)
+        /* A host already seen rejecting the attribute (GPU terminals) goes
+           straight to the watcher until its focus or the frontmost app
+           changes. */
+        if (g_ax_host == AX_HOST_UNSUPPORTED) {
+            g_stat_ax_skips++;
+            return -1;
+        }
+
+        bool cached = false;
+        AXUIElementRef focused = ax_focused_element(&cached);
+        if (!focused)
             return host_prefers_cmdc_fallback() ? -1 : -2;
 
         CFTypeRef val = NULL;
-        e = AXUIElementCopyAttributeValue(focused, kAXSelectedTextAttribute, &val);
+        AXError e = AXUIElementCopyAttributeValue(focused, kAXSelectedTextAttribute, &val);
         CFRelease(focused);
+        if (e == kAXErrorInvalidUIElement && cached) {
+            /* The cached element went away without a notification. */
+            ax_forget_focused();
+            focused = ax_focused_element(&cached);
+            if (!focused)
+                return host_prefers_cmdc_fallback() ? -1 : -2;
+            e = AXUIElementCopyAttributeValue(focused, kAXSelectedTextAttribute, &val);
+            CFRelease(focused);
+        }
 
-        if (e == kAXErrorAttributeUnsupported || e == kAXErrorActionUnsupported)
+        if (e == kAXErrorAttributeUnsupported || e == kAXErrorActionUnsupported) {
+            if (g_ax_pid > 0) g_ax_host = AX_HOST_UNSUPPORTED;
             return -1;   /* GPU terminal */
+        }
         if (e != kAXErrorSuccess || !val)
             return host_prefers_cmdc_fallback() ? -1 : -2;
+        if (g_ax_pid > 0) g_ax_host = AX_HOST_TEXT;
 
         NSString *s = (__bridge_transfer NSString *)val;
         if (!s || s.length == 0) {
@@ -390,12 +499,11 @@ static int ax_try(void) {
         size_t len = strlen(utf8);
         /* Path A keeps its prior publish semantics to avoid behavior drift in
            AX-capable terminals while watcher paths use write_primary_content(). */
-        if (g_last_len == len && len < DEDUP_SIZE &&
-            g_last[0] != '\0' && memcmp(g_last, utf8, len) == 0) {
+        uint64_t h = zes_hash64(utf8, len);
+        if (len > 0 && g_last_len == len && g_last_hash == h) {
             return 1; /* dedup */
         }
-        if (len < DEDUP_SIZE) { memcpy(g_last, utf8, len); g_last[len] = '\0'; }
-        else                  { g_last[0] = '\0'; }
+        g_last_hash = h;
         g_last_len = len;
         g_seq++;
         write_primary(utf8, len, g_seq);
@@ -448,30 +556,150 @@ static void inject_cmd_c(void) {
     if (up) CFRelease(up);
 }
 
+/* ─────────────────────────────────────────────────────────────────────
+   Watcher schedule & statistics
+   ───────────────────────────────────────────────────────────────────── */
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+/* Delay before the next tick: 1 ms for DENSE_MS after the last activity
+   (MouseUp, inject, new candidate, AX wake), then doubling per tick up to
+   the cap — longer when AX notifications will wake us anyway. */
+static uint64_t watcher_next_ms(uint64_t since_activity, int sparse_ticks) {
+    if (since_activity < DENSE_MS) return 1;
+    uint64_t cap = g_ax_notify ? BACKOFF_AX_MS : BACKOFF_CAP_MS;
+    uint64_t next = 1ull << (sparse_ticks < 6 ? sparse_ticks : 6);
+    return next < cap ? next : cap;
+}
+
+/* Record one finished watcher run and rewrite STATS_FILE (one small write
+   per MouseUp that needed a watcher). */
+static void watcher_stats_record(unsigned long ticks, uint64_t elapsed_ms) {
+    g_stat_runs++;
+    g_stat_ticks += ticks;
+    g_stat_fixed += elapsed_ms + 1;
+    if (ticks > g_stat_max) g_stat_max = ticks;
+    if (!g_stats_path[0]) return;
+    int fd = open(g_stats_path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+    if (fd < 0) return;
+    char buf[256];
+    int n = snprintf(buf, sizeof(buf),
+                     "runs %lu\nticks %llu\nfixed_ticks %llu\nmax_ticks %lu\n"
+                     "ax_wakeups %lu\nax_observer %d\nax_skips %lu\n",
+                     g_stat_runs, g_stat_ticks, g_stat_fixed, g_stat_max,
+                     g_stat_ax_kicks, g_ax_notify ? 1 : 0, g_stat_ax_skips);
+    ssize_t r = write(fd, buf, (size_t)n); (void)r;
+    close(fd);
+}
+
+/* ─────────────────────────────────────────────────────────────────────
+   AX observer — kAXSelectedTextChangedNotification on the frontmost app.
+   Terminals that post it (Terminal.app, iTerm2, AppKit views) wake an
+   in-flight watcher at once instead of waiting for its next tick.  It is
+   not used to publish on its own: typing also changes the selection, and
+   clearing PRIMARY under the shell would race its replacement logic.
+   ───────────────────────────────────────────────────────────────────── */
+static void ax_observer_cb(AXObserverRef obs, AXUIElementRef elem,
+                           CFStringRef note, void *refcon) {
+    (void)obs; (void)elem; (void)refcon;
+    if (CFEqual(note, kAXFocusedUIElementChangedNotification)) {
+        ax_forget_focused();   /* the host cache follows focus */
+        return;
+    }
+    if (!g_running || !g_watcher) return;
+    g_stat_ax_kicks++;
+    g_watcher_kick = true;
+    dispatch_source_set_timer(g_watcher, DISPATCH_TIME_NOW, DISPATCH_TIME_FOREVER, 0);
+}
+
+static void ax_observer_stop(void) {
+    if (g_ax_observer) {
+        if (g_ax_app && g_ax_notify)
+            AXObserverRemoveNotification(g_ax_observer, g_ax_app,
+                                         kAXSelectedTextChangedNotification);
+        if (g_ax_app && g_ax_focus_notify)
+            AXObserverRemoveNotification(g_ax_observer, g_ax_app,
+                                         kAXFocusedUIElementChangedNotification);
+        CFRunLoopRemoveSource(CFRunLoopGetMain(),
+                              AXObserverGetRunLoopSource(g_ax_observer),
+                              kCFRunLoopDefaultMode);
+        CFRelease(g_ax_observer);
+        g_ax_observer = NULL;
+    }
+    if (g_ax_app) { CFRelease(g_ax_app); g_ax_app = NULL; }
+    ax_forget_focused();
+    g_ax_pid = 0;
+    g_ax_notify = false;
+    g_ax_focus_notify = false;
+    g_ax_electron = false;
+}
+
+/* (Re)attach the observer and the host cache to the frontmost application.
+   Called at start and on every app activation; apps that reject the
+   selection notification leave g_ax_notify false and keep the shorter
+   backoff cap, and apps that reject focus changes get no cached element. */
+static void ax_observer_follow_frontmost(void) {
+    @autoreleasepool {
+        if (!AXIsProcessTrusted()) return;
+        NSRunningApplication *app = [[NSWorkspace sharedWorkspace] frontmostApplication];
+        pid_t pid = app ? app.processIdentifier : 0;
+        if (pid == g_ax_pid) return;
+        ax_observer_stop();
+        if (pid <= 0) return;
+        g_ax_pid = pid;   /* unsupported apps are not retried until the app changes */
+        g_ax_electron = bundle_prefers_cmdc_fallback(app.bundleIdentifier);
+        g_ax_app = AXUIElementCreateApplication(pid);
+        if (!g_ax_app) return;
+
+        AXObserverRef obs = NULL;
+        if (AXObserverCreate(pid, ax_observer_cb, &obs) != kAXErrorSuccess || !obs)
+            return;
+        g_ax_notify = AXObserverAddNotification(obs, g_ax_app,
+                          kAXSelectedTextChangedNotification, NULL) == kAXErrorSuccess;
+        g_ax_focus_notify = AXObserverAddNotification(obs, g_ax_app,
+                          kAXFocusedUIElementChangedNotification, NULL) == kAXErrorSuccess;
+        if (!g_ax_notify && !g_ax_focus_notify) {
+            CFRelease(obs);
+            return;
+        }
+        CFRunLoopAddSource(CFRunLoopGetMain(), AXObserverGetRunLoopSource(obs),
+                           kCFRunLoopDefaultMode);
+        g_ax_observer = obs;
+    }
+}
+
 /* ─────────────────────────────────────────────────────────────────────
    UNIFIED WATCHER — replaces start_named_pb_watcher + start_cmdc_watcher
 
    Action-driven escalation strategy (no terminal-specific routing):
-     Phase 1 (ticks 0 to ESCALATION_TICK-1):
+     Phase 1 (0 to ESCALATION_MS after MouseUp):
        Check named PBs only.  Non-invasive — covers terminals that
        write to a named PB on selection (e.g. Ghostty copy-on-select=true).
-     Phase 2 (tick == ESCALATION_TICK):
+     Phase 2 (at ESCALATION_MS):
        Inject Cmd+C.  Captures cc_inject_before for clipboard detection.
-     Phase 2+ (ticks > ESCALATION_TICK):
+     Phase 2+ (after the inject):
        Check BOTH named PBs AND clipboard changeCount.
        Covers all terminals that respond to Cmd+C.
-        Commits only after the candidate selection is stable for SETTLE_TICKS,
-        or on timeout with the latest captured candidate.
+        Commits only after the candidate selection is stable for SETTLE_MS,
+        or on timeout (MAX_POLL_MS) with the latest captured candidate.
+   The timer is one-shot and re-armed per tick by watcher_next_ms(), never
+   past the next deadline (escalation, settle, timeout).
    ───────────────────────────────────────────────────────────────────── */
 static void start_unified_watcher(uint64_t gen, bool pre_injected, NSInteger pre_cc,
                                   NSArray *restore_snapshot) {
-    __block int ticks = 0;
+    __block unsigned long ticks = 0;
+    __block int sparse_ticks = 0;
+    __block uint64_t start_ms = now_ms();
+    __block uint64_t activity_ms = start_ms;
+    __block uint64_t candidate_ms = 0;
     __block NSInteger cc_inject_before = pre_injected ? pre_cc : -1;
     __block NSInteger cc_native_before = g_mousedown_cc;
     __block bool injected = pre_injected;
     __block NSString *stable_candidate = nil;
     __block bool saw_candidate = false;
-    __block int settle_ticks = 0;
 
     if (cc_native_before < 0) {
         cc_native_before = [[NSPasteboard generalPasteboard] changeCount];
@@ -479,17 +707,27 @@ static void start_unified_watcher(uint64_t gen, bool pre_injected, NSInteger pre
 
     dispatch_source_t w = dispatch_source_create(
         DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
-    dispatch_source_set_timer(w, DISPATCH_TIME_NOW, POLL_NS, 0);
+    dispatch_source_set_timer(w, DISPATCH_TIME_NOW, DISPATCH_TIME_FOREVER, 0);
+    g_watcher_kick = false;
 
     dispatch_source_set_event_handler(w, ^{
         @autoreleasepool {
             if (!g_running || g_gen != gen) {
-                g_watcher = NULL;
+                if (g_watcher == w) g_watcher = NULL;
                 dispatch_source_cancel(w);
                 delete_pending_marker();
+                watcher_stats_record(ticks, now_ms() - start_ms);
                 return;
             }
 
+            uint64_t now = now_ms();
+            ticks++;
+            if (g_watcher_kick) {
+                g_watcher_kick = false;
+                activity_ms = now;
+                sparse_ticks = 0;
+            }
+
             bool changed_this_tick = false;
             NSString *latest_candidate = nil;
 
@@ -522,8 +760,10 @@ static void start_unified_watcher(uint64_t gen, bool pre_injected, NSInteger pre
             }
 
             /* ── Phase 2: Escalation — inject Cmd+C ────────────────── */
-            if (!injected && ticks >= ESCALATION_TICK) {
+            if (!injected && now - start_ms >= ESCALATION_MS) {
                 injected = true;
+                activity_ms = now;
+                sparse_ticks = 0;
                 cc_inject_before = [[NSPasteboard generalPasteboard] changeCount];
                 inject_cmd_c();
             }
@@ -546,27 +786,34 @@ static void start_unified_watcher(uint64_t gen, bool pre_injected, NSInteger pre
             if (changed_this_tick) {
                 stable_candidate = [latest_candidate copy];
                 saw_candidate = true;
-                settle_ticks = 0;
-            } else if (saw_candidate) {
-                if (++settle_ticks >= SETTLE_TICKS) {
-                    g_watcher = NULL;
-                    dispatch_source_cancel(w);
-                    const char *utf8 = [stable_candidate UTF8String];
-                    if (!utf8) utf8 = "";
-                    finalize_selection(utf8, strlen(utf8), true, restore_snapshot, gen);
-                    return;
-                }
+                candidate_ms = now;
+                activity_ms = now;
+                sparse_ticks = 0;
+            } else if (saw_candidate && now - candidate_ms >= SETTLE_MS) {
+                g_watcher = NULL;
+                dispatch_source_cancel(w);
+                watcher_stats_record(ticks, now - start_ms);
+                met_record(&met_wait, (long long)(now - start_ms) * 1000);
+                const char *utf8 = [stable_candidate UTF8String];
+                if (!utf8) utf8 = "";
+                finalize_selection(utf8, strlen(utf8), true, restore_snapshot, gen);
+                met_event_done(strlen(utf8));
+                return;
             }
 
             /* ── Timeout ───────────────────────────────────────────── */
-            if (++ticks >= MAX_POLL_TICKS) {
+            if (now - start_ms >= MAX_POLL_MS) {
                 g_watcher = NULL;
                 dispatch_source_cancel(w);
+                watcher_stats_record(ticks, now - start_ms);
+                met_record(&met_wait, (long long)(now - start_ms) * 1000);
+                met_timeouts++;
 
                 if (saw_candidate && stable_candidate.length > 0) {
                     const char *utf8 = [stable_candidate UTF8String];
                     if (!utf8) utf8 = "";
                     finalize_selection(utf8, strlen(utf8), true, restore_snapshot, gen);
+                    met_event_done(strlen(utf8));
                     return;
                 }
 
@@ -579,7 +826,24 @@ static void start_unified_watcher(uint64_t gen, bool pre_injected, NSInteger pre
                    or double-clicked an empty space). We MUST clear the stale cache
                    preventing ZSH from hallucinating a phantom selection. */
                 clear_primary_cache();
+                met_event_done(0);
+                return;
             }
+
+            /* ── Re-arm: back off, but never past the next deadline ─ */
+            uint64_t delay = watcher_next_ms(now - activity_ms, sparse_ticks);
+            if (now - activity_ms >= DENSE_MS) sparse_ticks++;
+            uint64_t deadline = start_ms + MAX_POLL_MS;
+            if (!injected && start_ms + ESCALATION_MS < deadline)
+                deadline = start_ms + ESCALATION_MS;
+            if (saw_candidate && candidate_ms + SETTLE_MS < deadline)
+                deadline = candidate_ms + SETTLE_MS;
+            if (now + delay > deadline)
+                delay = deadline > now ? deadline - now : 0;
+            dispatch_source_set_timer(w, dispatch_time(DISPATCH_TIME_NOW,
+                                                       (int64_t)delay * NSEC_PER_MSEC),
+                                      DISPATCH_TIME_FOREVER,
+                                      delay > 1 ? NSEC_PER_MSEC / 2 : 0);
         }
     });
     g_watcher = w;
@@ -594,15 +858,18 @@ static void handle_mouse_up(NSInteger click_count, CGFloat drag_pixels) {
     if (!g_running) return;
     cancel_watcher();
     g_gen++;
+    met_event_start_us = monotonic_us();
     NSArray *restore_snapshot = g_mousedown_bk ? [g_mousedown_bk copy] : nil;
 
     /* Path A — Accessibility API */
     int ax = ax_try();
+    met_record(&met_wait, monotonic_us() - met_event_start_us);
     if (ax != -1 && ax != AX_ELECTRON) {
         /* AX succeeded or terminal is AX-capable.  For non-definite
            clicks that are AX-capable, no clipboard protection needed
            (AX doesn't touch clipboard). */
         delete_pending_marker();
+        met_event_done(ax == 1 ? g_last_len : 0);
         return;
     }
 
@@ -630,6 +897,7 @@ static void handle_mouse_up(NSInteger click_count, CGFloat drag_pixels) {
                  clear_primary_cache();
             }
         }
+        met_event_done(0);
         return;
     }
 
@@ -650,6 +918,7 @@ static void handle_mouse_up(NSInteger click_count, CGFloat drag_pixels) {
                     const char *utf8 = [str UTF8String];
                     if (!utf8) utf8 = "";
                     finalize_selection(utf8, strlen(utf8), true, restore_snapshot, gen);
+                    met_event_done(strlen(utf8));
                     return;
                 }
             }
@@ -711,6 +980,12 @@ static CGEventRef event_tap_callback(CGEventTapProxy proxy,
                 NSPasteboard *pb = [NSPasteboard generalPasteboard];
                 g_mousedown_cc = pb.changeCount;
 
+                /* A click can activate an app before its activation
+                   notification arrives; re-check here, off the MouseUp
+                   path, so the AX host cache never answers for the
+                   previous app. */
+                if (g_ax_pid > 0) ax_observer_follow_frontmost();
+
                 /* Preserve restore snapshot from first click in burst. */
                 /* While pending exists, keep the existing backup snapshot so
                    rapid successive replaces restore the true pre-selection
@@ -821,24 +1096,6 @@ static bool set_clipboard_utf8(const char *data, size_t len) {
     return [pb setString:str forType:NSPasteboardTypeString];
 }
 
-static char *read_all_stdin(size_t *out_len) {
-    size_t cap = 4096, total = 0;
-    char  *buf = malloc(cap);
-    if (!buf) { *out_len = 0; return NULL; }
-    for (;;) {
-        if (total + 4096 > cap) {
-            cap *= 2;
-            if (cap > MAX_CLIP_SIZE) break;
-            char *nb = realloc(buf, cap);
-            if (!nb) { free(buf); *out_len = 0; return NULL; }
-            buf = nb;
-        }
-        ssize_t n = read(STDIN_FILENO, buf + total, 4096);
-        if (n > 0) total += (size_t)n; else break;
-    }
-    *out_len = total; return buf;
-}
-
 /* ── Short-lived modes ───────────────────────────────────────────────── */
 static int run_oneshot(void) {
     @autoreleasepool {
@@ -887,6 +1144,20 @@ static int run_status(const char *cache_dir_arg) {
         if (n == 0) strcpy(preview, "(empty)");
         else if (n == sizeof(preview)-1) strcpy(preview+60, "...");
     }
+    /* Watcher tick counts from the running daemon (absent until the
+       first watcher run). */
+    unsigned long runs = 0, max_ticks = 0, ax_kicks = 0, ax_skips = 0;
+    unsigned long long ticks = 0, fixed = 0;
+    int ax_obs = 0;
+    FILE *sf = alive ? fopen(g_stats_path, "r") : NULL;
+    if (sf) {
+        if (fscanf(sf, "runs %lu ticks %llu fixed_ticks %llu max_ticks %lu "
+                       "ax_wakeups %lu ax_observer %d ax_skips %lu",
+                   &runs, &ticks, &fixed, &max_ticks, &ax_kicks, &ax_obs, &ax_skips) < 6)
+            runs = 0;
+        fclose(sf);
+    }
+
     bool ax = AXIsProcessTrusted();
     char pid_buf[32] = "";
     if (alive) snprintf(pid_buf, sizeof(pid_buf), "%d)", dpid);
@@ -902,10 +1173,27 @@ static int run_status(const char *cache_dir_arg) {
         g_cache_dir, preview,
         ax ? "AX (AppKit) + Named PB (Ghostty) + Cmd+C inject (others)"
            : "disabled (no Accessibility permission)");
+    if (runs > 0)
+        fprintf(stdout,
+            "  watcher runs  : %lu\n"
+            "  watcher ticks : %llu (fixed 1 ms timer: %llu), max %lu per run\n"
+            "  AX wakeups    : %lu (observer on frontmost app: %s)\n"
+            "  AX skipped    : %lu (host known to lack selected-text)\n",
+            runs, ticks, fixed, max_ticks, ax_kicks, ax_obs ? "yes" : "no", ax_skips);
     return alive ? 0 : 1;
 }
 
+/* --stats: print the running daemon's METRICS_FILE. */
+static int run_stats(const char *cache_dir_arg) {
+    if (ensure_cache_dir(cache_dir_arg) != 0)
+        return 1;
+    return met_request_dump(g_pid_path, g_metrics_path, g_cache_dir);
+}
+
 /* ── Daemon ──────────────────────────────────────────────────────────── */
+/* Readiness: ZES_READY_FD is inherited through posix_spawn; the worker
+   takes it before the /dev/null redirect and signals READY once the tap
+   and observers are installed. */
 static int run_daemon_worker(const char *cache_dir_arg) {
     if (ensure_cache_dir(cache_dir_arg) != 0) return 1;
     setsid();
@@ -918,6 +1206,7 @@ static int run_daemon_worker(const char *cache_dir_arg) {
 
     named_pb_init();
 
+    ready_fd_take();
     { int dn = open("/dev/null", O_RDWR|O_CLOEXEC);
       if (dn >= 0) { dup2(dn,0); dup2(dn,1); dup2(dn,2); if (dn>2) close(dn); } }
 
@@ -935,6 +1224,10 @@ static int run_daemon_worker(const char *cache_dir_arg) {
     dispatch_source_set_event_handler(si, stop); dispatch_resume(si);
     dispatch_source_t sh = dispatch_source_create(DISPATCH_SOURCE_TYPE_SIGNAL, SIGHUP,  0, dispatch_get_main_queue());
     dispatch_source_set_event_handler(sh, stop); dispatch_resume(sh);
+    signal(SIGUSR1, SIG_IGN);
+    met_start_us = monotonic_us();
+    dispatch_source_t su = dispatch_source_create(DISPATCH_SOURCE_TYPE_SIGNAL, SIGUSR1, 0, dispatch_get_main_queue());
+    dispatch_source_set_event_handler(su, ^{ met_dump_to(g_metrics_path); }); dispatch_resume(su);
 
     if (AXIsProcessTrusted()) {
         CGEventMask mask = CGEventMaskBit(kCGEventLeftMouseDown) |
@@ -951,12 +1244,31 @@ static int run_daemon_worker(const char *cache_dir_arg) {
         }
     }
 
+    /* Keep the AX selection observer on whichever app is frontmost. */
+    id activation_obs = nil;
+    if (AXIsProcessTrusted()) {
+        ax_observer_follow_frontmost();
+        activation_obs = [[[NSWorkspace sharedWorkspace] notificationCenter]
+            addObserverForName:NSWorkspaceDidActivateApplicationNotification
+                        object:nil
+                         queue:[NSOperationQueue mainQueue]
+                    usingBlock:^(NSNotification *note) {
+                        (void)note;
+                        ax_observer_follow_frontmost();
+                    }];
+    }
+
+    ready_notify();
     CFRunLoopRun();
 
     g_running = 0;
+    if (activation_obs)
+        [[[NSWorkspace sharedWorkspace] notificationCenter] removeObserver:activation_obs];
+    ax_observer_stop();
     cancel_watcher();
     delete_pending_marker();
     dispatch_source_cancel(st); dispatch_source_cancel(si); dispatch_source_cancel(sh);
+    dispatch_source_cancel(su);
     if (g_tap) {
         CGEventTapEnable(g_tap, false);
         if (g_tap_rls) {
@@ -968,7 +1280,8 @@ static int run_daemon_worker(const char *cache_dir_arg) {
     if (g_fd_primary >= 0) { close(g_fd_primary); g_fd_primary = -1; }
     if (g_fd_seq     >= 0) { close(g_fd_seq);     g_fd_seq     = -1; }
     unlink(g_primary_path); unlink(g_seq_path);
-    unlink(g_pid_path); unlink(g_pending_path);
+    unlink(g_pid_path); unlink(g_pending_path); unlink(g_stats_path);
+    unlink(g_metrics_path);
     return 0;
 }
 
@@ -1000,7 +1313,7 @@ static int run_daemon(const char *exe_path, const char *cache_dir_arg) {
 int main(int argc, char *argv[]) {
     const char *cache_dir_arg = NULL;
     bool oneshot=0, get_clip=0, copy_clip=0, clr_prim=0,
-         chk_ax=0, req_ax=0, child=0, status=0;
+         chk_ax=0, req_ax=0, child=0, status=0, stats=0, osc52=0;
 
     for (int i = 1; i < argc; i++) {
         if      (!strcmp(argv[i],"--oneshot"))        oneshot   = true;
@@ -1011,6 +1324,8 @@ int main(int argc, char *argv[]) {
         else if (!strcmp(argv[i],"--request-ax"))     req_ax    = true;
         else if (!strcmp(argv[i],"--_daemon-child"))  child     = true;
         else if (!strcmp(argv[i],"--status"))         status    = true;
+        else if (!strcmp(argv[i],"--stats"))          stats     = true;
+        else if (!strcmp(argv[i],"--osc52"))          osc52     = true;
         else if (!strcmp(argv[i],"--help")||!strcmp(argv[i],"-h")) {
             fprintf(stderr,
                 "Usage: %s [cache_dir] [OPTIONS]\n"
@@ -1022,7 +1337,9 @@ int main(int argc, char *argv[]) {
                 "  --clear-primary   Clear cache files only\n"
                 "  --check-ax        Exit 0 if Accessibility granted\n"
                 "  --request-ax      Prompt for Accessibility permission\n"
-                "  --status          Print daemon status\n",
+                "  --status          Print daemon status\n"
+                "  --stats           Print the running daemon's metrics\n"
+                "  --osc52           Read stdin, write it to the terminal as OSC 52\n",
                 argv[0]);
             return 0;
         } else { cache_dir_arg = argv[i]; }
@@ -1030,6 +1347,8 @@ int main(int argc, char *argv[]) {
 
     if (chk_ax)  return AXIsProcessTrusted() ? 0 : 1;
     if (status)  return run_status(cache_dir_arg);
+    if (stats)   return run_stats(cache_dir_arg);
+    if (osc52)   return run_osc52();
     if (req_ax) {
         @autoreleasepool {
             NSDictionary *opts = @{ (__bridge id)kAXTrustedCheckOptionPrompt : @YES };
@@ -14,20 +14,42 @@
 //   zes-wl-selection-agent --get-clipboard      Print clipboard contents
 //   zes-wl-selection-agent --copy-clipboard     Read stdin, set clipboard
 //   zes-wl-selection-agent --clear-primary      Clear PRIMARY selection
+//   zes-wl-selection-agent --stats              Print the daemon's metrics
+//   zes-wl-selection-agent --osc52              Read stdin, write it as OSC 52
+//
+// In daemon mode the agent also listens on <cache_dir>/agent.sock and
+// answers GET/SET/CLEAR requests over its existing Wayland connection, so
+// the shell can paste and copy without spawning a short-lived agent per call.
+// --copy-clipboard <cache_dir> hands its input to that daemon with SET and
+// only forks its own clipboard server when no daemon accepts it.
+//
+// With ZES_LAZY_PRIMARY=1 (data-control compositors) the daemon only bumps
+// seq on a PRIMARY change and receives the text when the shell asks for it.
+//
+// SIGUSR1 makes the daemon write its metrics to <cache_dir>/agent.metrics;
+// --stats [cache_dir] triggers that and prints the result.
+//
+// --osc52 needs no Wayland connection (SSH sessions); the daemon's OSC52
+// verb returns the same tmux/screen-framed sequence to the shell.
 
 #define _GNU_SOURCE
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <time.h>
 #include <poll.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/mman.h>
 #include <wayland-client.h>
 
@@ -39,24 +61,23 @@
    need an extra generated header just for the daemon surface. */
 #include "xdg-shell-client-protocol.h"
 
-/* Cache-directory layout constants and safety caps.
-   CACHE_DIR_TEMPLATE: sprintf template for the HOME-based fallback path.
-   PRIMARY_FILE / SEQ_FILE / PID_FILE: filenames inside the cache directory.
+/* Safety caps (cache-file names live in zes-agent-core.h).
    MAX_SELECTION_SIZE: 1 MB cap on PRIMARY reads.
    MAX_CLIPBOARD_SIZE: 4 MB cap on clipboard reads (larger to accommodate
-   rich pastes). */
-#define CACHE_DIR_TEMPLATE "%s/.cache/zsh-edit-select"
-#define PRIMARY_FILE "primary"
-#define SEQ_FILE "seq"
-#define PID_FILE "agent.pid"
+   rich pastes).
+   PS_POLL_MIN_MS / PS_POLL_MAX_MS: bounds of the Mutter re-read interval
+   (see the daemon event loop). */
 #define MAX_SELECTION_SIZE (1024 * 1024)
 #define MAX_CLIPBOARD_SIZE (4 * 1024 * 1024)
+#define PS_POLL_MIN_MS 50
+#define PS_POLL_MAX_MS 800
 
-static volatile sig_atomic_t running = 1;
-static char cache_dir[512];
-static char primary_path[560];
-static char seq_path[560];
-static char pid_path[560];
+/* Shared daemon core: cache layout, publish, hash/history, metrics and the
+   socket API.  "wait" in the metrics is time blocked on the offer pipe,
+   until the source app closes it. */
+#define MET_AGENT "wayland"
+#define ZES_MAX_PAYLOAD MAX_CLIPBOARD_SIZE
+#include "zes-agent-core.h"
 
 /* Wayland globals */
 static struct wl_display *wl_dpy = NULL;
@@ -71,9 +92,10 @@ static struct wl_data_offer *current_clipboard_offer = NULL;
 /* Monotonically increasing counter written to SEQ_FILE; the shell polls
    its mtime to detect selection changes without reading content. */
 static unsigned long seq_counter = 0;
-/* True when the current PRIMARY / clipboard offer advertises a text MIME. */
-static bool ps_has_text = false;
-static bool clip_has_text = false;
+/* Best text MIME type the current PRIMARY / clipboard offer advertises
+   (see offer_text_mime()), or NULL when it offers no text. */
+static const char *ps_text_mime = NULL;
+static const char *clip_text_mime = NULL;
 
 /* Surface globals — Mutter/GNOME only delivers PRIMARY selection events
    to clients with a mapped surface.  The daemon creates a permanent 1x1
@@ -102,20 +124,20 @@ static bool keyboard_entered = false;
 /* Data-control offer for clipboard — set by data-control device selection event.
    dc_clipboard_offer: opaque pointer to either zwlr_data_control_offer_v1 or
    ext_data_control_offer_v1 (cast as needed based on dc_use_ext flag).
-   dc_clip_has_text: true when the current offer being built advertises text.
-   dc_clip_has_text_sel: snapshot of dc_clip_has_text taken when the
+   dc_clip_mime: best text MIME type of the offer being built, NULL if none.
+   dc_clip_mime_sel: snapshot of dc_clip_mime taken when the
    selection event fires — immune to later primary_selection data_offer
-   events that would reset dc_clip_has_text for a different offer.
+   events that would reset dc_clip_mime for a different offer.
    dc_got_selection: true when the data-control device selection event fires. */
 static void *dc_clipboard_offer = NULL;
-static bool dc_clip_has_text = false;
-static bool dc_clip_has_text_sel = false;
+static const char *dc_clip_mime = NULL;
+static const char *dc_clip_mime_sel = NULL;
 static bool dc_got_selection = false;
 static bool dc_use_ext = false;
 
 /* Data-control offer for PRIMARY selection — set by data-control primary_selection event. */
 static void *dc_primary_offer = NULL;
-static bool dc_primary_has_text_sel = false;
+static const char *dc_primary_mime_sel = NULL;
 
 /* Set true whenever dd_handle_selection fires — even if the offer is NULL
    (empty clipboard).  Used as the exit condition for the focus-surface
@@ -125,10 +147,47 @@ static bool got_clip_selection = false;
 /* Mode flags — controls handler behavior */
 static bool is_daemon_mode = false;
 static bool got_selection = false; /* one-shot: set when selection event arrives */
-/* Cached copy of the last PRIMARY content and its byte length.
-   Used to skip redundant cache writes when content has not changed. */
+/* Length and zes_hash64() of the last PRIMARY content.  Change detection
+   compares these two instead of the text itself, so the daemon keeps no
+   second copy of the selection: the primary file holds it, and the socket
+   PRIMARY verb serves it from there.  last_known_len > 0 means "PRIMARY is
+   non-empty".  last_known_content is only used in lazy mode, where the
+   materialised text is never written to the primary file. */
 static char *last_known_content = NULL;
 static size_t last_known_len = 0;
+static uint64_t last_known_hash = 0;
+
+/* Splice path (daemon mode, fd_primary open, unless ZES_NO_SPLICE=1): the
+   offer pipe is spliced straight into fd_primary instead of being read into
+   a heap buffer and written back out; the hash is then taken from a
+   read-only mapping of the file just written. */
+static bool splice_primary = false;
+
+/* Lazy PRIMARY (ZES_LAZY_PRIMARY=1, data-control compositors only): a
+   selection event only bumps seq and remembers its offer; the text is
+   received from the source client when the shell asks for it through the
+   socket PRIMARY verb.  primary_pending is set while the remembered offer
+   has not been read.  The offer objects themselves are the ones already
+   kept alive in dc_primary_offer / current_ps_offer until replaced. */
+static bool lazy_primary = false;
+static bool primary_pending = false;
+static struct ext_data_control_offer_v1 *pending_ext_offer = NULL;
+static struct zwlr_data_control_offer_v1 *pending_wlr_offer = NULL;
+static struct zwp_primary_selection_offer_v1 *pending_ps_offer = NULL;
+static const char *pending_mime = NULL;
+
+/* Opt-in burst coalescing (ZES_COALESCE_MS, daemon mode): compositors that
+   stream intermediate selections during a drag send one primary_selection
+   event per step.  With coalesce_us > 0 the first event arms
+   coalesce_due_us on the monotonic clock and each later one only replaces
+   the remembered offer; at the deadline the final offer is read once.
+   The offers stay alive for the same reason as in lazy mode. */
+static long long coalesce_us = 0;
+static long long coalesce_due_us = 0;
+static struct ext_data_control_offer_v1 *coalesce_ext_offer = NULL;
+static struct zwlr_data_control_offer_v1 *coalesce_wlr_offer = NULL;
+static struct zwp_primary_selection_offer_v1 *coalesce_ps_offer = NULL;
+static const char *coalesce_mime = NULL;
 
 /* For --copy-clipboard: data source serving */
 static struct wl_data_source *copy_source = NULL;
@@ -136,103 +195,13 @@ static char *copy_data = NULL;
 static size_t copy_data_len = 0;
 static bool copy_done = false;
 
-/* Persistent fds for write_primary() daemon hot path.
-   Opened once after daemon() in run_daemon(); reused for all subsequent writes.
-   -1 = not yet open (pre-daemon initial write uses the open/write/close fallback). */
-static int fd_primary = -1;
-static int fd_seq     = -1;
-
-/* SIGTERM / SIGINT handler — sets the flag that exits all event loops. */
-static void signal_handler(int sig) {
-    (void)sig;
-    running = 0;
-}
-
-/* Resolve cache directory path (from argument, XDG_RUNTIME_DIR, /dev/shm,
-   or HOME), populate the four path globals (cache_dir, primary_path,
-   seq_path, pid_path), and create the directory if needed.
-   Returns 0 on success, -1 on failure. */
-static int ensure_cache_dir(const char *dir) {
-    if (dir && dir[0]) {
-        snprintf(cache_dir, sizeof(cache_dir), "%s", dir);
-    } else {
-        const char *runtime = getenv("XDG_RUNTIME_DIR");
-        if (runtime) {
-            snprintf(cache_dir, sizeof(cache_dir), "%s/zsh-edit-select-%d",
-                     runtime, (int)getuid());
-        } else if (access("/dev/shm", W_OK | X_OK) == 0) {
-            /* /dev/shm is guaranteed in-memory tmpfs on Linux — faster than
-               HOME/.cache for short-lived modes without an explicit cache_dir.
-               access() fails on non-Linux and the chain falls through cleanly. */
-            snprintf(cache_dir, sizeof(cache_dir),
-                     "/dev/shm/zsh-edit-select-%d", (int)getuid());
-        } else {
-            const char *home = getenv("HOME");
-            if (!home) return -1;
-            snprintf(cache_dir, sizeof(cache_dir), CACHE_DIR_TEMPLATE, home);
-        }
-    }
-    snprintf(primary_path, sizeof(primary_path), "%s/%s", cache_dir, PRIMARY_FILE);
-    snprintf(seq_path, sizeof(seq_path), "%s/%s", cache_dir, SEQ_FILE);
-    snprintf(pid_path, sizeof(pid_path), "%s/%s", cache_dir, PID_FILE);
-
-    struct stat st;
-    if (stat(cache_dir, &st) == -1) {
-        if (mkdir(cache_dir, 0700) == -1 && errno != EEXIST)
-            return -1;
-    }
-    return 0;
-}
-
-
-
-/* Write selection text to the PRIMARY cache file and the monotonic
-   sequence number to the SEQ file.  Uses persistent fds when available
-   (daemon hot path) or falls back to open/write/close (short-lived modes). */
-static void write_primary(const char *data, size_t len, unsigned long seq) {
-    if (fd_primary >= 0) {
-        /* Persistent-fd hot path: seek to start, write new content, then
-           truncate to correct length.  ftruncate is mandatory — without it,
-           content that shrinks between events (e.g. "hello world" → "hi")
-           leaves stale bytes at the end that the shell reads as part of the
-           new selection.  The (void) casts match the existing style. */
-        if (len > 0 && data) {
-            ssize_t r = pwrite(fd_primary, data, len, 0);
-            (void)r;
-        }
-        (void)!ftruncate(fd_primary, (off_t)len);
-
-        /* primary must be fully committed before seq is touched —
-           seq's mtime is the shell's only per-keypress detection signal. */
-        char buf[24];
-        int n = snprintf(buf, sizeof(buf), "%lu\n", seq);
-        ssize_t r = pwrite(fd_seq, buf, (size_t)n, 0);
-        (void)r;
-        (void)!ftruncate(fd_seq, (off_t)n);
-        return;
-    }
-
-    /* Fallback path: used for the pre-daemon() initial write (fd_primary is
-       still -1 at that point) and if open() failed after daemon().
-       All short-lived modes (--oneshot, --get-clipboard, --copy-clipboard,
-       --clear-primary) also use this path since they never open persistent fds. */
-    int fd = open(primary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
-    if (fd < 0) return;
-    if (len > 0 && data) {
-        ssize_t r = write(fd, data, len);
-        (void)r;
-    }
-    close(fd);
-
-    fd = open(seq_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
-    if (fd >= 0) {
-        char buf[24];
-        int n = snprintf(buf, sizeof(buf), "%lu\n", seq);
-        ssize_t r = write(fd, buf, n);
-        (void)r;
-        close(fd);
-    }
-}
+/* Daemon-mode data-control device (one of the two, matching dc_use_ext)
+   and the source the daemon currently owns after a socket SET request.
+   copy_data doubles as that source's buffer; it is freed when the source
+   is cancelled because another client took the clipboard. */
+static struct ext_data_control_device_v1 *ext_dc_daemon_dev = NULL;
+static struct zwlr_data_control_device_v1 *wlr_dc_daemon_dev = NULL;
+static void *dc_daemon_source = NULL;
 
 /* ------------------------------------------------------------------ */
 /* Utility: read text from an fd with poll timeout                     */
@@ -242,20 +211,28 @@ static void write_primary(const char *data, size_t len, unsigned long seq) {
  * preserved across F_GETFL/F_SETFL — F_SETFL alone is sufficient.
  * The initial_timeout_ms is longer for the first chunk to cover the
  * round-trip to the selection owner; subsequent chunks use a shorter
- * 100 ms timeout to detect EOF quickly without burning CPU. */
+ * 100 ms timeout to detect EOF quickly without burning CPU.
+ * If out_hash is non-NULL it receives zes_hash64() of the data, computed
+ * chunk by chunk as it is read.  With scratch the data is read into the
+ * daemon's arena rather than a malloc'd buffer; release either kind with
+ * scratch_free(). */
 static char *read_fd_with_timeout(int fd, size_t *out_len, size_t max_size,
-                                   int initial_timeout_ms) {
+                                   int initial_timeout_ms, uint64_t *out_hash,
+                                   bool scratch) {
     fcntl(fd, F_SETFL, O_NONBLOCK);
 
     char *buf = NULL;
     size_t total = 0, capacity = 0;
     struct pollfd pfd = { .fd = fd, .events = POLLIN };
     int timeout_ms = initial_timeout_ms;
+    struct zes_hash_state hs;
+    zes_hash_reset(&hs);
+    long long start = monotonic_us();
 
     while (1) {
         int ret = poll(&pfd, 1, timeout_ms);
         if (ret < 0) { if (errno == EINTR) continue; break; }
-        if (ret == 0) break;
+        if (ret == 0) { met_timeouts++; break; }
         if ((pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) &&
             !(pfd.revents & POLLIN))
             break;
@@ -263,13 +240,17 @@ static char *read_fd_with_timeout(int fd, size_t *out_len, size_t max_size,
         if (pfd.revents & POLLIN) {
             if (total + 4096 > capacity) {
                 capacity = capacity ? capacity * 2 : 4096;
-                if (capacity > max_size) break;
-                char *nb = realloc(buf, capacity + 1);
-                if (!nb) { free(buf); buf = NULL; total = 0; break; }
+                if (capacity > max_size) { met_oversize++; break; }
+                char *nb = scratch ? arena_reserve(capacity + 1)
+                                   : realloc(buf, capacity + 1);
+                if (!nb) { if (!scratch) free(buf); buf = NULL; total = 0; break; }
                 buf = nb;
             }
             ssize_t n = read(fd, buf + total, 4096);
-            if (n > 0) total += n;
+            if (n > 0) {
+                if (out_hash) zes_hash_update(&hs, buf + total, (size_t)n);
+                total += n;
+            }
             else if (n == 0) break;
             else if (errno != EAGAIN && errno != EWOULDBLOCK) break;
         }
@@ -278,9 +259,86 @@ static char *read_fd_with_timeout(int fd, size_t *out_len, size_t max_size,
 
     if (buf) { buf[total] = '\0'; }
     *out_len = total;
+    if (out_hash) *out_hash = buf ? zes_hash_digest(&hs) : zes_hash64("", 0);
+    met_bytes += total;
+    met_record(&met_wait, monotonic_us() - start);
     return buf;
 }
 
+/* Splice up to max_size bytes from the pipe fd into fd_primary at offset 0
+ * and truncate the file to the amount received.  Same poll and timeout
+ * semantics as read_fd_with_timeout(), but the bytes move pipe → page cache
+ * inside the kernel, with no user-space buffer.  Returns 0 on success, or
+ * -1 before anything was consumed when splice() is not supported for this
+ * file, so the caller can fall back to reading the same pipe. */
+static int splice_fd_to_primary(int fd, size_t *out_len, size_t max_size,
+                                int initial_timeout_ms) {
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    size_t total = 0;
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    int timeout_ms = initial_timeout_ms;
+    long long start = monotonic_us();
+
+    while (total < max_size) {
+        int ret = poll(&pfd, 1, timeout_ms);
+        if (ret < 0) { if (errno == EINTR) continue; break; }
+        if (ret == 0) { met_timeouts++; break; }
+        if ((pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) &&
+            !(pfd.revents & POLLIN))
+            break;
+
+        if (pfd.revents & POLLIN) {
+            loff_t off = (loff_t)total;
+            ssize_t n = splice(fd, NULL, fd_primary, &off, max_size - total,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) total += (size_t)n;
+            else if (n == 0) break;
+            else if (errno == EINVAL && total == 0) return -1;
+            else if (errno != EAGAIN && errno != EWOULDBLOCK) break;
+        }
+        timeout_ms = 100;
+    }
+
+    (void)!ftruncate(fd_primary, (off_t)total);
+    *out_len = total;
+    if (total >= max_size) met_oversize++;
+    met_bytes += total;
+    met_record(&met_wait, monotonic_us() - start);
+    return 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Text MIME negotiation                                               */
+/* ------------------------------------------------------------------ */
+/* Text types in order of preference.  GTK and Qt advertise the UTF-8
+   MIME type (Qt with an upper-case charset), XWayland clients the X11
+   atom names, and some sources only the bare or legacy types. */
+static const char *const text_mimes[] = {
+    "text/plain;charset=utf-8",
+    "text/plain;charset=UTF-8",
+    "UTF8_STRING",
+    "text/plain",
+    "STRING",
+    "TEXT",
+};
+
+/* Called from every offer listener with the type just advertised: keep in
+ * *best whichever of *best and mime_type ranks higher in text_mimes.  Once
+ * the offer is complete *best is the single type receive() will ask for,
+ * so a source that does not serve text/plain;charset=utf-8 is not left to
+ * time out.  *best always points into text_mimes, never at the listener's
+ * transient string. */
+static void offer_text_mime(const char **best, const char *mime_type) {
+    for (size_t i = 0; i < sizeof(text_mimes) / sizeof(text_mimes[0]); i++) {
+        if (text_mimes[i] == *best) return;
+        if (strcmp(mime_type, text_mimes[i]) == 0) {
+            *best = text_mimes[i];
+            return;
+        }
+    }
+}
+
 /* ------------------------------------------------------------------ */
 /* Read text from a primary selection offer                            */
 /* ------------------------------------------------------------------ */
@@ -289,14 +347,14 @@ static char *read_fd_with_timeout(int fd, size_t *out_len, size_t max_size,
  * flushes the display to trigger delivery, then reads from the read end.
  * The write end is closed before reading so the read can detect EOF. */
 static char *read_ps_offer(struct zwp_primary_selection_offer_v1 *offer,
-                            size_t *out_len) {
+                            const char *mime, size_t *out_len) {
     int fds[2];
     if (pipe2(fds, O_CLOEXEC) == -1) return NULL;
-    zwp_primary_selection_offer_v1_receive(
-        offer, "text/plain;charset=utf-8", fds[1]);
+    zwp_primary_selection_offer_v1_receive(offer, mime, fds[1]);
     wl_display_flush(wl_dpy);
     close(fds[1]);
-    char *data = read_fd_with_timeout(fds[0], out_len, MAX_SELECTION_SIZE, 500);
+    char *data = read_fd_with_timeout(fds[0], out_len, MAX_SELECTION_SIZE, 500,
+                                      NULL, false);
     close(fds[0]);
     return data;
 }
@@ -306,161 +364,260 @@ static char *read_ps_offer(struct zwp_primary_selection_offer_v1 *offer,
 /* ------------------------------------------------------------------ */
 /* Read text from a clipboard (wl_data_offer) offer.
  * Same pipe protocol as read_ps_offer but uses wl_data_offer_receive. */
-static char *read_clip_offer(struct wl_data_offer *offer, size_t *out_len) {
+static char *read_clip_offer(struct wl_data_offer *offer, const char *mime,
+                             size_t *out_len) {
     int fds[2];
     if (pipe2(fds, O_CLOEXEC) == -1) return NULL;
-    wl_data_offer_receive(offer, "text/plain;charset=utf-8", fds[1]);
+    wl_data_offer_receive(offer, mime, fds[1]);
     wl_display_flush(wl_dpy);
     close(fds[1]);
-    char *data = read_fd_with_timeout(fds[0], out_len, MAX_CLIPBOARD_SIZE, 500);
+    char *data = read_fd_with_timeout(fds[0], out_len, MAX_CLIPBOARD_SIZE, 500,
+                                      NULL, false);
     close(fds[0]);
     return data;
 }
 
 /* ===== BASE64 LOOKUP TABLE ======================================== */
 
-static const char b64_enc_table[] =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
 /* ===== OSC 52 WRITE (Mechanism A) ================================= */
 /* OSC 52 read is intentionally omitted: it requires putting the terminal
    in raw mode and triggers a security confirmation popup on Kitty
    ("A program wants to read from the system clipboard").  The three
    Wayland-native mechanisms (wl_data_device, data-control, focus surface)
-   cover all major compositors without touching the terminal. */
-
-/* Write clipboard data to the terminal via OSC 52 escape sequence.
- * Single write() syscall to /dev/tty — no Wayland involvement.
- * Returns true if the write succeeded (terminal accepted the sequence). */
-static bool osc52_write(const char *data, size_t len) {
-    int tty_fd = open("/dev/tty", O_WRONLY | O_CLOEXEC);
-    if (tty_fd < 0) return false;
-
-    /* Encode base64 directly into the framing buffer to avoid a
-       separate malloc/free/strlen for the intermediate b64 string.
-       Layout: "\e]52;c;" (7) + base64 (b64_len) + BEL (1) */
-    size_t b64_len = 4 * ((len + 2) / 3);
-    size_t total = 7 + b64_len + 1;
-    char *buf = malloc(total);
-    if (!buf) { close(tty_fd); return false; }
-
-    memcpy(buf, "\033]52;c;", 7);
-
-    /* Inline base64 encode into buf+7 */
-    {
-        const unsigned char *src = (const unsigned char *)data;
-        size_t i = 0, j = 7;
-        while (i < len) {
-            uint32_t a = (i < len) ? src[i++] : 0;
-            uint32_t b = (i < len) ? src[i++] : 0;
-            uint32_t c = (i < len) ? src[i++] : 0;
-            uint32_t triple = (a << 16) | (b << 8) | c;
-            buf[j++] = b64_enc_table[(triple >> 18) & 0x3F];
-            buf[j++] = b64_enc_table[(triple >> 12) & 0x3F];
-            buf[j++] = b64_enc_table[(triple >> 6) & 0x3F];
-            buf[j++] = b64_enc_table[triple & 0x3F];
+   cover all major compositors without touching the terminal.  The
+   write itself is osc52_write() in zes-agent-core.h. */
+
+/* ===== DATA-CONTROL PROTOCOL LISTENERS (Mechanism B) ============== */
+
+/* Ask whichever PRIMARY offer is given to write its text, as mime, into a
+ * new pipe.  Returns the read end (the write end is already closed so EOF
+ * is seen), or -1 on failure. */
+static int open_primary_pipe(
+        struct ext_data_control_offer_v1 *ext_offer,
+        struct zwlr_data_control_offer_v1 *wlr_offer,
+        struct zwp_primary_selection_offer_v1 *ps_offer,
+        const char *mime) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) return -1;
+    if (ext_offer)
+        ext_data_control_offer_v1_receive(ext_offer, mime, fds[1]);
+    else if (wlr_offer)
+        zwlr_data_control_offer_v1_receive(wlr_offer, mime, fds[1]);
+    else
+        zwp_primary_selection_offer_v1_receive(ps_offer, mime, fds[1]);
+    wl_display_flush(wl_dpy);
+    close(fds[1]);
+    return fds[0];
+}
+
+/* Receive text from whichever PRIMARY offer is given over a pipe.
+ * Returns a buffer (release with scratch_free(); the arena when scratch)
+ * or NULL; out_hash, if non-NULL, receives its zes_hash64(). */
+static char *receive_primary_offer(
+        struct ext_data_control_offer_v1 *ext_offer,
+        struct zwlr_data_control_offer_v1 *wlr_offer,
+        struct zwp_primary_selection_offer_v1 *ps_offer,
+        const char *mime, size_t *out_len, uint64_t *out_hash, bool scratch) {
+    *out_len = 0;
+    int fd = open_primary_pipe(ext_offer, wlr_offer, ps_offer, mime);
+    if (fd < 0) return NULL;
+    char *sel = read_fd_with_timeout(fd, out_len, MAX_SELECTION_SIZE, 500,
+                                     out_hash, scratch);
+    close(fd);
+    return sel;
+}
+
+/* Splice path of process_primary_update(): stream the offer into
+ * fd_primary, then bump seq only if the length or hash differs from the
+ * previous selection.  Returns false (nothing consumed) when splice() is
+ * unavailable; splice_primary is then switched off for the session. */
+static bool splice_primary_update(
+        struct ext_data_control_offer_v1 *ext_offer,
+        struct zwlr_data_control_offer_v1 *wlr_offer,
+        struct zwp_primary_selection_offer_v1 *ps_offer,
+        const char *mime) {
+    long long start = monotonic_us();
+    int fd = open_primary_pipe(ext_offer, wlr_offer, ps_offer, mime);
+    if (fd < 0) return true;
+
+    size_t len = 0;
+    if (splice_fd_to_primary(fd, &len, MAX_SELECTION_SIZE, 500) != 0) {
+        splice_primary = false;
+        /* Nothing was consumed: the caller reads the same data again
+           through a fresh receive on the buffered path. */
+        close(fd);
+        return false;
+    }
+    close(fd);
+    long long wait = monotonic_us() - start;
+
+    /* Hash (and record in history) straight from the page cache. */
+    uint64_t h = 0;
+    if (len == 0)
+        trace_record(TRACE_READ, mime, NULL, 0, 0, wait);
+    if (len > 0) {
+        char *map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd_primary, 0);
+        if (map == MAP_FAILED) {
+            /* Cannot compare: treat as changed. */
+            h = last_known_hash + 1;
+            trace_record(TRACE_READ, mime, NULL, len, h, wait);
+        } else {
+            h = zes_hash64(map, len);
+            trace_record(TRACE_READ, mime, map, len, h, wait);
+            if (len != last_known_len || h != last_known_hash)
+                hist_record(map, len);
+            munmap(map, len);
         }
-        /* RFC 4648 padding */
-        if (len % 3 >= 1) buf[j - 1] = '=';
-        if (len % 3 == 1) buf[j - 2] = '=';
     }
-    buf[7 + b64_len] = '\a';
 
-    size_t written = 0;
-    while (written < total) {
-        ssize_t r = write(tty_fd, buf + written, total - written);
-        if (r > 0) { written += r; continue; }
-        if (r < 0 && errno == EINTR) continue;
-        break;
+    if (len != last_known_len || h != last_known_hash) {
+        seq_counter++;
+        write_seq(seq_counter);
+        last_known_len = len;
+        last_known_hash = h;
     }
-    free(buf);
-    close(tty_fd);
-    return written == total;
+    return true;
 }
 
-/* ===== DATA-CONTROL PROTOCOL LISTENERS (Mechanism B) ============== */
-
 /* Helper function: reads the primary selection from either standard
- * zwp_primary_selection or data-control protocols and updates the cache. */
-static void process_primary_update(
+ * zwp_primary_selection or data-control protocols and updates the cache.
+ * In lazy mode the read is deferred to materialize_primary(). */
+static void update_primary_cache(
         struct ext_data_control_offer_v1 *ext_offer,
         struct zwlr_data_control_offer_v1 *wlr_offer,
         struct zwp_primary_selection_offer_v1 *ps_offer,
-        bool has_text) {
+        const char *mime) {
     seq_counter++;
     got_selection = true;
 
     if (!is_daemon_mode) return;
 
-    if ((!ext_offer && !wlr_offer && !ps_offer) || !has_text) {
-        if (last_known_content) {
+    if ((!ext_offer && !wlr_offer && !ps_offer) || !mime) {
+        if (last_known_len > 0 || primary_pending) {
             seq_counter++;
             write_primary("", 0, seq_counter);
             free(last_known_content);
             last_known_content = NULL;
             last_known_len = 0;
+            last_known_hash = 0;
+            primary_pending = false;
         }
         return;
     }
 
-    size_t len = 0;
-    char *sel = NULL;
-
-    if (ext_offer) {
-        int fds[2];
-        if (pipe2(fds, O_CLOEXEC) != -1) {
-            ext_data_control_offer_v1_receive(ext_offer, "text/plain;charset=utf-8", fds[1]);
-            wl_display_flush(wl_dpy);
-            close(fds[1]);
-            sel = read_fd_with_timeout(fds[0], &len, MAX_SELECTION_SIZE, 500);
-            close(fds[0]);
-        }
-    } else if (wlr_offer) {
-        int fds[2];
-        if (pipe2(fds, O_CLOEXEC) != -1) {
-            zwlr_data_control_offer_v1_receive(wlr_offer, "text/plain;charset=utf-8", fds[1]);
-            wl_display_flush(wl_dpy);
-            close(fds[1]);
-            sel = read_fd_with_timeout(fds[0], &len, MAX_SELECTION_SIZE, 500);
-            close(fds[0]);
-        }
-    } else if (ps_offer) {
-        sel = read_ps_offer(ps_offer, &len);
+    if (lazy_primary) {
+        /* Every event is announced (no content to dedupe against), with
+           an empty primary file so file readers never see stale text. */
+        pending_ext_offer = ext_offer;
+        pending_wlr_offer = wlr_offer;
+        pending_ps_offer = ps_offer;
+        pending_mime = mime;
+        primary_pending = true;
+        free(last_known_content);
+        last_known_content = NULL;
+        last_known_len = 0;
+        seq_counter++;
+        write_primary("", 0, seq_counter);
+        return;
     }
 
+    if (splice_primary && splice_primary_update(ext_offer, wlr_offer, ps_offer, mime))
+        return;
+
+    long long start = monotonic_us();
+    size_t len = 0;
+    uint64_t h = 0;
+    char *sel = receive_primary_offer(ext_offer, wlr_offer, ps_offer, mime,
+                                      &len, &h, true);
+    if (!sel) len = 0;
+    if (len == 0) h = 0;
+    trace_record(TRACE_READ, mime, sel, len, h, monotonic_us() - start);
+
     /* Only update cache if content actually changed. */
-    bool changed = false;
-    if (!sel && last_known_content)
-        changed = true;
-    else if (sel && !last_known_content)
-        changed = true;
-    else if (sel && last_known_content)
-        changed = (len != last_known_len || memcmp(sel, last_known_content, len) != 0);
-
-    if (changed) {
+    if (len != last_known_len || h != last_known_hash) {
         seq_counter++;
-        write_primary(sel ? sel : "", sel ? len : 0, seq_counter);
-        free(last_known_content);
-        if (sel && len > 0) {
-            /* Transfer ownership — avoids redundant malloc+memcpy. */
-            last_known_content = sel;
-            last_known_len = len;
-            sel = NULL;
-        } else {
-            last_known_content = NULL;
-            last_known_len = 0;
-        }
+        write_primary(sel ? sel : "", len, seq_counter);
+        hist_record(sel, len);
+        last_known_len = len;
+        last_known_hash = h;
+    }
+    scratch_free(sel);
+}
+
+/* update_primary_cache(), timed as one selection event for the metrics. */
+static void process_primary_update(
+        struct ext_data_control_offer_v1 *ext_offer,
+        struct zwlr_data_control_offer_v1 *wlr_offer,
+        struct zwp_primary_selection_offer_v1 *ps_offer,
+        const char *mime) {
+    long long start = monotonic_us();
+    update_primary_cache(ext_offer, wlr_offer, ps_offer, mime);
+    if (!is_daemon_mode) return;
+    met_events++;
+    met_record(&met_event, monotonic_us() - start);
+}
+
+/* Entry point of the selection listeners: process_primary_update() at once,
+   or remember the offer for the coalescing window. */
+static void queue_primary_update(
+        struct ext_data_control_offer_v1 *ext_offer,
+        struct zwlr_data_control_offer_v1 *wlr_offer,
+        struct zwp_primary_selection_offer_v1 *ps_offer,
+        const char *mime) {
+    if (is_daemon_mode)
+        trace_record(TRACE_NOTIFY, mime, NULL, 0, 0, 0);
+    if (!coalesce_us || !is_daemon_mode) {
+        process_primary_update(ext_offer, wlr_offer, ps_offer, mime);
+        return;
     }
-    free(sel);
+    coalesce_ext_offer = ext_offer;
+    coalesce_wlr_offer = wlr_offer;
+    coalesce_ps_offer = ps_offer;
+    coalesce_mime = mime;
+    if (!coalesce_due_us)
+        coalesce_due_us = monotonic_us() + coalesce_us;
+}
+
+/* Process the coalesced event once its deadline has passed, or at once
+   with force (the shell is asking for PRIMARY).  Returns true if one was
+   pending and processed. */
+static bool flush_primary_update(bool force) {
+    if (!coalesce_due_us || (!force && monotonic_us() < coalesce_due_us))
+        return false;
+    coalesce_due_us = 0;
+    process_primary_update(coalesce_ext_offer, coalesce_wlr_offer,
+                           coalesce_ps_offer, coalesce_mime);
+    return true;
 }
 
-/* Offer listener — tracks whether the data-control offer has text MIME. */
+/* Lazy mode: receive the pending offer into last_known_content.  Called by
+ * the socket PRIMARY verb; the seq file is not touched again because the
+ * event was already announced when the offer arrived. */
+static void materialize_primary(void) {
+    if (!primary_pending) return;
+    primary_pending = false;
+
+    size_t len = 0;
+    char *sel = receive_primary_offer(pending_ext_offer, pending_wlr_offer,
+                                      pending_ps_offer, pending_mime,
+                                      &len, NULL, false);
+    free(last_known_content);
+    last_known_content = NULL;
+    last_known_len = 0;
+    if (sel && len > 0) {
+        hist_record(sel, len);
+        last_known_content = sel;
+        last_known_len = len;
+    } else {
+        free(sel);
+    }
+}
+
+/* Offer listener — keeps the best text MIME the data-control offer has. */
 static void dc_offer_handle_offer_wlr(void *data,
         struct zwlr_data_control_offer_v1 *offer, const char *mime_type) {
     (void)data; (void)offer;
-    if (strcmp(mime_type, "text/plain;charset=utf-8") == 0 ||
-        strcmp(mime_type, "text/plain") == 0)
-        dc_clip_has_text = true;
+    offer_text_mime(&dc_clip_mime, mime_type);
 }
 
 static const struct zwlr_data_control_offer_v1_listener dc_offer_listener_wlr = {
@@ -470,9 +627,7 @@ static const struct zwlr_data_control_offer_v1_listener dc_offer_listener_wlr =
 static void dc_offer_handle_offer_ext(void *data,
         struct ext_data_control_offer_v1 *offer, const char *mime_type) {
     (void)data; (void)offer;
-    if (strcmp(mime_type, "text/plain;charset=utf-8") == 0 ||
-        strcmp(mime_type, "text/plain") == 0)
-        dc_clip_has_text = true;
+    offer_text_mime(&dc_clip_mime, mime_type);
 }
 
 static const struct ext_data_control_offer_v1_listener dc_offer_listener_ext = {
@@ -486,7 +641,7 @@ static void dc_device_data_offer_wlr(void *data,
         struct zwlr_data_control_device_v1 *dev,
         struct zwlr_data_control_offer_v1 *offer) {
     (void)data; (void)dev;
-    dc_clip_has_text = false;
+    dc_clip_mime = NULL;
     zwlr_data_control_offer_v1_add_listener(offer, &dc_offer_listener_wlr, NULL);
 }
 
@@ -497,7 +652,7 @@ static void dc_device_selection_wlr(void *data,
     if (dc_clipboard_offer && dc_clipboard_offer != offer)
         zwlr_data_control_offer_v1_destroy(dc_clipboard_offer);
     dc_clipboard_offer = offer;
-    dc_clip_has_text_sel = dc_clip_has_text;
+    dc_clip_mime_sel = dc_clip_mime;
     dc_got_selection = true;
 }
 
@@ -513,9 +668,9 @@ static void dc_device_primary_selection_wlr(void *data,
     if (dc_primary_offer && dc_primary_offer != offer)
         zwlr_data_control_offer_v1_destroy(dc_primary_offer);
     dc_primary_offer = offer;
-    dc_primary_has_text_sel = dc_clip_has_text;
+    dc_primary_mime_sel = dc_clip_mime;
 
-    process_primary_update(NULL, offer, NULL, dc_primary_has_text_sel);
+    queue_primary_update(NULL, offer, NULL, dc_primary_mime_sel);
 }
 
 static const struct zwlr_data_control_device_v1_listener dc_device_listener_wlr = {
@@ -530,7 +685,7 @@ static void dc_device_data_offer_ext(void *data,
         struct ext_data_control_device_v1 *dev,
         struct ext_data_control_offer_v1 *offer) {
     (void)data; (void)dev;
-    dc_clip_has_text = false;
+    dc_clip_mime = NULL;
     ext_data_control_offer_v1_add_listener(offer, &dc_offer_listener_ext, NULL);
 }
 
@@ -541,7 +696,7 @@ static void dc_device_selection_ext(void *data,
     if (dc_clipboard_offer && dc_clipboard_offer != offer)
         ext_data_control_offer_v1_destroy(dc_clipboard_offer);
     dc_clipboard_offer = offer;
-    dc_clip_has_text_sel = dc_clip_has_text;
+    dc_clip_mime_sel = dc_clip_mime;
     dc_got_selection = true;
 }
 
@@ -557,9 +712,9 @@ static void dc_device_primary_selection_ext(void *data,
     if (dc_primary_offer && dc_primary_offer != offer)
         ext_data_control_offer_v1_destroy(dc_primary_offer);
     dc_primary_offer = offer;
-    dc_primary_has_text_sel = dc_clip_has_text;
+    dc_primary_mime_sel = dc_clip_mime;
 
-    process_primary_update(offer, NULL, NULL, dc_primary_has_text_sel);
+    queue_primary_update(offer, NULL, NULL, dc_primary_mime_sel);
 }
 
 static const struct ext_data_control_device_v1_listener dc_device_listener_ext = {
@@ -570,9 +725,10 @@ static const struct ext_data_control_device_v1_listener dc_device_listener_ext =
 };
 
 /* Read text from a data-control clipboard offer (either wlr or ext).
- * Same pipe protocol as read_clip_offer(). */
+ * Same pipe protocol as read_clip_offer(); the daemon reads into its
+ * arena, so release the result with scratch_free(). */
 static char *read_dc_clip_offer(size_t *out_len) {
-    if (!dc_clipboard_offer || !dc_clip_has_text_sel) {
+    if (!dc_clipboard_offer || !dc_clip_mime_sel) {
         *out_len = 0;
         return NULL;
     }
@@ -580,13 +736,14 @@ static char *read_dc_clip_offer(size_t *out_len) {
     if (pipe2(fds, O_CLOEXEC) == -1) return NULL;
     if (dc_use_ext)
         ext_data_control_offer_v1_receive(dc_clipboard_offer,
-            "text/plain;charset=utf-8", fds[1]);
+            dc_clip_mime_sel, fds[1]);
     else
         zwlr_data_control_offer_v1_receive(dc_clipboard_offer,
-            "text/plain;charset=utf-8", fds[1]);
+            dc_clip_mime_sel, fds[1]);
     wl_display_flush(wl_dpy);
     close(fds[1]);
-    char *data = read_fd_with_timeout(fds[0], out_len, MAX_CLIPBOARD_SIZE, 500);
+    char *data = read_fd_with_timeout(fds[0], out_len, MAX_CLIPBOARD_SIZE, 500,
+                                      NULL, is_daemon_mode);
     close(fds[0]);
     return data;
 }
@@ -612,6 +769,12 @@ static void dc_source_send_wlr(void *data,
 static void dc_source_cancelled_wlr(void *data,
         struct zwlr_data_control_source_v1 *src) {
     (void)data;
+    if (is_daemon_mode && src == dc_daemon_source) {
+        dc_daemon_source = NULL;
+        free(copy_data);
+        copy_data = NULL;
+        copy_data_len = 0;
+    }
     zwlr_data_control_source_v1_destroy(src);
     copy_done = true;
 }
@@ -640,6 +803,12 @@ static void dc_source_send_ext(void *data,
 static void dc_source_cancelled_ext(void *data,
         struct ext_data_control_source_v1 *src) {
     (void)data;
+    if (is_daemon_mode && src == dc_daemon_source) {
+        dc_daemon_source = NULL;
+        free(copy_data);
+        copy_data = NULL;
+        copy_data_len = 0;
+    }
     ext_data_control_source_v1_destroy(src);
     copy_done = true;
 }
@@ -703,17 +872,13 @@ static const struct wl_keyboard_listener keyboard_listener = {
 /* Called once per MIME type advertised by the selection owner.
  * Multiple type aliases for plain text exist across GUI toolkits;
  * accepting any of them ensures compatibilty with terminals, browsers,
- * and legacy X11 applications running via XWayland. */
+ * and legacy X11 applications running via XWayland.  The best one is
+ * the type requested later by read_ps_offer(). */
 static void ps_offer_handle_offer(void *data,
         struct zwp_primary_selection_offer_v1 *offer,
         const char *mime_type) {
     (void)data; (void)offer;
-    if (strcmp(mime_type, "text/plain;charset=utf-8") == 0 ||
-        strcmp(mime_type, "text/plain") == 0 ||
-        strcmp(mime_type, "UTF8_STRING") == 0 ||
-        strcmp(mime_type, "TEXT") == 0 ||
-        strcmp(mime_type, "STRING") == 0)
-        ps_has_text = true;
+    offer_text_mime(&ps_text_mime, mime_type);
 }
 
 /* Listener table for individual PRIMARY selection offers.  One instance
@@ -726,10 +891,10 @@ static void ps_device_handle_data_offer(void *data,
         struct zwp_primary_selection_device_v1 *dev,
         struct zwp_primary_selection_offer_v1 *offer) {
     (void)data; (void)dev;
-    /* Reset ps_has_text before adding the listener: the new offer
+    /* Reset ps_text_mime before adding the listener: the new offer
        advertises its types via subsequent ps_offer_handle_offer calls,
        so any leftover state from the previous offer must be cleared first. */
-    ps_has_text = false;
+    ps_text_mime = NULL;
     zwp_primary_selection_offer_v1_add_listener(offer, &ps_offer_listener, NULL);
 }
 
@@ -741,7 +906,7 @@ static void ps_device_handle_selection(void *data,
         zwp_primary_selection_offer_v1_destroy(current_ps_offer);
     current_ps_offer = offer;
 
-    process_primary_update(NULL, NULL, offer, ps_has_text);
+    queue_primary_update(NULL, NULL, offer, ps_text_mime);
 }
 
 /* Listener table for the PRIMARY selection device.
@@ -755,16 +920,12 @@ static const struct zwp_primary_selection_device_v1_listener ps_device_listener
 
 /* ===== CLIPBOARD (wl_data_device) LISTENERS ======================= */
 
-/* Mirror of ps_offer_handle_offer for clipboard offers.
- * Clipboard applications tend to advertise both UTF-8 and plain text;
- * matching either is sufficient — we always request text/plain;charset=utf-8
- * from read_clip_offer() regardless of which type triggered the flag. */
+/* Mirror of ps_offer_handle_offer for clipboard offers; read_clip_offer()
+ * then requests exactly the type chosen here. */
 static void clip_offer_handle_offer(void *data, struct wl_data_offer *offer,
                                      const char *mime_type) {
     (void)data; (void)offer;
-    if (strcmp(mime_type, "text/plain;charset=utf-8") == 0 ||
-        strcmp(mime_type, "text/plain") == 0)
-        clip_has_text = true;
+    offer_text_mime(&clip_text_mime, mime_type);
 }
 
 /* Listener for clipboard (wl_data_offer) type advertisements. */
@@ -775,9 +936,9 @@ static const struct wl_data_offer_listener clip_offer_listener = {
 static void dd_handle_data_offer(void *data, struct wl_data_device *dev,
                                   struct wl_data_offer *offer) {
     (void)data; (void)dev;
-    /* Reset clip_has_text: the new clipboard offer will populate it via
+    /* Reset clip_text_mime: the new clipboard offer will populate it via
        the clip_offer_listener below before dd_handle_selection fires. */
-    clip_has_text = false;
+    clip_text_mime = NULL;
     wl_data_offer_add_listener(offer, &clip_offer_listener, NULL);
 }
 
@@ -928,41 +1089,95 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = {
 
 /* ===== REGISTRY =================================================== */
 
-/* Bind Wayland globals as they are advertised.
- * Version caps are applied to avoid using features not yet supported:
- * wl_compositor capped at 4 (damage_buffer, preferred_buffer_scale),
- * wl_data_device_manager capped at 3 (wl_surface.set_selection).
- * Data-control protocols: prefer ext-data-control-v1 over wlr when both
- * are advertised (ext is the standardized successor). */
+/* Registry snapshot: the name and version of every global this agent can
+ * use, recorded by the roundtrip in wayland_connect().  Nothing is bound
+ * while the snapshot is taken; each mode binds only the globals it needs
+ * through wayland_bind(), so a one-shot creates no proxies (and the
+ * compositor no resources) for protocols it never touches.  The surface
+ * globals are bound only on the Mutter focus-surface fallback paths. */
+enum {
+    G_SEAT, G_PS_MANAGER, G_DDM, G_COMPOSITOR, G_XDG_WM_BASE, G_SHM,
+    G_EXT_DCM, G_WLR_DCM, G_COUNT
+};
+#define BIND_SEAT    (1u << G_SEAT)
+#define BIND_PS      (1u << G_PS_MANAGER)
+#define BIND_DDM     (1u << G_DDM)
+#define BIND_SURFACE ((1u << G_COMPOSITOR) | (1u << G_XDG_WM_BASE) | (1u << G_SHM))
+#define BIND_DC      ((1u << G_EXT_DCM) | (1u << G_WLR_DCM))
+#define BIND_ALL     ((1u << G_COUNT) - 1)
+
+static const char *const global_iface[G_COUNT] = {
+    [G_SEAT]        = "wl_seat",
+    [G_PS_MANAGER]  = "zwp_primary_selection_device_manager_v1",
+    [G_DDM]         = "wl_data_device_manager",
+    [G_COMPOSITOR]  = "wl_compositor",
+    [G_XDG_WM_BASE] = "xdg_wm_base",
+    [G_SHM]         = "wl_shm",
+    [G_EXT_DCM]     = "ext_data_control_manager_v1",
+    [G_WLR_DCM]     = "zwlr_data_control_manager_v1",
+};
+/* global_version[g] == 0: not advertised (versions start at 1). */
+static uint32_t global_name[G_COUNT];
+static uint32_t global_version[G_COUNT];
+
+/* Record a global in the snapshot as it is advertised. */
 static void registry_handle_global(void *data, struct wl_registry *reg,
                                     uint32_t name, const char *interface,
                                     uint32_t version) {
-    (void)data; (void)version;
-    if (strcmp(interface, "wl_seat") == 0) {
-        wl_seat_obj = wl_registry_bind(reg, name, &wl_seat_interface, 2);
-    } else if (strcmp(interface,
-                "zwp_primary_selection_device_manager_v1") == 0) {
-        ps_manager = wl_registry_bind(reg, name,
+    (void)data; (void)reg;
+    for (unsigned int g = 0; g < G_COUNT; g++) {
+        if (strcmp(interface, global_iface[g]) == 0) {
+            global_name[g] = name;
+            global_version[g] = version;
+            return;
+        }
+    }
+}
+
+/* True when global g is selected by mask and was advertised. */
+static bool global_wanted(unsigned int mask, unsigned int g) {
+    return (mask & (1u << g)) && global_version[g] != 0;
+}
+
+/* Bind the snapshot globals selected by mask that are not bound yet.
+ * Version caps are applied to avoid using features not yet supported:
+ * wl_compositor capped at 4 (damage_buffer, preferred_buffer_scale),
+ * wl_data_device_manager capped at 3 (wl_surface.set_selection).
+ * Data-control protocols: wlr is bound only when ext-data-control-v1 is
+ * not advertised (ext is the standardized successor). */
+static void wayland_bind(unsigned int mask) {
+    uint32_t v;
+    if (!wl_seat_obj && global_wanted(mask, G_SEAT))
+        wl_seat_obj = wl_registry_bind(wl_reg, global_name[G_SEAT],
+            &wl_seat_interface, 2);
+    if (!ps_manager && global_wanted(mask, G_PS_MANAGER))
+        ps_manager = wl_registry_bind(wl_reg, global_name[G_PS_MANAGER],
             &zwp_primary_selection_device_manager_v1_interface, 1);
-    } else if (strcmp(interface, "wl_data_device_manager") == 0) {
-        wl_ddm = wl_registry_bind(reg, name,
-            &wl_data_device_manager_interface,
-            version < 3 ? version : 3);
-    } else if (strcmp(interface, "wl_compositor") == 0) {
-        wl_comp = wl_registry_bind(reg, name, &wl_compositor_interface,
-                                    version < 4 ? version : 4);
-    } else if (strcmp(interface, "xdg_wm_base") == 0) {
-        xdg_wmbase = wl_registry_bind(reg, name, &xdg_wm_base_interface, 1);
+    if (!wl_ddm && global_wanted(mask, G_DDM)) {
+        v = global_version[G_DDM];
+        wl_ddm = wl_registry_bind(wl_reg, global_name[G_DDM],
+            &wl_data_device_manager_interface, v < 3 ? v : 3);
+    }
+    if (!wl_comp && global_wanted(mask, G_COMPOSITOR)) {
+        v = global_version[G_COMPOSITOR];
+        wl_comp = wl_registry_bind(wl_reg, global_name[G_COMPOSITOR],
+            &wl_compositor_interface, v < 4 ? v : 4);
+    }
+    if (!xdg_wmbase && global_wanted(mask, G_XDG_WM_BASE)) {
+        xdg_wmbase = wl_registry_bind(wl_reg, global_name[G_XDG_WM_BASE],
+            &xdg_wm_base_interface, 1);
         xdg_wm_base_add_listener(xdg_wmbase, &xdg_wm_base_listener, NULL);
-    } else if (strcmp(interface, "wl_shm") == 0) {
-        wl_shm_obj = wl_registry_bind(reg, name, &wl_shm_interface, 1);
-    } else if (strcmp(interface, "ext_data_control_manager_v1") == 0) {
-        ext_dcm = wl_registry_bind(reg, name,
+    }
+    if (!wl_shm_obj && global_wanted(mask, G_SHM))
+        wl_shm_obj = wl_registry_bind(wl_reg, global_name[G_SHM],
+            &wl_shm_interface, 1);
+    if (!ext_dcm && global_wanted(mask, G_EXT_DCM))
+        ext_dcm = wl_registry_bind(wl_reg, global_name[G_EXT_DCM],
             &ext_data_control_manager_v1_interface, 1);
-    } else if (strcmp(interface, "zwlr_data_control_manager_v1") == 0) {
-        wlr_dcm = wl_registry_bind(reg, name,
-            &zwlr_data_control_manager_v1_interface,
-            version < 2 ? version : 2);
+    if (!ext_dcm && !wlr_dcm && global_wanted(mask, G_WLR_DCM)) {
+        v = global_version[G_WLR_DCM];
+        wlr_dcm = wl_registry_bind(wl_reg, global_name[G_WLR_DCM],
+            &zwlr_data_control_manager_v1_interface, v < 2 ? v : 2);
     }
 }
 
@@ -973,7 +1188,7 @@ static void registry_handle_global_remove(void *data, struct wl_registry *reg,
     (void)data;(void)reg;(void)name;
 }
 
-/* Registry listener — discovers globals at startup via global callbacks
+/* Registry listener — snapshots globals at startup via global callbacks
    and ignores subsequent hot-plug events via the no-op global_remove. */
 static const struct wl_registry_listener registry_listener = {
     .global = registry_handle_global,
@@ -982,10 +1197,11 @@ static const struct wl_registry_listener registry_listener = {
 
 /* ===== HELPERS ==================================================== */
 
-/* Open the Wayland display connection and trigger the first registry
- * roundtrip to populate all global object pointers before any mode
- * function is called. */
-static int wayland_connect(void) {
+/* Open the Wayland display connection, take the registry snapshot with
+ * one roundtrip, and bind the globals selected by mask (BIND_*) before
+ * the mode function uses them.  More can be bound later with
+ * wayland_bind(). */
+static int wayland_connect(unsigned int mask) {
     wl_dpy = wl_display_connect(NULL);
     if (!wl_dpy) {
         fprintf(stderr, "Cannot connect to Wayland display\n");
@@ -994,6 +1210,7 @@ static int wayland_connect(void) {
     wl_reg = wl_display_get_registry(wl_dpy);
     wl_registry_add_listener(wl_reg, &registry_listener, NULL);
     wl_display_roundtrip(wl_dpy);
+    wayland_bind(mask);
     return 0;
 }
 
@@ -1137,7 +1354,22 @@ static void destroy_focus_surface(struct wl_surface *surface,
    The surface is transparent and exists for only a few milliseconds. */
 
 static int run_oneshot(const char *cache_dir_arg) {
-    if (wayland_connect() != 0) return 1;
+    /* A live daemon with data-control answers from its cache, with no
+       compositor connection here.  Without data-control (Mutter) its
+       cache can miss PRIMARY changes, so it answers ERR and the focus
+       surface below is used instead. */
+    {
+        char *data = NULL;
+        size_t len = 0;
+        if (resolve_cache_dir(cache_dir_arg) == 0 &&
+            sock_client_request("PRIMARY", NULL, 0, &data, &len) == 0) {
+            if (len > 0) fwrite(data, 1, len, stdout);
+            free(data);
+            return 0;
+        }
+    }
+
+    if (wayland_connect(BIND_SEAT | BIND_PS) != 0) return 1;
     if (!ps_manager || !wl_seat_obj) {
         fprintf(stderr, "Compositor missing primary-selection or seat\n");
         wayland_disconnect();
@@ -1157,6 +1389,8 @@ static int run_oneshot(const char *cache_dir_arg) {
     /* If we didn't get the selection event (Mutter), create a popup
        surface to gain keyboard focus, then dispatch events until
        the selection event arrives or we time out. */
+    if (!got_selection)
+        wayland_bind(BIND_SURFACE);
     if (!got_selection && wl_comp && xdg_wmbase && wl_shm_obj) {
         create_daemon_surface();
         wl_display_roundtrip(wl_dpy);
@@ -1186,9 +1420,9 @@ static int run_oneshot(const char *cache_dir_arg) {
             have_cache = 1;
     }
 
-    if (current_ps_offer && ps_has_text) {
+    if (current_ps_offer && ps_text_mime) {
         size_t len = 0;
-        char *data = read_ps_offer(current_ps_offer, &len);
+        char *data = read_ps_offer(current_ps_offer, ps_text_mime, &len);
         if (data && len > 0) {
             fwrite(data, 1, len, stdout);
             /* Update cache so daemon-based detection stays in sync on
@@ -1213,12 +1447,24 @@ static int run_oneshot(const char *cache_dir_arg) {
 /* ===== MODE: --get-clipboard ====================================== */
 
 /* Print clipboard text to stdout and exit.
- * Three mechanisms attempted — devices are bound in a single batch
- * before one shared roundtrip to minimise Wayland IPC latency:
+ * A live daemon is asked first (GET); it answers when it owns the
+ * clipboard or holds a data-control offer.  Otherwise two mechanisms are
+ * attempted — devices are bound in a single batch before one shared
+ * roundtrip to minimise Wayland IPC latency:
  *   1. wl_data_device + data-control (batched roundtrip)
  *   2. Focus surface (Mechanism C) — GNOME < 47 fallback */
-static int run_get_clipboard(void) {
-    if (wayland_connect() != 0) return 1;
+static int run_get_clipboard(const char *cache_dir_arg) {
+    if (resolve_cache_dir(cache_dir_arg) == 0) {
+        char *reply = NULL;
+        size_t reply_len = 0;
+        if (sock_client_request("GET", NULL, 0, &reply, &reply_len) == 0) {
+            if (reply_len > 0) fwrite(reply, 1, reply_len, stdout);
+            free(reply);
+            return 0;
+        }
+    }
+
+    if (wayland_connect(BIND_SEAT | BIND_DDM | BIND_DC) != 0) return 1;
     if (!wl_seat_obj) {
         wayland_disconnect();
         return 1;
@@ -1238,8 +1484,8 @@ static int run_get_clipboard(void) {
     if (ext_dcm) {
         dc_use_ext = true;
         dc_clipboard_offer = NULL;
-        dc_clip_has_text = false;
-        dc_clip_has_text_sel = false;
+        dc_clip_mime = NULL;
+        dc_clip_mime_sel = NULL;
         dc_got_selection = false;
         ext_dc_dev = ext_data_control_manager_v1_get_data_device(
             ext_dcm, wl_seat_obj);
@@ -1248,8 +1494,8 @@ static int run_get_clipboard(void) {
     } else if (wlr_dcm) {
         dc_use_ext = false;
         dc_clipboard_offer = NULL;
-        dc_clip_has_text = false;
-        dc_clip_has_text_sel = false;
+        dc_clip_mime = NULL;
+        dc_clip_mime_sel = NULL;
         dc_got_selection = false;
         wlr_dc_dev = zwlr_data_control_manager_v1_get_data_device(
             wlr_dcm, wl_seat_obj);
@@ -1261,8 +1507,8 @@ static int run_get_clipboard(void) {
     wl_display_roundtrip(wl_dpy);
 
     /* Check wl_data_device result first (cheapest path). */
-    if (current_clipboard_offer && clip_has_text) {
-        data = read_clip_offer(current_clipboard_offer, &len);
+    if (current_clipboard_offer && clip_text_mime) {
+        data = read_clip_offer(current_clipboard_offer, clip_text_mime, &len);
         if (data && len > 0) {
             fwrite(data, 1, len, stdout);
             free(data);
@@ -1276,7 +1522,7 @@ static int run_get_clipboard(void) {
     }
 
     /* Check data-control result (works on wlroots/KDE/GNOME 47+). */
-    if (dc_clipboard_offer && dc_clip_has_text_sel) {
+    if (dc_clipboard_offer && dc_clip_mime_sel) {
         data = read_dc_clip_offer(&len);
         if (data && len > 0) {
             fwrite(data, 1, len, stdout);
@@ -1300,6 +1546,7 @@ static int run_get_clipboard(void) {
      * got_clip_selection (set by dd_handle_selection) rather than on
      * current_clipboard_offer, so an empty clipboard exits immediately
      * instead of hanging forever. */
+    wayland_bind(BIND_SURFACE);
     if (wl_comp && xdg_wmbase && wl_shm_obj && wl_ddm) {
         struct wl_surface *focus_surf = NULL;
         struct xdg_surface *focus_xdg_surf = NULL;
@@ -1317,7 +1564,7 @@ static int run_get_clipboard(void) {
             wl_data_offer_destroy(current_clipboard_offer);
             current_clipboard_offer = NULL;
         }
-        clip_has_text = false;
+        clip_text_mime = NULL;
         got_clip_selection = false;
 
         if (create_focus_surface(&focus_surf, &focus_xdg_surf,
@@ -1353,8 +1600,8 @@ static int run_get_clipboard(void) {
                 if (wl_display_get_error(wl_dpy) != 0) break;
             }
 
-            if (current_clipboard_offer && clip_has_text) {
-                data = read_clip_offer(current_clipboard_offer, &len);
+            if (current_clipboard_offer && clip_text_mime) {
+                data = read_clip_offer(current_clipboard_offer, clip_text_mime, &len);
                 if (data && len > 0)
                     fwrite(data, 1, len, stdout);
                 free(data);
@@ -1371,29 +1618,6 @@ static int run_get_clipboard(void) {
 
 /* ===== MODE: --copy-clipboard ===================================== */
 
-/* read_all_stdin: drain stdin into a malloc'd buffer and return it.
- * The buffer is grown exponentially; capped by MAX_CLIPBOARD_SIZE. */
-static char *read_all_stdin(size_t *out_len) {
-    size_t capacity = 4096, total = 0;
-    char *buf = malloc(capacity);
-    if (!buf) return NULL;
-
-    while (1) {
-        if (total + 4096 > capacity) {
-            capacity *= 2;
-            if (capacity > MAX_CLIPBOARD_SIZE) break;
-            char *nb = realloc(buf, capacity);
-            if (!nb) { free(buf); *out_len = 0; return NULL; }
-            buf = nb;
-        }
-        ssize_t n = read(STDIN_FILENO, buf + total, 4096);
-        if (n > 0) total += n;
-        else break;
-    }
-    *out_len = total;
-    return buf;
-}
-
 /* Take ownership of the Wayland clipboard and serve paste requests.
  * Three mechanisms attempted in order:
  *   1. OSC 52 write to /dev/tty — fire-and-forget; single write()
@@ -1406,11 +1630,15 @@ static char *read_all_stdin(size_t *out_len) {
  * to avoid creating redundant protocol objects and a source-cancellation
  * race between the two clipboard sources.
  *
- * Forks immediately so the shell is not blocked: the parent exits at
- * once; the child runs a background event loop alive until some other
+ * When a daemon is listening on the cache directory's socket, steps 2
+ * and 3 are replaced by a SET request: the daemon's data-control source
+ * serves the text over its existing connection and nothing is forked.
+ *
+ * Otherwise forks immediately so the shell is not blocked: the parent exits
+ * at once; the child runs a background event loop alive until some other
  * client calls set_selection (signalled via cancelled callback) or the
  * process is sent SIGTERM. */
-static int run_copy_clipboard(void) {
+static int run_copy_clipboard(const char *cache_dir_arg) {
     copy_data = read_all_stdin(&copy_data_len);
     if (!copy_data || copy_data_len == 0) {
         free(copy_data);
@@ -1420,7 +1648,17 @@ static int run_copy_clipboard(void) {
     /* Step 1: OSC 52 write — fire-and-forget; single write(); no waiting */
     osc52_write(copy_data, copy_data_len);
 
-    if (wayland_connect() != 0) { free(copy_data); return 1; }
+    if (resolve_cache_dir(cache_dir_arg) == 0 &&
+        sock_client_request("SET", copy_data, copy_data_len, NULL, NULL) == 0) {
+        free(copy_data);
+        copy_data = NULL;
+        return 0;
+    }
+
+    if (wayland_connect(BIND_SEAT | BIND_DC | BIND_DDM) != 0) {
+        free(copy_data);
+        return 1;
+    }
     if (!wl_seat_obj) {
         free(copy_data); wayland_disconnect(); return 1;
     }
@@ -1480,6 +1718,7 @@ static int run_copy_clipboard(void) {
         wl_data_source_add_listener(copy_source, &ds_listener, NULL);
 
         /* GNOME fallback — acquire keyboard focus for a valid serial. */
+        wayland_bind(BIND_SURFACE);
         if (wl_comp && xdg_wmbase && wl_shm_obj) {
             struct wl_surface *focus_surf = NULL;
             struct xdg_surface *focus_xdg_surf = NULL;
@@ -1603,8 +1842,14 @@ static int run_copy_clipboard(void) {
 
 /* ===== MODE: --clear-primary ====================================== */
 
-static int run_clear_primary(void) {
-    if (wayland_connect() != 0) return 1;
+/* A live daemon clears PRIMARY through the device it already holds
+   (CLEAR); otherwise a short connection does it here. */
+static int run_clear_primary(const char *cache_dir_arg) {
+    if (resolve_cache_dir(cache_dir_arg) == 0 &&
+        sock_client_request("CLEAR", NULL, 0, NULL, NULL) == 0)
+        return 0;
+
+    if (wayland_connect(BIND_SEAT | BIND_PS) != 0) return 1;
     if (!ps_manager || !wl_seat_obj) {
         wayland_disconnect();
         return 1;
@@ -1686,13 +1931,170 @@ static int create_daemon_surface(void) {
     return 0;
 }
 
+/* ------------------------------------------------------------------ */
+/*  Daemon socket API                                                 */
+/* ------------------------------------------------------------------ */
+/* The daemon listens on SOCK_FILE so the shell can read and write the
+ * clipboard over the daemon's existing Wayland connection instead of
+ * fork+exec'ing this binary (and re-connecting, re-binding the data-control
+ * globals) per paste.
+ * One request per connection:
+ *   request:   "<VERB> <len>\n" followed by <len> payload bytes
+ *   response:  "OK <len>\n" followed by <len> payload bytes, or "ERR\n"
+ * Verbs: GET (clipboard text), SET (own CLIPBOARD with the payload),
+ *        CLEAR (clear PRIMARY), HIST (payload "k": history entry k,
+ *        0 = newest; ERR when out of range), PRIMARY (PRIMARY text,
+ *        received on demand in lazy mode), OSC52 (payload
+ *        "<frame>\n<text>": the OSC 52 sequence for the shell's tty). */
+
+/* Take the clipboard with a data-control source owned by the daemon and
+   served from copy_data until the source is cancelled.  Only available
+   when data-control is present — wl_data_device needs a keyboard serial
+   that the unfocused daemon surface never receives.  On success the
+   buffer is adopted (the previous one is freed); on failure the caller's
+   buffer is freed. */
+static bool daemon_set_clipboard(char *data, size_t len) {
+    if (ext_dc_daemon_dev) {
+        struct ext_data_control_source_v1 *src =
+            ext_data_control_manager_v1_create_data_source(ext_dcm);
+        ext_data_control_source_v1_offer(src, "text/plain;charset=utf-8");
+        ext_data_control_source_v1_offer(src, "text/plain");
+        ext_data_control_source_v1_offer(src, "UTF8_STRING");
+        ext_data_control_source_v1_offer(src, "STRING");
+        ext_data_control_source_v1_add_listener(src,
+            &dc_source_listener_ext, NULL);
+        ext_data_control_device_v1_set_selection(ext_dc_daemon_dev, src);
+        dc_daemon_source = src;
+    } else if (wlr_dc_daemon_dev) {
+        struct zwlr_data_control_source_v1 *src =
+            zwlr_data_control_manager_v1_create_data_source(wlr_dcm);
+        zwlr_data_control_source_v1_offer(src, "text/plain;charset=utf-8");
+        zwlr_data_control_source_v1_offer(src, "text/plain");
+        zwlr_data_control_source_v1_offer(src, "UTF8_STRING");
+        zwlr_data_control_source_v1_offer(src, "STRING");
+        zwlr_data_control_source_v1_add_listener(src,
+            &dc_source_listener_wlr, NULL);
+        zwlr_data_control_device_v1_set_selection(wlr_dc_daemon_dev, src);
+        dc_daemon_source = src;
+    } else {
+        free(data);
+        return false;
+    }
+    /* The previous source (if any) is cancelled by the compositor; its
+       handler only destroys it because dc_daemon_source has moved on. */
+    wl_display_flush(wl_dpy);
+    free(copy_data);
+    copy_data = data;
+    copy_data_len = len;
+    return true;
+}
+
+/* Clear PRIMARY through whichever device the daemon is bound to. */
+static void daemon_clear_primary(void) {
+    if (ext_dc_daemon_dev) {
+        ext_data_control_device_v1_set_primary_selection(ext_dc_daemon_dev, NULL);
+    } else if (wlr_dc_daemon_dev) {
+        if (zwlr_data_control_device_v1_get_version(wlr_dc_daemon_dev) >=
+            ZWLR_DATA_CONTROL_DEVICE_V1_SET_PRIMARY_SELECTION_SINCE_VERSION)
+            zwlr_data_control_device_v1_set_primary_selection(wlr_dc_daemon_dev, NULL);
+    } else if (ps_device) {
+        zwp_primary_selection_device_v1_set_selection(ps_device, NULL, 0);
+    }
+    wl_display_flush(wl_dpy);
+}
+
+/* Accept one client on the listening socket and serve its request. */
+static void handle_sock_request(int listen_fd) {
+    int cfd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (cfd < 0) return;
+
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 500000 };
+    setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    char verb[16];
+    char *payload = NULL;
+    size_t payload_len = 0;
+    if (sock_read_request(cfd, verb, sizeof(verb), &payload, &payload_len) != 0) {
+        sock_reply(cfd, false, NULL, 0);
+        close(cfd);
+        return;
+    }
+
+    if (strcmp(verb, "GET") == 0) {
+        if (dc_daemon_source) {
+            /* We own the selection — receiving from our own source would
+               need the event loop we are blocking, so answer directly. */
+            sock_reply(cfd, true, copy_data, copy_data_len);
+        } else if (dc_clipboard_offer) {
+            size_t len = 0;
+            char *data = read_dc_clip_offer(&len);
+            hist_record(data, len);
+            sock_reply(cfd, true, data, data ? len : 0);
+            scratch_free(data);
+        } else {
+            /* No data-control clipboard offer (GNOME < 47): the shell
+               falls back to --get-clipboard with its focus surface. */
+            sock_reply(cfd, false, NULL, 0);
+        }
+    } else if (strcmp(verb, "SET") == 0) {
+        /* daemon_set_clipboard() adopts or frees the payload. */
+        bool ok = payload && daemon_set_clipboard(payload, payload_len);
+        payload = NULL;
+        if (ok) hist_record(copy_data, copy_data_len);
+        sock_reply(cfd, ok, NULL, 0);
+    } else if (strcmp(verb, "PRIMARY") == 0 && !ext_dcm && !wlr_dcm) {
+        /* Without data-control (Mutter) the unfocused daemon can miss
+           PRIMARY changes; --oneshot falls back to its focus surface. */
+        sock_reply(cfd, false, NULL, 0);
+    } else if (strcmp(verb, "PRIMARY") == 0) {
+        /* Current PRIMARY text; in lazy mode this is where it is read.  A
+           burst still inside its coalescing window is settled first. */
+        flush_primary_update(true);
+        materialize_primary();
+        if (!lazy_primary && last_known_len > 0) {
+            /* Outside lazy mode the text lives only in the primary file. */
+            char *map = mmap(NULL, last_known_len, PROT_READ, MAP_SHARED,
+                             fd_primary, 0);
+            if (map != MAP_FAILED) {
+                sock_reply(cfd, true, map, last_known_len);
+                munmap(map, last_known_len);
+            } else {
+                sock_reply(cfd, false, NULL, 0);
+            }
+        } else {
+            sock_reply(cfd, true, last_known_content, last_known_len);
+        }
+    } else if (strcmp(verb, "CLEAR") == 0) {
+        daemon_clear_primary();
+        sock_reply(cfd, true, NULL, 0);
+    } else if (strcmp(verb, "HIST") == 0) {
+        unsigned long k = payload ? strtoul(payload, NULL, 10) : 0;
+        if (k < hist_count)
+            sock_reply(cfd, true, hist_arena + hist[k].off, hist[k].len);
+        else
+            sock_reply(cfd, false, NULL, 0);
+    } else if (strcmp(verb, "STATS") == 0) {
+        char buf[MET_TEXT_MAX];
+        size_t n = met_format(buf, sizeof(buf));
+        sock_reply(cfd, true, buf, n);
+    } else if (strcmp(verb, "OSC52") == 0) {
+        osc52_sock_reply(cfd, payload, payload_len);
+    } else {
+        sock_reply(cfd, false, NULL, 0);
+    }
+
+    free(payload);
+    close(cfd);
+}
+
 /* run_daemon: connect to the Wayland compositor, subscribe to PRIMARY
  * selection events, and loop indefinitely writing changes to the cache.
  * Calls daemon(3) to background itself after creating cache files so
  * the shell never blocks.  See DETECTION ARCHITECTURE comment in the
  * event loop for the full monitoring strategy. */
 static int run_daemon(const char *cache_dir_arg) {
-    if (wayland_connect() != 0) return 1;
+    if (wayland_connect(BIND_ALL) != 0) return 1;
     if (!ps_manager && !ext_dcm && !wlr_dcm) {
         fprintf(stderr,
                 "Compositor does not support primary selection or data control\n");
@@ -1713,11 +2115,29 @@ static int run_daemon(const char *cache_dir_arg) {
 
     is_daemon_mode = true;
 
+    /* Lazy PRIMARY needs event-driven offers: the Mutter fallback below
+       re-reads the same ps offer on a timer and would announce each poll. */
+    const char *lazy_env = getenv("ZES_LAZY_PRIMARY");
+    lazy_primary = lazy_env && strcmp(lazy_env, "1") == 0 && (ext_dcm || wlr_dcm);
+
+    /* Opt-in coalescing window, clamped to one second. */
+    const char *coalesce_env = getenv("ZES_COALESCE_MS");
+    long coalesce_ms = coalesce_env ? strtol(coalesce_env, NULL, 10) : 0;
+    if (coalesce_ms > 0)
+        coalesce_us = (coalesce_ms > 1000 ? 1000 : coalesce_ms) * 1000LL;
+
+    /* Opt-in event trace (ZES_TRACE), opened while the shell's working
+       directory is still ours. */
+    trace_open();
+
     /* Write initial empty cache files BEFORE daemonizing so the shell
        never tries to read a non-existent file. */
     seq_counter = (unsigned long)time(NULL);
     write_primary("", 0, seq_counter);
 
+    /* Keep the shell's readiness pipe across daemon(); see ready_notify(). */
+    ready_fd_take();
+
     if (daemon(0, 0) != 0) {
         perror("daemon");
         wayland_disconnect();
@@ -1729,29 +2149,44 @@ static int run_daemon(const char *cache_dir_arg) {
         if (f) { fprintf(f, "%d\n", getpid()); fclose(f); }
     }
 
+    if (pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        unlink(pid_path);
+        wayland_disconnect();
+        return 1;
+    }
     signal(SIGTERM, signal_handler);
     signal(SIGINT, signal_handler);
     signal(SIGHUP, signal_handler);
+    signal(SIGUSR1, met_signal_handler);
+    met_start_us = monotonic_us();
 
     /* Open persistent fds for write_primary() hot path.
        daemon(0,0) on Linux only redirects fds 0/1/2 to /dev/null; other fds
        survive.  The files already exist from the pre-daemon write_primary() call.
        O_CREAT without O_TRUNC: first real write uses lseek+ftruncate to overwrite. */
-    fd_primary = open(primary_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    fd_primary = open(primary_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
     fd_seq     = open(seq_path,    O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
 
+    /* fd_primary is opened O_RDWR so the file just written can be mapped
+       for its hash (splice path) and for the socket PRIMARY verb.  Splicing
+       is off in lazy mode, which writes an empty primary file at event
+       time and receives the text only when the PRIMARY verb asks. */
+    const char *no_splice_env = getenv("ZES_NO_SPLICE");
+    splice_primary = fd_primary >= 0 && fd_seq >= 0 && !lazy_primary &&
+                     !(no_splice_env && strcmp(no_splice_env, "1") == 0);
+
     if (ext_dcm) {
         dc_use_ext = true;
         dc_primary_offer = NULL;
-        dc_primary_has_text_sel = false;
-        struct ext_data_control_device_v1 *ext_dc_dev = ext_data_control_manager_v1_get_data_device(ext_dcm, wl_seat_obj);
-        ext_data_control_device_v1_add_listener(ext_dc_dev, &dc_device_listener_ext, NULL);
+        dc_primary_mime_sel = NULL;
+        ext_dc_daemon_dev = ext_data_control_manager_v1_get_data_device(ext_dcm, wl_seat_obj);
+        ext_data_control_device_v1_add_listener(ext_dc_daemon_dev, &dc_device_listener_ext, NULL);
     } else if (wlr_dcm) {
         dc_use_ext = false;
         dc_primary_offer = NULL;
-        dc_primary_has_text_sel = false;
-        struct zwlr_data_control_device_v1 *wlr_dc_dev = zwlr_data_control_manager_v1_get_data_device(wlr_dcm, wl_seat_obj);
-        zwlr_data_control_device_v1_add_listener(wlr_dc_dev, &dc_device_listener_wlr, NULL);
+        dc_primary_mime_sel = NULL;
+        wlr_dc_daemon_dev = zwlr_data_control_manager_v1_get_data_device(wlr_dcm, wl_seat_obj);
+        zwlr_data_control_device_v1_add_listener(wlr_dc_daemon_dev, &dc_device_listener_wlr, NULL);
     } else if (ps_manager) {
         ps_device = zwp_primary_selection_device_manager_v1_get_device(
             ps_manager, wl_seat_obj);
@@ -1782,8 +2217,23 @@ static int run_daemon(const char *cache_dir_arg) {
      * GTK3/GTK4 terminals comply: they fire ps_device_handle_selection on
      * the mouse-button release event with final content.  The cache is
      * always correct before user invokes Ctrl+C.
-     * The event loop wakes up every 1 s for SIGTERM processing only. */
+     * With data-control the loop blocks with no timeout; signals reach it
+     * through wake_pipe.  Without it (GNOME/Mutter) the current ps offer
+     * must be re-read on a timer, because the compositor won't send
+     * selection events to unfocused background surfaces.  That interval
+     * starts at PS_POLL_MIN_MS and doubles after every read that finds the
+     * content unchanged, up to PS_POLL_MAX_MS; a change, a new offer or a
+     * shell request drops it back to the minimum. */
     int wl_fd = wl_display_get_fd(wl_dpy);
+    int ps_poll_ms = PS_POLL_MIN_MS;
+
+    /* Request socket for the shell's GET/SET/CLEAR calls.  -1 is not
+       fatal: the shell falls back to spawning the agent per call. */
+    int sock_fd = sock_listen();
+
+    /* Initial offers handled by the roundtrip above and socket listening:
+       release the shell. */
+    ready_notify();
 
     while (running) {
         while (wl_display_prepare_read(wl_dpy) != 0)
@@ -1794,9 +2244,25 @@ static int run_daemon(const char *cache_dir_arg) {
             break;
         }
 
-        int timeout = (ext_dcm || wlr_dcm) ? 1000 : 50;
-        struct pollfd pfd = { .fd = wl_fd, .events = POLLIN };
-        int ret = poll(&pfd, 1, timeout);
+        bool ps_poll = !ext_dcm && !wlr_dcm && current_ps_offer && ps_text_mime;
+        int timeout = ps_poll ? ps_poll_ms : -1;
+        if (coalesce_due_us) {
+            long long left = coalesce_due_us - monotonic_us();
+            int left_ms = left > 0 ? (int)((left + 999) / 1000) : 0;
+            if (timeout < 0 || left_ms < timeout) timeout = left_ms;
+        }
+        struct pollfd pfds[3] = {
+            { .fd = wl_fd,        .events = POLLIN },
+            { .fd = sock_fd,      .events = POLLIN },
+            { .fd = wake_pipe[0], .events = POLLIN },
+        };
+        int ret = poll(pfds, 3, timeout);
+        if (ret > 0 && pfds[2].revents)
+            wake_drain();
+        if (met_dump_pending) {
+            met_dump_pending = 0;
+            met_dump_file();
+        }
 
         if (ret < 0) {
             wl_display_cancel_read(wl_dpy);
@@ -1806,32 +2272,63 @@ static int run_daemon(const char *cache_dir_arg) {
 
         if (ret == 0) {
             wl_display_cancel_read(wl_dpy);
-            /* If no data-control manager exists (GNOME/Mutter), we MUST poll the
-               current offer because the compositor won't send selection events
-               to unfocused background surfaces. */
-            if (!ext_dcm && !wlr_dcm && current_ps_offer && ps_has_text) {
-                process_primary_update(NULL, NULL, current_ps_offer, ps_has_text);
+            /* The coalescing deadline woke us. */
+            if (flush_primary_update(false))
+                continue;
+            /* Mutter fallback: re-read the current offer, backing off while
+               it keeps returning the same content.  seq_counter moves on
+               every call, so "changed" is the (len, hash) pair moving. */
+            if (ps_poll) {
+                size_t before_len = last_known_len;
+                uint64_t before_hash = last_known_hash;
+                process_primary_update(NULL, NULL, current_ps_offer, ps_text_mime);
+                if (last_known_len != before_len || last_known_hash != before_hash)
+                    ps_poll_ms = PS_POLL_MIN_MS;
+                else if (ps_poll_ms < PS_POLL_MAX_MS)
+                    ps_poll_ms *= 2;
             }
             continue;
         }
 
-        if (pfd.revents & POLLIN) {
+        if (pfds[0].revents & POLLIN) {
             if (wl_display_read_events(wl_dpy) == -1) break;
             wl_display_dispatch_pending(wl_dpy);
+            ps_poll_ms = PS_POLL_MIN_MS;
         } else {
             wl_display_cancel_read(wl_dpy);
         }
 
+        /* Served outside the prepare_read window so that request handlers
+           are free to flush and receive on the display.  A request means
+           the user is at a prompt, so the Mutter re-read speeds back up. */
+        if (sock_fd >= 0 && (pfds[1].revents & POLLIN)) {
+            handle_sock_request(sock_fd);
+            ps_poll_ms = PS_POLL_MIN_MS;
+        }
+
+        /* A drag streaming events never lets poll() time out. */
+        flush_primary_update(false);
+
         if (wl_display_get_error(wl_dpy) != 0) break;
     }
 
+    if (sock_fd >= 0) {
+        close(sock_fd);
+        unlink(sock_path);
+    }
+
     if (fd_primary >= 0) { close(fd_primary); fd_primary = -1; }
     if (fd_seq     >= 0) { close(fd_seq);     fd_seq     = -1; }
+    trace_close();
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
     wayland_disconnect();
     free(last_known_content);
+    free(copy_data);
     unlink(primary_path);
     unlink(seq_path);
     unlink(pid_path);
+    unlink(metrics_path);
     return 0;
 }
 
@@ -1846,14 +2343,16 @@ static int run_daemon(const char *cache_dir_arg) {
  *   --get-clipboard    Print clipboard (CLIPBOARD selection) and exit.
  *   --copy-clipboard   Read stdin, take clipboard ownership, serve paste requests.
  *   --clear-primary    Clear PRIMARY selection.
+ *   --stats            Print the running daemon's metrics (no Wayland connection).
  *   --help / -h        Print usage to stderr and exit.
  *
- * A positional non-flag argument sets cache_dir (used by daemon / oneshot). */
+ * A positional non-flag argument sets cache_dir (used by daemon / oneshot, and
+ * by the one-shot modes to find the daemon socket). */
 int main(int argc, char *argv[]) {
     const char *cache_dir_arg = NULL;
 
     enum { MODE_DAEMON, MODE_ONESHOT, MODE_GET_CLIP, MODE_COPY_CLIP,
-           MODE_CLEAR_PRIMARY } mode = MODE_DAEMON;
+           MODE_CLEAR_PRIMARY, MODE_STATS, MODE_OSC52 } mode = MODE_DAEMON;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--oneshot") == 0)
@@ -1864,17 +2363,23 @@ int main(int argc, char *argv[]) {
             mode = MODE_COPY_CLIP;
         else if (strcmp(argv[i], "--clear-primary") == 0)
             mode = MODE_CLEAR_PRIMARY;
+        else if (strcmp(argv[i], "--stats") == 0)
+            mode = MODE_STATS;
+        else if (strcmp(argv[i], "--osc52") == 0)
+            mode = MODE_OSC52;
         else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             fprintf(stderr,
                 "Usage: %s [cache_dir] [--oneshot|--get-clipboard|"
-                "--copy-clipboard|--clear-primary]\n\n"
+                "--copy-clipboard|--clear-primary|--stats|--osc52]\n\n"
                 "Wayland selection monitor for zsh-edit-select\n\n"
                 "Modes:\n"
                 "  (default)         Daemon: monitor PRIMARY selection\n"
                 "  --oneshot         Print current PRIMARY and exit\n"
                 "  --get-clipboard   Print clipboard contents and exit\n"
                 "  --copy-clipboard  Read stdin, set as clipboard\n"
-                "  --clear-primary   Clear PRIMARY selection\n",
+                "  --clear-primary   Clear PRIMARY selection\n"
+                "  --stats           Print the running daemon's metrics\n"
+                "  --osc52           Read stdin, write it to the terminal as OSC 52\n",
                 argv[0]);
             return 0;
         } else {
@@ -1884,9 +2389,11 @@ int main(int argc, char *argv[]) {
 
     switch (mode) {
         case MODE_ONESHOT:       return run_oneshot(cache_dir_arg);
-        case MODE_GET_CLIP:      return run_get_clipboard();
-        case MODE_COPY_CLIP:     return run_copy_clipboard();
-        case MODE_CLEAR_PRIMARY: return run_clear_primary();
+        case MODE_GET_CLIP:      return run_get_clipboard(cache_dir_arg);
+        case MODE_COPY_CLIP:     return run_copy_clipboard(cache_dir_arg);
+        case MODE_CLEAR_PRIMARY: return run_clear_primary(cache_dir_arg);
+        case MODE_STATS:         return run_stats(cache_dir_arg);
+        case MODE_OSC52:         return run_osc52();
         case MODE_DAEMON:        return run_daemon(cache_dir_arg);
     }
     return 1;
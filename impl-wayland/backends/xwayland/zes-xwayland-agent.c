@@ -4,7 +4,18 @@
 // XWayland clipboard integration agent for zsh-edit-select.
 // Uses X11 XFixes through XWayland — completely invisible on Wayland
 // compositors. Supports clipboard operations and PRIMARY clearing.
-// Compile: gcc -O3 zes-xwayland-agent.c -o zes-xwayland-agent -lX11 -lXfixes
+// Compile: gcc -O3 -I../../../common zes-xwayland-agent.c -o zes-xwayland-agent -lX11 -lXfixes
+//
+// In daemon mode the agent also listens on <cache_dir>/agent.sock and
+// answers GET/SET/CLEAR requests over its existing X connection, so the
+// shell can paste and copy without spawning a short-lived agent per call.
+//
+// SIGUSR1 makes the daemon write its metrics to <cache_dir>/agent.metrics;
+// --stats [cache_dir] triggers that and prints the result.
+//
+// --osc52 writes stdin to the terminal as an OSC 52 sequence without
+// opening the display, for SSH sessions; the daemon's OSC52 verb returns
+// the same tmux/screen-framed sequence to the shell.
 
 #define _GNU_SOURCE
 
@@ -14,6 +25,9 @@
 #include <unistd.h>
 #include <signal.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
@@ -23,24 +37,28 @@
 #include <X11/Xatom.h>
 #include <X11/extensions/Xfixes.h>
 
-/* Cache-directory filenames and safety cap.
-   PRIMARY_FILE / SEQ_FILE: selected text and change counter.
-   PID_FILE: daemon PID for liveness checks.
-   MAX_SELECTION_SIZE: 1 MB cap on selection reads. */
-#define PRIMARY_FILE "primary"
-#define SEQ_FILE "seq"
-#define PID_FILE "agent.pid"
+/* Size caps (cache-file names live in zes-agent-core.h).
+   MAX_SELECTION_SIZE: 1 MB cap on PRIMARY reads.
+   MAX_TRANSFER_SIZE: cap on clipboard text moved by --copy-clipboard,
+   --get-clipboard and the socket API.
+   INCR_CHUNK_SIZE: largest piece fetched or served per X request. */
 #define MAX_SELECTION_SIZE (1024 * 1024)
+#define MAX_TRANSFER_SIZE (64 * 1024 * 1024)
+#define INCR_CHUNK_SIZE (256 * 1024)
 
-static volatile sig_atomic_t running = 1;
-static char cache_dir[512];
-static char primary_path[560];
-static char seq_path[560];
-static char pid_path[560];
+/* Shared daemon core: cache layout, publish, metrics and the socket API.
+   "wait" in the metrics is time blocked on the selection owner's
+   conversion reply and INCR chunks. */
+#define MET_AGENT "xwayland"
+#define ZES_MAX_PAYLOAD MAX_TRANSFER_SIZE
+#include "zes-agent-core.h"
 
-/* X11/XWayland connection state and interned selection atoms. */
 /* X11/XWayland connection handle and root window. */
 static Display *dpy = NULL;
+/* Persistent window reused by daemon-mode selection reads to avoid
+   per-event XCreateSimpleWindow/XDestroyWindow round-trips.
+   Set once after daemon() in run_daemon(); None in short-lived modes. */
+static Window daemon_win = None;
 static Window root;
 /* Standard X11 selection and conversion atoms.
    XWayland runs an isolated per-session X server, so using xa_primary
@@ -50,103 +68,257 @@ static Atom xa_primary;
 static Atom xa_clipboard;
 static Atom xa_utf8_string;
 static Atom xa_targets;
+static Atom xa_incr;
+static Atom xa_text_plain_utf8;
+static Atom xa_text;
+/* Text target chosen for the current owner of each selection by one
+   TARGETS query (see selection_target()); owner None means no choice is
+   cached yet. */
+struct owner_target {
+    Window owner;
+    Atom target;
+};
+static struct owner_target primary_target = { None, None };
+static struct owner_target clipboard_target = { None, None };
 /* Monotonically increasing counter written to SEQ_FILE; the shell polls
    its mtime to detect selection changes without reading content. */
 static unsigned long seq_counter = 0;
 
-/* Persistent fds for write_primary() daemon hot path.
-   Opened once after daemon() in run_daemon(); reused for all subsequent writes.
-   -1 = not yet open (pre-daemon initial write uses the open/write/close fallback). */
-static int fd_primary = -1;
-static int fd_seq     = -1;
+/* Clipboard owned by the daemon itself after a socket SET request.
+   clip_win is created on the first SET and reused for every later one;
+   clip_data is the buffer served to paste requestors until another client
+   takes CLIPBOARD (SelectionClear), at which point it is freed. */
+static Window clip_win = None;
+static char *clip_data = NULL;
+static size_t clip_data_len = 0;
+
+#define CONV_TIMEOUT_MS 500
+
+/* Ask the owner of selection to convert it to target into prop on w,
+ * then block in poll() on the X connection until the matching
+ * SelectionNotify is queued or a CLOCK_MONOTONIC deadline passes.  The
+ * caller wakes as soon as the reply arrives, and EINTR cannot stretch the
+ * CONV_TIMEOUT_MS budget.  Notifies left on a reused window by an earlier
+ * timed-out conversion are discarded first.  Returns true with *ev filled in
+ * when the notify arrived. */
+static bool convert_and_wait(Window w, Atom selection, Atom target, Atom prop,
+                             XEvent *ev) {
+    while (XCheckTypedWindowEvent(dpy, w, SelectionNotify, ev))
+        ;
+    XConvertSelection(dpy, selection, target, prop, w, CurrentTime);
+    XFlush(dpy);
+    long long start = monotonic_us();
+    long long deadline = start + CONV_TIMEOUT_MS * 1000LL;
+
+    struct pollfd pfd = { .fd = XConnectionNumber(dpy), .events = POLLIN };
+    bool got = false;
+    for (;;) {
+        /* Also reads whatever has already arrived on the socket. */
+        if (XCheckTypedWindowEvent(dpy, w, SelectionNotify, ev)) {
+            got = true;
+            break;
+        }
+        long long now = monotonic_us();
+        if (now >= deadline)
+            break;
+        int ret = poll(&pfd, 1, (int)((deadline - now + 999) / 1000));
+        if (ret < 0 && errno != EINTR)
+            break;
+    }
+    met_record(&met_wait, monotonic_us() - start);
+    if (!got)
+        met_timeouts++;
+    return got;
+}
+
+/* Return the text target to request from owner, the current owner of
+ * selection.  The choice is cached per owner window, so only the first
+ * read after an ownership change pays for the TARGETS query; every later
+ * read of the same owner converts straight to a type it is known to
+ * serve instead of waiting out CONV_TIMEOUT_MS on one it does not.
+ * Owners that do not answer TARGETS, or list no text type, get
+ * UTF8_STRING as before. */
+static Atom selection_target(Window w, Atom selection, Atom prop, Window owner) {
+    struct owner_target *c = (selection == xa_primary) ? &primary_target
+                                                       : &clipboard_target;
+    if (c->owner == owner && c->target != None)
+        return c->target;
+
+    /* Text types in order of preference. */
+    const Atom prefs[] = { xa_utf8_string, xa_text_plain_utf8, XA_STRING, xa_text };
+    size_t best = sizeof(prefs) / sizeof(prefs[0]);
 
-/* SIGTERM / SIGINT handler — sets the flag that exits the event loop. */
-static void signal_handler(int sig) {
-    (void)sig;
-    running = 0;
+    XEvent ev;
+    if (convert_and_wait(w, selection, xa_targets, prop, &ev) &&
+        ev.xselection.property != None) {
+        Atom actual_type;
+        int actual_format;
+        unsigned long nitems, bytes_after;
+        unsigned char *xdata = NULL;
+        if (XGetWindowProperty(dpy, w, prop, 0, 1024, True, XA_ATOM,
+                               &actual_type, &actual_format, &nitems,
+                               &bytes_after, &xdata) == Success &&
+            actual_type == XA_ATOM && actual_format == 32) {
+            /* Format-32 property data is handed back as longs. */
+            const long *atoms = (const long *)xdata;
+            for (unsigned long i = 0; i < nitems; i++)
+                for (size_t k = 0; k < best; k++)
+                    if ((Atom)atoms[i] == prefs[k]) { best = k; break; }
+        }
+        if (xdata) XFree(xdata);
+    }
+
+    c->owner = owner;
+    c->target = (best < sizeof(prefs) / sizeof(prefs[0])) ? prefs[best]
+                                                          : xa_utf8_string;
+    return c->target;
 }
 
-/* Resolve cache directory path (argument > XDG_RUNTIME_DIR > /dev/shm > HOME),
-   populate path globals, and create the directory.  Returns 0 on success. */
-static int ensure_cache_dir(const char *dir) {
-    if (dir && dir[0]) {
-        snprintf(cache_dir, sizeof(cache_dir), "%s", dir);
-    } else {
-        /* Cache location priority:
-           1. XDG_RUNTIME_DIR/<uid> — tmpfs, cleaned by PAM on logout.
-           2. /dev/shm — in-memory tmpfs on Linux; fast for short-lived modes.
-           3. HOME/.cache — persistent fallback for non-standard environments. */
-        const char *runtime = getenv("XDG_RUNTIME_DIR");
-        if (runtime) {
-            snprintf(cache_dir, sizeof(cache_dir), "%s/zsh-edit-select-%d",
-                     runtime, (int)getuid());
-        } else if (access("/dev/shm", W_OK | X_OK) == 0) {
-            snprintf(cache_dir, sizeof(cache_dir),
-                     "/dev/shm/zsh-edit-select-%d", (int)getuid());
-        } else {
-            const char *home = getenv("HOME");
-            if (!home) return -1;
-            snprintf(cache_dir, sizeof(cache_dir),
-                     "%s/.cache/zsh-edit-select", home);
+/* Growable buffer for a selection value arriving in pieces. */
+struct sel_buf {
+    char *data;
+    size_t len;
+    size_t cap;
+    bool scratch; /* grow in the daemon's arena instead of the heap */
+};
+
+/* Append the current value of prop on w to b, fetching it INCR_CHUNK_SIZE
+   bytes per GetProperty reply instead of one MAX_SELECTION_SIZE read that
+   could exceed the server's reply limits.  Stops (truncating) at max bytes.
+   *got receives the number of bytes the property held.  Returns false when
+   the property cannot be read. */
+static bool sel_buf_append_property(struct sel_buf *b, Window w, Atom prop,
+                                    size_t max, size_t *got) {
+    size_t total = 0; /* property bytes fetched so far */
+    *got = 0;
+    for (;;) {
+        Atom actual_type;
+        int actual_format;
+        unsigned long nitems, bytes_after;
+        unsigned char *xdata = NULL;
+
+        if (XGetWindowProperty(dpy, w, prop, (long)(total / 4),
+                               INCR_CHUNK_SIZE / 4, False,
+                               AnyPropertyType, &actual_type, &actual_format,
+                               &nitems, &bytes_after, &xdata) != Success)
+            return false;
+        /* Offsets count 32-bit units; a reply carries nitems items of
+           actual_format bits each. */
+        size_t bytes = nitems * (size_t)(actual_format / 8);
+        total += bytes;
+        /* Text targets are format 8; anything else carries no usable bytes. */
+        size_t n = (actual_format == 8) ? nitems : 0;
+        if (n > max - b->len) n = max - b->len;
+        if (b->len + n + 1 > b->cap) {
+            size_t cap = b->cap ? b->cap : 4096;
+            while (cap < b->len + n + 1) cap *= 2;
+            char *nb = b->scratch ? arena_reserve(cap) : realloc(b->data, cap);
+            if (!nb) { if (xdata) XFree(xdata); return false; }
+            b->data = nb;
+            b->cap = cap;
         }
+        if (n > 0) memcpy(b->data + b->len, xdata, n);
+        b->len += n;
+        b->data[b->len] = '\0';
+        *got += bytes;
+        if (xdata) XFree(xdata);
+        if (bytes_after == 0 || bytes == 0 || b->len >= max)
+            return true;
     }
-    snprintf(primary_path, sizeof(primary_path), "%s/%s", cache_dir, PRIMARY_FILE);
-    snprintf(seq_path, sizeof(seq_path), "%s/%s", cache_dir, SEQ_FILE);
-    snprintf(pid_path, sizeof(pid_path), "%s/%s", cache_dir, PID_FILE);
+}
 
-    struct stat st;
-    if (stat(cache_dir, &st) == -1) {
-        if (mkdir(cache_dir, 0700) == -1 && errno != EEXIST)
-            return -1;
+/* Block until prop on w receives a new value (the next INCR chunk), or
+   CONV_TIMEOUT_MS passes without one. */
+static bool wait_property_new_value(Window w, Atom prop) {
+    long long deadline = monotonic_us() + CONV_TIMEOUT_MS * 1000LL;
+    struct pollfd pfd = { .fd = XConnectionNumber(dpy), .events = POLLIN };
+    for (;;) {
+        XEvent ev;
+        while (XCheckTypedWindowEvent(dpy, w, PropertyNotify, &ev)) {
+            if (ev.xproperty.atom == prop && ev.xproperty.state == PropertyNewValue)
+                return true;
+        }
+        long long now = monotonic_us();
+        if (now >= deadline) {
+            met_timeouts++;
+            return false;
+        }
+        int ret = poll(&pfd, 1, (int)((deadline - now + 999) / 1000));
+        if (ret < 0 && errno != EINTR)
+            return false;
     }
-    return 0;
 }
 
-/* Write selection text to PRIMARY cache and the sequence number to SEQ.
-   Uses persistent fds in daemon mode, open/write/close otherwise. */
-static void write_primary(const char *data, size_t len, unsigned long seq) {
-    if (fd_primary >= 0) {
-        /* Persistent-fd hot path: seek to start, write new content, then
-           truncate to correct length.  ftruncate is mandatory — without it,
-           content that shrinks between events (e.g. "hello world" → "hi")
-           leaves stale bytes at the end that the shell reads as part of the
-           new selection.  The (void) casts match the existing style. */
-        if (len > 0 && data) {
-            ssize_t r = pwrite(fd_primary, data, len, 0);
-            (void)r;
+/* Read the conversion reply left in prop on w after a SelectionNotify and
+ * delete the property.  Owners of large selections answer with an INCR
+ * property instead of the text (ICCCM 2.7.2): we then delete it to start
+ * the transfer and collect one chunk per PropertyNewValue until the owner
+ * writes a zero-length chunk.  At most max bytes are kept.
+ *
+ * Returns a NUL-terminated buffer, the daemon's arena when scratch or else
+ * malloc'd (release either with scratch_free()), or NULL if the selection
+ * is empty or the transfer fails or stalls. */
+static char *read_selection_property(Window w, Atom prop, size_t max,
+                                     size_t *out_len, bool scratch) {
+    struct sel_buf b = { NULL, 0, 0, scratch };
+    size_t got = 0;
+    *out_len = 0;
+
+    Atom actual_type;
+    int actual_format;
+    unsigned long nitems, bytes_after;
+    unsigned char *xdata = NULL;
+    if (XGetWindowProperty(dpy, w, prop, 0, 0, False, AnyPropertyType,
+                           &actual_type, &actual_format, &nitems,
+                           &bytes_after, &xdata) != Success)
+        return NULL;
+    if (xdata) XFree(xdata);
+
+    if (actual_type != xa_incr) {
+        bool ok = sel_buf_append_property(&b, w, prop, max, &got);
+        XDeleteProperty(dpy, w, prop);
+        if (!ok || b.len == 0) {
+            scratch_free(b.data);
+            return NULL;
         }
-        (void)ftruncate(fd_primary, (off_t)len);
-
-        /* primary must be fully committed before seq is touched —
-           seq's mtime is the shell's only per-keypress detection signal. */
-        char buf[24];
-        int n = snprintf(buf, sizeof(buf), "%lu\n", seq);
-        ssize_t r = pwrite(fd_seq, buf, (size_t)n, 0);
-        (void)r;
-        (void)ftruncate(fd_seq, (off_t)n);
-        return;
+        if (b.len >= max)
+            met_oversize++;
+        *out_len = b.len;
+        return b.data;
     }
 
-    /* Fallback path: used for the pre-daemon() initial write (fd_primary is
-       still -1 at that point) and if open() failed after daemon().
-       All short-lived modes (--oneshot, --get-clipboard, --copy-clipboard,
-       --clear-primary) also use this path since they never open persistent fds. */
-    int fd = open(primary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
-    if (fd < 0) return;
-    if (len > 0 && data) {
-        ssize_t r = write(fd, data, len);
-        (void)r;
+    /* PropertyChangeMask must be selected before the delete that tells the
+       owner to send the first chunk.  Notifies left over from an earlier
+       transfer on a reused window are discarded. */
+    XEvent stale;
+    XSelectInput(dpy, w, PropertyChangeMask);
+    while (XCheckTypedWindowEvent(dpy, w, PropertyNotify, &stale))
+        ;
+    XDeleteProperty(dpy, w, prop);
+    XFlush(dpy);
+
+    bool ok = true;
+    for (;;) {
+        long long wait_start = monotonic_us();
+        bool more = wait_property_new_value(w, prop);
+        met_record(&met_wait, monotonic_us() - wait_start);
+        if (!more) { ok = false; break; }
+        ok = sel_buf_append_property(&b, w, prop, max, &got);
+        /* Deleting the chunk asks the owner for the next one. */
+        XDeleteProperty(dpy, w, prop);
+        XFlush(dpy);
+        if (!ok || got == 0 || b.len >= max) break;
     }
-    close(fd);
+    XSelectInput(dpy, w, NoEventMask);
 
-    fd = open(seq_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
-    if (fd >= 0) {
-        char buf[24];
-        int n = snprintf(buf, sizeof(buf), "%lu\n", seq);
-        ssize_t r = write(fd, buf, n);
-        (void)r;
-        close(fd);
+    if (!ok || b.len == 0) {
+        scratch_free(b.data);
+        return NULL;
     }
+    if (b.len >= max)
+        met_oversize++;
+    *out_len = b.len;
+    return b.data;
 }
 
 /* Request PRIMARY selection text from the XWayland X11 server.
@@ -154,7 +326,8 @@ static void write_primary(const char *data, size_t len, unsigned long seq) {
  * because XWayland has an isolated per-session X server with no risk
  * of clashing with properties written by unrelated clients.
  *
- * Returns a malloc'd buffer (caller must free) or NULL on failure/timeout. */
+ * Returns a buffer to release with scratch_free(), or NULL on
+ * failure/timeout. */
 static char *get_primary_selection(size_t *out_len) {
     Window owner = XGetSelectionOwner(dpy, xa_primary);
     if (owner == None) {
@@ -162,51 +335,26 @@ static char *get_primary_selection(size_t *out_len) {
         return NULL;
     }
 
-    Window w = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
-    XConvertSelection(dpy, xa_primary, xa_utf8_string, xa_primary, w, CurrentTime);
-    XFlush(dpy);
+    /* Reuse the persistent daemon window when available; create a temp
+       window only in short-lived modes (--oneshot, --get-clipboard). */
+    bool ephemeral = (daemon_win == None);
+    Window w = ephemeral ? XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0)
+                         : daemon_win;
     XEvent ev;
-    bool got_notify = false;
-    {
-        int xfd = XConnectionNumber(dpy);
-        struct pollfd pfd = { .fd = xfd, .events = POLLIN };
-        int elapsed_ms = 0;
-        while (elapsed_ms < 500) {
-            if (XCheckTypedWindowEvent(dpy, w, SelectionNotify, &ev)) {
-                got_notify = true;
-                break;
-            }
-            /* Short initial polls catch the common 1-5 ms roundtrip without
-               overshooting; longer polls after 20 ms reduce syscall rate. */
-            int wait = (elapsed_ms < 20) ? 5 : 20;
-            int ret = poll(&pfd, 1, wait);
-            if (ret < 0 && errno != EINTR) break;
-            elapsed_ms += wait;
-        }
-    }
+    Atom target = selection_target(w, xa_primary, xa_primary, owner);
+    bool got_notify = convert_and_wait(w, xa_primary, target, xa_primary, &ev);
 
     char *data = NULL;
     *out_len = 0;
 
-    if (got_notify && ev.xselection.property != None) {
-        Atom actual_type;
-        int actual_format;
-        unsigned long nitems, bytes_after;
-        unsigned char *prop = NULL;
-
-        if (XGetWindowProperty(dpy, w, xa_primary, 0, MAX_SELECTION_SIZE / 4,
-                               False, AnyPropertyType, &actual_type, &actual_format,
-                               &nitems, &bytes_after, &prop) == Success) {
-            if (prop && nitems > 0) {
-                *out_len = nitems;
-                data = malloc(nitems);
-                if (data) memcpy(data, prop, nitems);
-            }
-            if (prop) XFree(prop);
-        }
-    }
+    if (got_notify && ev.xselection.property != None)
+        data = read_selection_property(w, xa_primary, MAX_SELECTION_SIZE,
+                                       out_len, !ephemeral);
+    else if (got_notify)
+        primary_target.owner = None; /* refused: ask for TARGETS again */
 
-    XDestroyWindow(dpy, w);
+    if (ephemeral)
+        XDestroyWindow(dpy, w);
     return data;
 }
 
@@ -214,14 +362,28 @@ static char *get_primary_selection(size_t *out_len) {
    unconditionally update cache, incrementing the sequence counter.
    Called on every XFixes owner-change notification. */
 static void check_and_update_primary(void) {
+    long long start = monotonic_us();
     size_t len = 0;
     char *sel = get_primary_selection(&len);
+    uint64_t hash = sel ? zes_hash64(sel, len) : zes_hash64("", 0);
+    if (trace_fd >= 0) {
+        char *target = primary_target.target != None
+            ? XGetAtomName(dpy, primary_target.target) : NULL;
+        trace_record(TRACE_READ, target, sel, len,
+                     sel ? hash : 0, monotonic_us() - start);
+        if (target) XFree(target);
+    }
 
     /* Always increment seq even when content is identical — a reselect
-       of exactly the same text must still fire a new event in the shell. */
+       of exactly the same text must still fire a new event in the shell;
+       write_primary_hashed() then only rewrites seq. */
     seq_counter++;
-    write_primary(sel ? sel : "", sel ? len : 0, seq_counter);
-    free(sel);
+    write_primary_hashed(sel ? sel : "", sel ? len : 0, seq_counter, hash);
+    scratch_free(sel);
+
+    met_events++;
+    met_bytes += len;
+    met_record(&met_event, monotonic_us() - start);
 }
 
 /* Print current PRIMARY selection to stdout and exit.
@@ -248,53 +410,31 @@ static char *get_selection(Atom selection, size_t *out_len) {
         return NULL;
     }
 
-    Window w = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
+    /* Reuse the persistent daemon window when available; create a temp
+       window only in short-lived modes (--oneshot, --get-clipboard). */
+    bool ephemeral = (daemon_win == None);
+    Window w = ephemeral ? XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0)
+                         : daemon_win;
     Atom prop_atom = (selection == xa_primary) ? xa_primary : xa_clipboard;
-    XConvertSelection(dpy, selection, xa_utf8_string, prop_atom, w, CurrentTime);
-    XFlush(dpy);
+    size_t max = (selection == xa_primary) ? MAX_SELECTION_SIZE : MAX_TRANSFER_SIZE;
 
     XEvent ev;
-    bool got_notify = false;
-    {
-        int xfd = XConnectionNumber(dpy);
-        struct pollfd pfd = { .fd = xfd, .events = POLLIN };
-        int elapsed_ms = 0;
-        while (elapsed_ms < 500) {
-            if (XCheckTypedWindowEvent(dpy, w, SelectionNotify, &ev)) {
-                got_notify = true;
-                break;
-            }
-            /* Short initial polls catch the common 1-5 ms roundtrip without
-               overshooting; longer polls after 20 ms reduce syscall rate. */
-            int wait = (elapsed_ms < 20) ? 5 : 20;
-            int ret = poll(&pfd, 1, wait);
-            if (ret < 0 && errno != EINTR) break;
-            elapsed_ms += wait;
-        }
-    }
+    Atom target = selection_target(w, selection, prop_atom, owner);
+    bool got_notify = convert_and_wait(w, selection, target, prop_atom, &ev);
 
     char *data = NULL;
     *out_len = 0;
 
-    if (got_notify && ev.xselection.property != None) {
-        Atom actual_type;
-        int actual_format;
-        unsigned long nitems, bytes_after;
-        unsigned char *prop = NULL;
-
-        if (XGetWindowProperty(dpy, w, prop_atom, 0, MAX_SELECTION_SIZE / 4,
-                               False, AnyPropertyType, &actual_type, &actual_format,
-                               &nitems, &bytes_after, &prop) == Success) {
-            if (prop && nitems > 0) {
-                *out_len = nitems;
-                data = malloc(nitems);
-                if (data) memcpy(data, prop, nitems);
-            }
-            if (prop) XFree(prop);
-        }
+    if (got_notify && ev.xselection.property != None)
+        data = read_selection_property(w, prop_atom, max, out_len, !ephemeral);
+    else if (got_notify) {
+        /* Refused: ask the owner for TARGETS again next time. */
+        if (selection == xa_primary) primary_target.owner = None;
+        else clipboard_target.owner = None;
     }
 
-    XDestroyWindow(dpy, w);
+    if (ephemeral)
+        XDestroyWindow(dpy, w);
     return data;
 }
 
@@ -311,36 +451,113 @@ static int run_get_clipboard(void) {
     return 1;
 }
 
-/* Read all of stdin into a malloc'd buffer.  Used by --copy-clipboard
- * to capture the content before the agent takes clipboard ownership. */
-static char *read_all_stdin(size_t *out_len) {
-    size_t capacity = 4096, total = 0;
-    char *buf = malloc(capacity);
-    if (!buf) return NULL;
-
-    while (1) {
-        if (total + 4096 > capacity) {
-            capacity *= 2;
-            if (capacity > MAX_SELECTION_SIZE) break;
-            char *nb = realloc(buf, capacity);
-            if (!nb) { free(buf); *out_len = 0; return NULL; }
-            buf = nb;
+/* A selection_request_received flag prevents the 50-second idle
+   timeout from expiring while the agent is actively serving pastes. */
+static bool selection_request_received = false;
+
+/* In-flight INCR transfers being served (ICCCM 2.7.2).  A requestor asking
+   for more than incr_chunk_size() bytes gets an INCR property holding the
+   total length; each time it deletes the property the next chunk is written,
+   and a zero-length chunk ends the transfer.  Slots whose requestor went
+   quiet for INCR_STALE_MS (window destroyed, client killed) are reused. */
+#define INCR_MAX_XFERS 8
+#define INCR_STALE_MS 5000
+struct incr_xfer {
+    Window requestor;   /* None when the slot is free */
+    Atom property;
+    Atom target;
+    const char *data;
+    size_t len;
+    size_t off;
+    long long last_us;
+};
+static struct incr_xfer incr_xfers[INCR_MAX_XFERS];
+
+/* Largest value written in one ChangeProperty: INCR_CHUNK_SIZE, or less when
+   the server's maximum request size (in 4-byte units) is smaller. */
+static size_t incr_chunk_size(void) {
+    long max_req = XExtendedMaxRequestSize(dpy);
+    if (max_req == 0) max_req = XMaxRequestSize(dpy);
+    size_t bytes = (size_t)max_req * 4 - 256;   /* ChangeProperty header room */
+    return bytes < INCR_CHUNK_SIZE ? bytes : INCR_CHUNK_SIZE;
+}
+
+/* Begin an INCR transfer of data to req's property.  Returns false when
+   every slot is busy, in which case the request is refused. */
+static bool incr_start(XSelectionRequestEvent *req, const char *data, size_t len) {
+    long long now = monotonic_us();
+    struct incr_xfer *x = NULL;
+    for (int i = 0; i < INCR_MAX_XFERS; i++) {
+        if (incr_xfers[i].requestor == None ||
+            now - incr_xfers[i].last_us > INCR_STALE_MS * 1000LL) {
+            x = &incr_xfers[i];
+            break;
         }
-        ssize_t n = read(STDIN_FILENO, buf + total, 4096);
-        if (n > 0) total += n;
-        else break;
     }
-    *out_len = total;
-    return buf;
+    if (!x) return false;
+
+    x->requestor = req->requestor;
+    x->property = req->property;
+    x->target = req->target;
+    x->data = data;
+    x->len = len;
+    x->off = 0;
+    x->last_us = now;
+
+    long total = (long)len;
+    XSelectInput(dpy, req->requestor, PropertyChangeMask);
+    XChangeProperty(dpy, req->requestor, req->property, xa_incr, 32,
+                    PropModeReplace, (unsigned char *)&total, 1);
+    return true;
 }
 
-/* A selection_request_received flag prevents the 50-second idle
-   timeout from expiring while the agent is actively serving pastes. */
-static bool selection_request_received = false;
+/* Advance the transfer whose property the requestor just deleted.
+   Returns true if pev belonged to one of our transfers. */
+static bool incr_handle_property(XPropertyEvent *pev) {
+    if (pev->state != PropertyDelete) return false;
+    for (int i = 0; i < INCR_MAX_XFERS; i++) {
+        struct incr_xfer *x = &incr_xfers[i];
+        if (x->requestor != pev->window || x->property != pev->atom)
+            continue;
+        size_t n = x->len - x->off;
+        size_t chunk = incr_chunk_size();
+        if (n > chunk) n = chunk;
+        XChangeProperty(dpy, x->requestor, x->property, x->target, 8,
+                        PropModeReplace, (unsigned char *)x->data + x->off, (int)n);
+        x->off += n;
+        x->last_us = monotonic_us();
+        if (n == 0) {
+            /* Zero-length chunk written: transfer complete. */
+            XSelectInput(dpy, x->requestor, NoEventMask);
+            x->requestor = None;
+        }
+        XFlush(dpy);
+        return true;
+    }
+    return false;
+}
+
+/* Drop transfers reading from data before the buffer is freed. */
+static void incr_cancel(const char *data) {
+    for (int i = 0; i < INCR_MAX_XFERS; i++) {
+        if (incr_xfers[i].requestor != None && incr_xfers[i].data == data)
+            incr_xfers[i].requestor = None;
+    }
+}
+
+/* A paste requestor may destroy its window mid-transfer; the resulting
+   BadWindow from our next ChangeProperty must not take the default Xlib
+   handler's exit() path and kill the daemon.  Other errors still do. */
+static int (*prev_x_error_handler)(Display *, XErrorEvent *) = NULL;
+static int x_error_handler(Display *d, XErrorEvent *e) {
+    if (e->error_code == BadWindow) return 0;
+    return prev_x_error_handler ? prev_x_error_handler(d, e) : 0;
+}
 
 /* Respond to a SelectionRequest event.
  * TARGETS: advertise supported formats so requestors can negotiate.
- * UTF8_STRING / XA_STRING: write text into the requestor's property and
+ * UTF8_STRING / XA_STRING: write text into the requestor's property (or
+ *   start an INCR transfer when it does not fit in one request) and
  *   set selection_request_received to prevent idle timeout. */
 static int handle_selection_request(XSelectionRequestEvent *req,
                                      const char *data, size_t data_len) {
@@ -360,10 +577,15 @@ static int handle_selection_request(XSelectionRequestEvent *req,
                         (unsigned char *)targets, 3);
         response.xselection.property = req->property;
     } else if (req->target == xa_utf8_string || req->target == XA_STRING) {
-        XChangeProperty(dpy, req->requestor, req->property,
-                        req->target, 8, PropModeReplace,
-                        (unsigned char *)data, data_len);
-        response.xselection.property = req->property;
+        if (data_len > incr_chunk_size()) {
+            if (incr_start(req, data, data_len))
+                response.xselection.property = req->property;
+        } else {
+            XChangeProperty(dpy, req->requestor, req->property,
+                            req->target, 8, PropModeReplace,
+                            (unsigned char *)data, data_len);
+            response.xselection.property = req->property;
+        }
         selection_request_received = true;
     }
 
@@ -372,10 +594,12 @@ static int handle_selection_request(XSelectionRequestEvent *req,
     return 0;
 }
 
-/* Set stdin as the clipboard and serve paste requests from the background.
- * Forks a background child that loops serving SelectionRequest events;
- * the parent exits immediately so the shell is not blocked. */
-static int run_copy_clipboard(void) {
+/* Set stdin as the clipboard.  When a daemon is listening on the cache
+ * directory's socket the text is handed to it (SET) and served from its
+ * persistent connection; nothing is forked.  Otherwise this forks a
+ * background child that loops serving SelectionRequest events; the parent
+ * exits immediately so the shell is not blocked. */
+static int run_copy_clipboard(const char *cache_dir_arg) {
     size_t data_len = 0;
     char *data = read_all_stdin(&data_len);
     if (!data || data_len == 0) {
@@ -383,6 +607,12 @@ static int run_copy_clipboard(void) {
         return 1;
     }
 
+    if (resolve_cache_dir(cache_dir_arg) == 0 &&
+        sock_client_request("SET", data, data_len, NULL, NULL) == 0) {
+        free(data);
+        return 0;
+    }
+
     Window w = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
     XSetSelectionOwner(dpy, xa_clipboard, w, CurrentTime);
 
@@ -428,6 +658,8 @@ static int run_copy_clipboard(void) {
 
             if (ev.type == SelectionRequest) {
                 handle_selection_request(&ev.xselectionrequest, data, data_len);
+            } else if (ev.type == PropertyNotify) {
+                incr_handle_property(&ev.xproperty);
             } else if (ev.type == SelectionClear) {
                 running = 0;
                 break;
@@ -465,6 +697,91 @@ static int run_clear_primary(void) {
     return 0;
 }
 
+/* ------------------------------------------------------------------ */
+/*  Daemon socket API                                                 */
+/* ------------------------------------------------------------------ */
+/* The daemon listens on SOCK_FILE so the shell can read and write the
+ * clipboard over the daemon's existing X connection instead of fork+exec'ing
+ * this binary (and re-opening the display, re-interning atoms) per paste.
+ * One request per connection:
+ *   request:   "<VERB> <len>\n" followed by <len> payload bytes
+ *   response:  "OK <len>\n" followed by <len> payload bytes, or "ERR\n"
+ * Verbs: GET (clipboard text), SET (own CLIPBOARD with the payload),
+ *        CLEAR (clear PRIMARY), OSC52 (payload "<frame>\n<text>": the
+ *        OSC 52 sequence for the shell's tty). */
+
+/* Take CLIPBOARD ownership with the daemon's persistent clip_win.  On
+   success the buffer is adopted (the previous one is freed); on failure
+   the caller's buffer is freed. */
+static bool daemon_set_clipboard(char *data, size_t len) {
+    if (clip_win == None)
+        clip_win = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
+    XSetSelectionOwner(dpy, xa_clipboard, clip_win, CurrentTime);
+    if (XGetSelectionOwner(dpy, xa_clipboard) != clip_win) {
+        free(data);
+        return false;
+    }
+    XFlush(dpy);
+    incr_cancel(clip_data);
+    free(clip_data);
+    clip_data = data;
+    clip_data_len = len;
+    return true;
+}
+
+/* Accept one client on the listening socket and serve its request. */
+static void handle_sock_request(int listen_fd) {
+    int cfd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (cfd < 0) return;
+
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 500000 };
+    setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    char verb[16];
+    char *payload = NULL;
+    size_t payload_len = 0;
+    if (sock_read_request(cfd, verb, sizeof(verb), &payload, &payload_len) != 0) {
+        sock_reply(cfd, false, NULL, 0);
+        close(cfd);
+        return;
+    }
+
+    if (strcmp(verb, "GET") == 0) {
+        if (clip_data) {
+            /* We are the owner — converting to ourselves would stall this
+               loop until the 500 ms timeout, so answer from the buffer. */
+            sock_reply(cfd, true, clip_data, clip_data_len);
+        } else {
+            size_t len = 0;
+            char *data = get_selection(xa_clipboard, &len);
+            sock_reply(cfd, true, data, data ? len : 0);
+            scratch_free(data);
+        }
+    } else if (strcmp(verb, "SET") == 0) {
+        /* daemon_set_clipboard() adopts or frees the payload. */
+        bool ok = payload && daemon_set_clipboard(payload, payload_len);
+        payload = NULL;
+        sock_reply(cfd, ok, NULL, 0);
+    } else if (strcmp(verb, "CLEAR") == 0) {
+        /* The resulting XFixes notification writes the empty cache entry. */
+        XSetSelectionOwner(dpy, xa_primary, None, CurrentTime);
+        XFlush(dpy);
+        sock_reply(cfd, true, NULL, 0);
+    } else if (strcmp(verb, "STATS") == 0) {
+        char buf[MET_TEXT_MAX];
+        size_t n = met_format(buf, sizeof(buf));
+        sock_reply(cfd, true, buf, n);
+    } else if (strcmp(verb, "OSC52") == 0) {
+        osc52_sock_reply(cfd, payload, payload_len);
+    } else {
+        sock_reply(cfd, false, NULL, 0);
+    }
+
+    free(payload);
+    close(cfd);
+}
+
 /* Daemon mode: set up cache, daemonise, subscribe to XFixes PRIMARY
    owner-change events, and enter the poll-based event loop writing
    selection changes to cache until SIGTERM. */
@@ -480,6 +797,13 @@ static int run_daemon(const char *cache_dir_arg) {
     seq_counter = (unsigned long)time(NULL);
     write_primary("", 0, seq_counter);
 
+    /* Opt-in event trace (ZES_TRACE), opened while the shell's working
+       directory is still ours. */
+    trace_open();
+
+    /* Keep the shell's readiness pipe across daemon(); see ready_notify(). */
+    ready_fd_take();
+
     if (daemon(0, 0) != 0) {
         perror("daemon");
         return 1;
@@ -488,23 +812,35 @@ static int run_daemon(const char *cache_dir_arg) {
     FILE *f = fopen(pid_path, "w");
     if (f) { fprintf(f, "%d\n", getpid()); fclose(f); }
 
+    if (pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        unlink(pid_path);
+        return 1;
+    }
     signal(SIGTERM, signal_handler);
     signal(SIGINT, signal_handler);
     signal(SIGHUP, signal_handler);
+    signal(SIGUSR1, met_signal_handler);
+    met_start_us = monotonic_us();
 
     /* Open persistent fds for write_primary() hot path */
     fd_primary = open(primary_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
     fd_seq     = open(seq_path,    O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
 
+    /* Create a persistent window for selection conversion requests.
+       Reused by get_primary_selection() and get_selection() to avoid
+       per-event XCreateSimpleWindow/XDestroyWindow round-trips. */
+    daemon_win = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
+
+    int rc = 0, sock_fd = -1;
+
     /* XFixes is required for owner-change notifications.  Failure here
        typically means XWayland is not running, in which case the Wayland
        native agent should be used instead. */
     int xfixes_event_base, xfixes_error_base;
     if (!XFixesQueryExtension(dpy, &xfixes_event_base, &xfixes_error_base)) {
         fprintf(stderr, "XFixes extension not available (XWayland not running?)\n");
-        if (fd_primary >= 0) { close(fd_primary); fd_primary = -1; }
-        if (fd_seq     >= 0) { close(fd_seq);     fd_seq     = -1; }
-        return 1;
+        rc = 1;
+        goto cleanup;
     }
 
     /* Subscribe to PRIMARY owner-change events only; content-change polling
@@ -513,40 +849,84 @@ static int run_daemon(const char *cache_dir_arg) {
                                 XFixesSetSelectionOwnerNotifyMask);
     XFlush(dpy);
 
+    /* Request socket for the shell's GET/SET/CLEAR calls.  -1 is not
+       fatal: the shell falls back to spawning the agent per call. */
+    sock_fd = sock_listen();
+
     /* Populate the cache immediately with any pre-existing selection. */
     check_and_update_primary();
+    /* First selection published and socket listening: release the shell. */
+    ready_notify();
 
     /* poll()-based event loop: XNextEvent() blocks indefinitely and with
-       glibc's signal() (SA_RESTART), SIGTERM cannot interrupt it.  Using
-       poll() with a 1-second timeout ensures clean shutdown within 1s.
-       XPending() drains Xlib's internal buffer before we call poll() again
-       — data may have arrived during a previous read() that filled Xlib's
-       buffer with multiple events. */
+       glibc's signal() (SA_RESTART), SIGTERM cannot interrupt it.  poll()
+       blocks with no timeout — the daemon does not wake while idle — and
+       the signal handlers reach it through wake_pipe.  XPending() drains
+       Xlib's queue before every poll(): events it already buffered (e.g.
+       during a socket request's conversion) do not make xfd readable. */
     {
         int xfd = XConnectionNumber(dpy);
         while (running) {
-            struct pollfd pfd = { .fd = xfd, .events = POLLIN };
-            int ret = poll(&pfd, 1, 1000);
-            if (ret < 0 && errno != EINTR) break;
             while (XPending(dpy) > 0) {
                 XEvent ev;
                 XNextEvent(dpy, &ev);
                 if (ev.type == xfixes_event_base + XFixesSelectionNotify) {
                     XFixesSelectionNotifyEvent *sev = (XFixesSelectionNotifyEvent *)&ev;
                     if (sev->selection == xa_primary) {
+                        trace_record(TRACE_NOTIFY, NULL, NULL, 0, 0, 0);
                         check_and_update_primary();
                     }
+                } else if (ev.type == SelectionRequest && clip_data &&
+                           ev.xselectionrequest.owner == clip_win) {
+                    handle_selection_request(&ev.xselectionrequest,
+                                             clip_data, clip_data_len);
+                } else if (ev.type == PropertyNotify) {
+                    incr_handle_property(&ev.xproperty);
+                } else if (ev.type == SelectionClear &&
+                           ev.xselectionclear.window == clip_win) {
+                    /* Another client copied — stop serving our buffer. */
+                    incr_cancel(clip_data);
+                    free(clip_data);
+                    clip_data = NULL;
+                    clip_data_len = 0;
                 }
             }
+            if (!running) break;
+
+            struct pollfd pfds[3] = {
+                { .fd = xfd,          .events = POLLIN },
+                { .fd = sock_fd,      .events = POLLIN },
+                { .fd = wake_pipe[0], .events = POLLIN },
+            };
+            int ret = poll(pfds, 3, -1);
+            if (ret > 0 && pfds[2].revents)
+                wake_drain();
+            if (met_dump_pending) {
+                met_dump_pending = 0;
+                met_dump_file();
+            }
+            if (ret < 0 && errno != EINTR) break;
+            if (ret > 0 && (pfds[1].revents & POLLIN))
+                handle_sock_request(sock_fd);
         }
     }
 
+cleanup:
+    if (sock_fd >= 0) { close(sock_fd); unlink(sock_path); }
+    if (clip_win != None) { XDestroyWindow(dpy, clip_win); clip_win = None; }
+    if (daemon_win != None) { XDestroyWindow(dpy, daemon_win); daemon_win = None; }
+    free(clip_data);
+    clip_data = NULL;
     if (fd_primary >= 0) { close(fd_primary); fd_primary = -1; }
     if (fd_seq     >= 0) { close(fd_seq);     fd_seq     = -1; }
+    trace_close();
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
     unlink(primary_path);
     unlink(seq_path);
     unlink(pid_path);
-    return 0;
+    unlink(metrics_path);
+    return rc;
 }
 
 /* Entry point — parse argv, open X11 display (XWayland), intern atoms,
@@ -558,6 +938,7 @@ static int run_daemon(const char *cache_dir_arg) {
  *   --get-clipboard    Print clipboard (CLIPBOARD) text and exit.
  *   --copy-clipboard   Read stdin, take clipboard ownership, serve paste requests.
  *   --clear-primary    Clear PRIMARY by setting its owner to None.
+ *   --stats            Print the running daemon's metrics (no X connection).
  *   --help / -h        Print usage to stderr and exit.
  *
  * A positional non-flag argument sets cache_dir (used by daemon mode). */
@@ -567,6 +948,8 @@ int main(int argc, char *argv[]) {
     bool get_clipboard = false;
     bool copy_clipboard = false;
     bool clear_primary = false;
+    bool stats = false;
+    bool osc52 = false;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--oneshot") == 0)
@@ -577,15 +960,21 @@ int main(int argc, char *argv[]) {
             copy_clipboard = true;
         else if (strcmp(argv[i], "--clear-primary") == 0)
             clear_primary = true;
+        else if (strcmp(argv[i], "--stats") == 0)
+            stats = true;
+        else if (strcmp(argv[i], "--osc52") == 0)
+            osc52 = true;
         else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             fprintf(stderr,
-                "Usage: %s [cache_dir] [--oneshot|--get-clipboard|--copy-clipboard|--clear-primary]\n"
+                "Usage: %s [cache_dir] [--oneshot|--get-clipboard|--copy-clipboard|--clear-primary|--stats|--osc52]\n"
                 "XWayland selection monitor and clipboard helper for zsh-edit-select.\n\n"
                 "  (default)         Daemon mode — monitor PRIMARY selection\n"
                 "  --oneshot         Print current PRIMARY and exit\n"
                 "  --get-clipboard   Print clipboard contents and exit\n"
                 "  --copy-clipboard  Read stdin, set as clipboard\n"
-                "  --clear-primary   Clear PRIMARY selection\n",
+                "  --clear-primary   Clear PRIMARY selection\n"
+                "  --stats           Print the running daemon's metrics\n"
+                "  --osc52           Read stdin, write it to the terminal as OSC 52\n",
                 argv[0]);
             return 0;
         } else {
@@ -593,18 +982,28 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if (stats)
+        return run_stats(cache_dir_arg);
+    if (osc52)
+        return run_osc52();
+
     dpy = XOpenDisplay(NULL);
     if (!dpy) {
         fprintf(stderr, "Cannot open X11 display (XWayland not available?)\n");
         return 1;
     }
 
+    prev_x_error_handler = XSetErrorHandler(x_error_handler);
+
     /* Intern the standard X11 selection atoms for conversion requests. */
     root = DefaultRootWindow(dpy);
     xa_primary = XInternAtom(dpy, "PRIMARY", False);
     xa_clipboard = XInternAtom(dpy, "CLIPBOARD", False);
     xa_utf8_string = XInternAtom(dpy, "UTF8_STRING", False);
     xa_targets = XInternAtom(dpy, "TARGETS", False);
+    xa_incr = XInternAtom(dpy, "INCR", False);
+    xa_text_plain_utf8 = XInternAtom(dpy, "text/plain;charset=utf-8", False);
+    xa_text = XInternAtom(dpy, "TEXT", False);
 
     int ret = 0;
     if (oneshot)
@@ -612,7 +1011,7 @@ int main(int argc, char *argv[]) {
     else if (get_clipboard)
         ret = run_get_clipboard();
     else if (copy_clipboard)
-        ret = run_copy_clipboard();
+        ret = run_copy_clipboard(cache_dir_arg);
     else if (clear_primary)
         ret = run_clear_primary();
     else
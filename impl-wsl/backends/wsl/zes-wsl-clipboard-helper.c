@@ -9,6 +9,9 @@
 // Modes (first matching flag wins):
 //   --daemon          Monitor clipboard changes via AddClipboardFormatListener,
 //                     write events to stdout using a length-prefixed protocol.
+//                     With --framed, events use fixed binary headers instead
+//                     of text lines, and GET/SET command frames are read
+//                     from stdin and answered on stdout.
 //   --get-clipboard   Print clipboard text (UTF-8) to stdout and exit.
 //   --set-clipboard   Read stdin (UTF-8), place on clipboard, and exit.
 //   --get-seq         Print GetClipboardSequenceNumber() and exit.
@@ -33,6 +36,11 @@
 #include <stdarg.h>
 #include <io.h>
 #include <fcntl.h>
+#include <stdint.h>
+#include <wchar.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /* Safety cap on clipboard reads. */
 #define MAX_CLIPBOARD_SIZE (4 * 1024 * 1024)
@@ -46,55 +54,172 @@
 /* Timer ID for periodic heartbeats / parent liveness checks. */
 #define TIMER_ID_HEARTBEAT 1
 
+/* Framed protocol (--daemon --framed): a fixed 16-byte header, sent as the
+   raw struct, followed by len payload bytes.  Must match
+   zes-wsl-selection-agent.c. */
+#define FRAME_MAGIC     0x3153455AU  /* "ZES1" */
+#define FRAME_READY     1
+#define FRAME_CLIPBOARD 2            /* payload: UTF-8 text */
+#define FRAME_EMPTY     3            /* clipboard empty or non-text */
+#define FRAME_HEARTBEAT 4
+#define FRAME_CMD_GET   5            /* agent → helper: read clipboard */
+#define FRAME_CMD_SET   6            /* agent → helper: payload = text */
+#define FRAME_REPLY     7            /* helper → agent: seq = command id */
+#define FRAME_ERROR     8            /* helper → agent: command failed */
+
+struct helper_frame {
+    uint32_t magic;
+    uint32_t type;
+    uint32_t seq;   /* GetClipboardSequenceNumber() */
+    uint32_t len;   /* payload bytes that follow */
+};
+
+/* Payloads up to this size are sent in the same WriteFile as their header. */
+#define FRAME_INLINE_MAX 65536
+
+/* Posted by the stdin reader thread; lParam is a struct helper_cmd * that
+   the window procedure frees. */
+#define WM_ZES_COMMAND (WM_APP + 1)
+
+struct helper_cmd {
+    uint32_t type;
+    uint32_t id;
+    size_t len;
+    char data[];
+};
+
 /* The message-only window handle used by --daemon mode. */
 static HWND g_hwnd = NULL;
 
+/* Set by --framed: --daemon writes frames instead of text lines. */
+static int g_framed = 0;
+
 /* Shared flag used by the low-level mouse hook wait path. */
 static volatile LONG g_physical_left_up_seen = 0;
 
 /* ------------------------------------------------------------------ */
-/*  Clipboard read: CF_UNICODETEXT → UTF-8 malloc'd buffer.           */
+/*  Clipboard read: CF_UNICODETEXT → UTF-8 reusable buffer.           */
 /* ------------------------------------------------------------------ */
-static char *read_clipboard_utf8(size_t *out_len) {
-    *out_len = 0;
-
-    if (!OpenClipboard(NULL))
-        return NULL;
-
-    HANDLE h = GetClipboardData(CF_UNICODETEXT);
-    if (!h) {
-        CloseClipboard();
-        return NULL;
+/* The converted text lives in one buffer that only grows, so --daemon does
+   not malloc/free per WM_CLIPBOARDUPDATE.  g_utf8_seq records which
+   clipboard sequence number the buffer holds; a read at the same sequence
+   number (a repeated notification, a GET command right after an event)
+   returns it without opening the clipboard. */
+static char *g_utf8 = NULL;
+static size_t g_utf8_cap = 0;
+static size_t g_utf8_len = 0;
+static DWORD g_utf8_seq = 0;
+static int g_utf8_valid = 0;   /* 0: nothing cached yet */
+static int g_utf8_text = 0;    /* cached sequence number had text */
+
+/* Encode n UTF-16 code units as UTF-8 into dst (at least 3 * n bytes) in
+   one pass.  A paired surrogate becomes one 4-byte sequence; an unpaired
+   one becomes U+FFFD, as WideCharToMultiByte does.  Returns the byte
+   count. */
+static size_t utf16_to_utf8(const wchar_t *src, size_t n, char *dst) {
+    unsigned char *o = (unsigned char *)dst;
+    size_t i = 0;
+    while (i < n) {
+#if defined(__SSE2__)
+        /* ASCII fast path: 16 code units per step while none is >= 0x80;
+           packus narrows the two halves straight into 16 output bytes. */
+        while (n - i >= 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 8));
+            __m128i hi = _mm_and_si128(_mm_or_si128(a, b),
+                                       _mm_set1_epi16((short)0xFF80));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(hi, _mm_setzero_si128())) != 0xFFFF)
+                break;
+            _mm_storeu_si128((__m128i *)o, _mm_packus_epi16(a, b));
+            i += 16;
+            o += 16;
+        }
+        if (i == n)
+            break;
+#endif
+        uint32_t c = (uint16_t)src[i++];
+        if (c < 0x80) {
+            *o++ = (unsigned char)c;
+        } else if (c < 0x800) {
+            *o++ = (unsigned char)(0xC0 | (c >> 6));
+            *o++ = (unsigned char)(0x80 | (c & 0x3F));
+        } else {
+            if (c >= 0xD800 && c <= 0xDBFF && i < n &&
+                (uint16_t)src[i] >= 0xDC00 && (uint16_t)src[i] <= 0xDFFF) {
+                c = 0x10000 + ((c - 0xD800) << 10) + ((uint16_t)src[i++] - 0xDC00);
+                *o++ = (unsigned char)(0xF0 | (c >> 18));
+                *o++ = (unsigned char)(0x80 | ((c >> 12) & 0x3F));
+                *o++ = (unsigned char)(0x80 | ((c >> 6) & 0x3F));
+                *o++ = (unsigned char)(0x80 | (c & 0x3F));
+                continue;
+            }
+            if (c >= 0xD800 && c <= 0xDFFF)
+                c = 0xFFFD;
+            *o++ = (unsigned char)(0xE0 | (c >> 12));
+            *o++ = (unsigned char)(0x80 | ((c >> 6) & 0x3F));
+            *o++ = (unsigned char)(0x80 | (c & 0x3F));
+        }
     }
+    return (size_t)(o - (unsigned char *)dst);
+}
 
-    const wchar_t *wstr = (const wchar_t *)GlobalLock(h);
-    if (!wstr) {
-        CloseClipboard();
-        return NULL;
-    }
+/* Return the clipboard text as UTF-8, or NULL when the clipboard holds no
+   text.  The buffer belongs to this module and stays valid until the next
+   call; *out_seq (if non-NULL) gets the sequence number it reflects. */
+static const char *read_clipboard_utf8(size_t *out_len, DWORD *out_seq) {
+    *out_len = 0;
 
-    int needed = WideCharToMultiByte(CP_UTF8, 0, wstr, -1, NULL, 0, NULL, NULL);
-    if (needed <= 0) {
-        GlobalUnlock(h);
-        CloseClipboard();
-        return NULL;
-    }
+    DWORD seq = GetClipboardSequenceNumber();
+    if (!g_utf8_valid || seq != g_utf8_seq) {
+        g_utf8_valid = 0;
+        g_utf8_text = 0;
+        g_utf8_len = 0;
 
-    char *buf = (char *)malloc((size_t)needed);
-    if (!buf) {
-        GlobalUnlock(h);
-        CloseClipboard();
-        return NULL;
+        /* Non-text formats (images, files) are reported as empty without
+           opening the clipboard. */
+        if (IsClipboardFormatAvailable(CF_UNICODETEXT)) {
+            if (!OpenClipboard(NULL))
+                return NULL;
+            /* Re-read under the open clipboard: nobody can change it now,
+               so this is the number that matches the data. */
+            seq = GetClipboardSequenceNumber();
+
+            HANDLE h = GetClipboardData(CF_UNICODETEXT);
+            const wchar_t *wstr = h ? (const wchar_t *)GlobalLock(h) : NULL;
+            if (wstr) {
+                size_t n = wcsnlen(wstr, GlobalSize(h) / sizeof(wchar_t));
+                size_t need = 3 * n + 1;
+                if (need > g_utf8_cap) {
+                    size_t cap = g_utf8_cap ? g_utf8_cap : 4096;
+                    while (cap < need)
+                        cap *= 2;
+                    char *nb = (char *)realloc(g_utf8, cap);
+                    if (nb) {
+                        g_utf8 = nb;
+                        g_utf8_cap = cap;
+                    }
+                }
+                if (need <= g_utf8_cap) {
+                    g_utf8_len = utf16_to_utf8(wstr, n, g_utf8);
+                    g_utf8[g_utf8_len] = '\0';
+                    g_utf8_text = 1;
+                }
+                GlobalUnlock(h);
+            }
+            CloseClipboard();
+            if (!g_utf8_text)
+                return NULL;   /* transient failure: do not cache */
+        }
+        g_utf8_seq = seq;
+        g_utf8_valid = 1;
     }
 
-    WideCharToMultiByte(CP_UTF8, 0, wstr, -1, buf, needed, NULL, NULL);
-    GlobalUnlock(h);
-    CloseClipboard();
-
-    /* needed includes the null terminator; the caller wants the byte count
-       without the trailing NUL. */
-    *out_len = (size_t)(needed - 1);
-    return buf;
+    if (out_seq)
+        *out_seq = g_utf8_seq;
+    if (!g_utf8_text)
+        return NULL;
+    *out_len = g_utf8_len;
+    return g_utf8;
 }
 
 /* ------------------------------------------------------------------ */
@@ -224,6 +349,28 @@ static int write_bytes(const char *data, size_t len) {
     return 0;
 }
 
+/* Write one frame.  Small payloads share a single WriteFile with the
+   header — each write is a round trip across the WSL interop pipe.
+   Returns 0 on success, -1 if the pipe broke. */
+static int write_frame(uint32_t type, DWORD seq, const char *data, size_t len) {
+    static char buf[sizeof(struct helper_frame) + FRAME_INLINE_MAX];
+    struct helper_frame fr;
+    fr.magic = FRAME_MAGIC;
+    fr.type = type;
+    fr.seq = (uint32_t)seq;
+    fr.len = (uint32_t)len;
+
+    memcpy(buf, &fr, sizeof(fr));
+    if (len <= FRAME_INLINE_MAX) {
+        if (len > 0)
+            memcpy(buf + sizeof(fr), data, len);
+        return write_bytes(buf, sizeof(fr) + len);
+    }
+    if (write_bytes(buf, sizeof(fr)) < 0)
+        return -1;
+    return write_bytes(data, len);
+}
+
 /* ------------------------------------------------------------------ */
 /*  --daemon mode: event-driven clipboard monitoring.                 */
 /*                                                                    */
@@ -239,44 +386,126 @@ static int write_bytes(const char *data, size_t len) {
 /*    <len bytes of UTF-8 text>   — raw content                       */
 /*    EMPTY <seq>\n               — clipboard empty or non-text       */
 /*    HEARTBEAT\n                 — periodic liveness signal           */
+/*                                                                    */
+/*  With --framed the same events are sent as frames (READY,          */
+/*  CLIPBOARD, EMPTY, HEARTBEAT) so the agent parses fixed headers    */
+/*  from a buffered read instead of scanning for newlines.            */
+/*                                                                    */
+/*  A framed helper also takes commands on stdin: CMD_GET and CMD_SET */
+/*  frames (seq = command id) are answered with a REPLY frame, the    */
+/*  clipboard text for GET, or ERROR.  A reader thread hands each     */
+/*  command to the window thread, which owns all clipboard access.    */
 /* ------------------------------------------------------------------ */
 
+/* Read exactly len bytes from stdin.  Returns 0 on success, -1 on EOF. */
+static int read_stdin_exact(HANDLE hIn, char *buf, size_t len) {
+    size_t off = 0;
+    while (off < len) {
+        DWORD chunk = (DWORD)((len - off > 65536) ? 65536 : (len - off));
+        DWORD got = 0;
+        if (!ReadFile(hIn, buf + off, chunk, &got, NULL) || got == 0)
+            return -1;
+        off += got;
+    }
+    return 0;
+}
+
+/* Stdin command reader (framed daemon only).  Blocks in ReadFile and
+   posts every complete command to g_hwnd.  EOF or a malformed frame means
+   the agent went away: the helper quits, like on a broken stdout. */
+static DWORD WINAPI command_reader_thread(LPVOID arg) {
+    HANDLE hIn = (HANDLE)arg;
+    for (;;) {
+        struct helper_frame fr;
+        if (read_stdin_exact(hIn, (char *)&fr, sizeof(fr)) < 0 ||
+            fr.magic != FRAME_MAGIC || fr.len > MAX_CLIPBOARD_SIZE)
+            break;
+
+        struct helper_cmd *cmd = malloc(sizeof(*cmd) + fr.len + 1);
+        if (!cmd)
+            break;
+        cmd->type = fr.type;
+        cmd->id = fr.seq;
+        cmd->len = fr.len;
+        if (read_stdin_exact(hIn, cmd->data, fr.len) < 0) {
+            free(cmd);
+            break;
+        }
+        cmd->data[fr.len] = '\0';
+        if (!PostMessageA(g_hwnd, WM_ZES_COMMAND, 0, (LPARAM)cmd)) {
+            free(cmd);
+            break;
+        }
+    }
+    PostMessageA(g_hwnd, WM_CLOSE, 0, 0);
+    return 0;
+}
+
+/* Answer one command frame on stdout. */
+static int handle_command(const struct helper_cmd *cmd) {
+    if (cmd->type == FRAME_CMD_GET) {
+        size_t len = 0;
+        const char *content = read_clipboard_utf8(&len, NULL);
+        return write_frame(FRAME_REPLY, cmd->id, content, content ? len : 0);
+    }
+    if (cmd->type == FRAME_CMD_SET &&
+        set_clipboard_utf8(cmd->data, cmd->len))
+        return write_frame(FRAME_REPLY, cmd->id, NULL, 0);
+    return write_frame(FRAME_ERROR, cmd->id, NULL, 0);
+}
+
 static LRESULT CALLBACK ClipboardWndProc(HWND hwnd, UINT msg,
                                          WPARAM wParam, LPARAM lParam) {
     if (msg == WM_CLIPBOARDUPDATE) {
+        /* Sequence number of the last event sent; a repeated notification
+           for the same clipboard contents is not reported again. */
+        static DWORD last_sent_seq = 0;
+        static int sent_any = 0;
+
         DWORD seq = GetClipboardSequenceNumber();
-        size_t len = 0;
-        char *content = read_clipboard_utf8(&len);
+        if (sent_any && seq == last_sent_seq)
+            return 0;
 
-        if (content && len > 0) {
-            /* CLIPBOARD <seq> <len>\n<content> */
-            if (write_line("CLIPBOARD %lu %zu\n", (unsigned long)seq, len) < 0) {
+        size_t len = 0;
+        const char *content = read_clipboard_utf8(&len, &seq);
+        if (sent_any && seq == last_sent_seq)
+            return 0;
+        last_sent_seq = seq;
+        sent_any = 1;
+
+        if (g_framed) {
+            int rc = (content && len > 0)
+                         ? write_frame(FRAME_CLIPBOARD, seq, content, len)
+                         : write_frame(FRAME_EMPTY, seq, NULL, 0);
+            if (rc < 0)
                 PostQuitMessage(0);
-                free(content);
-                return 0;
-            }
-            if (write_bytes(content, len) < 0) {
+        } else if (content && len > 0) {
+            /* CLIPBOARD <seq> <len>\n<content> */
+            if (write_line("CLIPBOARD %lu %zu\n", (unsigned long)seq, len) < 0 ||
+                write_bytes(content, len) < 0)
                 PostQuitMessage(0);
-                free(content);
-                return 0;
-            }
         } else {
             /* EMPTY <seq>\n */
-            if (write_line("EMPTY %lu\n", (unsigned long)seq) < 0) {
+            if (write_line("EMPTY %lu\n", (unsigned long)seq) < 0)
                 PostQuitMessage(0);
-                free(content);
-                return 0;
-            }
         }
+        return 0;
+    }
 
-        free(content);
+    if (msg == WM_ZES_COMMAND) {
+        struct helper_cmd *cmd = (struct helper_cmd *)lParam;
+        if (handle_command(cmd) < 0)
+            PostQuitMessage(0);
+        free(cmd);
         return 0;
     }
 
     if (msg == WM_TIMER && wParam == TIMER_ID_HEARTBEAT) {
         /* Periodic heartbeat: lets the Linux agent know we are alive,
            and detects a broken pipe (parent death) on write failure. */
-        if (write_line("HEARTBEAT\n") < 0)
+        int rc = g_framed ? write_frame(FRAME_HEARTBEAT, 0, NULL, 0)
+                          : write_line("HEARTBEAT\n");
+        if (rc < 0)
             PostQuitMessage(0);
         return 0;
     }
@@ -321,12 +550,23 @@ static int run_daemon(void) {
     SetTimer(g_hwnd, TIMER_ID_HEARTBEAT, HEARTBEAT_MS, NULL);
 
     /* Signal readiness to the Linux-side agent. */
-    if (write_line("READY\n") < 0) {
+    int rc = g_framed ? write_frame(FRAME_READY, 0, NULL, 0)
+                      : write_line("READY\n");
+    if (rc < 0) {
         RemoveClipboardFormatListener(g_hwnd);
         DestroyWindow(g_hwnd);
         return 1;
     }
 
+    /* Commands arrive on stdin only from an agent that asked for frames;
+       an older agent leaves stdin untouched. */
+    if (g_framed) {
+        HANDLE hThread = CreateThread(NULL, 0, command_reader_thread,
+                                      GetStdHandle(STD_INPUT_HANDLE), 0, NULL);
+        if (hThread)
+            CloseHandle(hThread);
+    }
+
     /* Win32 message loop — truly event-driven, zero CPU while idle. */
     MSG msg;
     while (GetMessageA(&msg, NULL, 0, 0) > 0) {
@@ -347,13 +587,11 @@ static int run_get_clipboard(void) {
     init_stdout();
 
     size_t len = 0;
-    char *data = read_clipboard_utf8(&len);
+    const char *data = read_clipboard_utf8(&len, NULL);
     if (data && len > 0) {
         fwrite(data, 1, len, stdout);
-        free(data);
         return 0;
     }
-    free(data);
     return 1;
 }
 
@@ -748,6 +986,8 @@ int main(int argc, char *argv[]) {
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--daemon") == 0)
             mode_daemon = 1;
+        else if (strcmp(argv[i], "--framed") == 0)
+            g_framed = 1;
         else if (strcmp(argv[i], "--get-clipboard") == 0)
             mode_get_clipboard = 1;
         else if (strcmp(argv[i], "--set-clipboard") == 0)
@@ -766,9 +1006,10 @@ int main(int argc, char *argv[]) {
             mode_handoff_scrollback_vscode_shift = 1;
         else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             fprintf(stderr,
-                "Usage: %s [--daemon|--get-clipboard|--set-clipboard|--get-seq|--inject-left-down|--inject-left-up|--wait-left-up|--handoff-scrollback|--handoff-scrollback-vscode-shift]\n"
+                "Usage: %s [--daemon [--framed]|--get-clipboard|--set-clipboard|--get-seq|--inject-left-down|--inject-left-up|--wait-left-up|--handoff-scrollback|--handoff-scrollback-vscode-shift]\n"
                 "Windows clipboard helper for zsh-edit-select WSL backend.\n\n"
                 "  --daemon          Monitor clipboard (event-driven, stdout protocol)\n"
+                "  --framed          With --daemon: binary framed protocol\n"
                 "  --get-clipboard   Print clipboard text to stdout\n"
                 "  --set-clipboard   Read stdin, set as clipboard\n"
                 "  --get-seq         Print clipboard sequence number\n"
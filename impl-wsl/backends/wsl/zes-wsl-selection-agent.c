@@ -4,22 +4,43 @@
 // Linux-side clipboard agent for zsh-edit-select WSL backend.
 // Communicates with zes-wsl-clipboard-helper.exe (Windows side) via pipes.
 //
-// Compile: gcc -O3 zes-wsl-selection-agent.c -o zes-wsl-selection-agent
-// Usage:   zes-wsl-selection-agent [cache_dir] [--oneshot|--get-clipboard|--copy-clipboard|--clear-primary]
+// Compile: gcc -O3 -I../../../common zes-wsl-selection-agent.c -o zes-wsl-selection-agent
+// Usage:   zes-wsl-selection-agent [cache_dir] [--oneshot|--get-clipboard|--copy-clipboard|--clear-primary|--stats|--osc52]
 //
-// In daemon mode the agent launches the Windows helper (.exe) with --daemon,
-// reads its stdout protocol, and writes cache files using the same
+// In daemon mode the agent launches the Windows helper (.exe) with
+// --daemon --framed, reads its binary framed stdout protocol (falling back
+// to the line protocol for helpers built without --framed), and writes
+// cache files using the same
 // pwrite+ftruncate protocol as the X11 and Wayland agents.  Cache files
 // sit on native Linux tmpfs for fast zstat from the shell.
+//
+// The daemon also listens on <cache_dir>/agent.sock and answers GET/SET/CLEAR
+// requests, so the shell can paste and copy without spawning this agent and
+// a fresh Windows helper per call.  With a framed helper, SET (and a GET
+// before the first clipboard event) are forwarded as commands on the
+// resident helper's stdin.  The short-lived modes, given <cache_dir>, ask
+// that daemon first and only launch a helper of their own without one.
+//
+// SIGUSR1 makes the daemon write its metrics to <cache_dir>/agent.metrics;
+// --stats [cache_dir] triggers that and prints the result.
+//
+// --osc52 writes stdin to the terminal as an OSC 52 sequence without the
+// Windows helper, for SSH sessions; the daemon's OSC52 verb returns the
+// same tmux/screen-framed sequence to the shell.
 
 #define _GNU_SOURCE
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -27,81 +48,92 @@
 #include <time.h>
 #include <stdbool.h>
 #include <limits.h>
+#include <stdint.h>
 
-/* Cache-directory filenames and safety cap.
-   PRIMARY_FILE / SEQ_FILE: selected text and change counter.
-   PID_FILE: daemon PID for liveness checks.
+/* Safety cap (cache-file names live in zes-agent-core.h).
    MAX_CLIPBOARD_SIZE: 4 MB cap on clipboard reads. */
-#define PRIMARY_FILE "primary"
-#define SEQ_FILE "seq"
-#define PID_FILE "agent.pid"
 #define MAX_CLIPBOARD_SIZE (4 * 1024 * 1024)
 
+/* Shared daemon core: cache layout, publish, metrics and the socket API.
+   "wait" in the metrics is payload transfer from the Windows helper, and
+   command round trips. */
+#define MET_AGENT "wsl"
+#define ZES_MAX_PAYLOAD MAX_CLIPBOARD_SIZE
+#include "zes-agent-core.h"
+
 /* Name of the Windows helper binary (same directory as this agent). */
 #define HELPER_NAME "zes-wsl-clipboard-helper.exe"
 
-static volatile sig_atomic_t running = 1;
-static char cache_dir[512];
-static char primary_path[560];
-static char seq_path[560];
-static char pid_path[560];
+/* Framed helper protocol (helper --daemon --framed).  Every message is a
+   fixed 16-byte header followed by len payload bytes.  Both ends run on
+   the same little-endian machine, so the header is sent as the raw struct.
+   Must match zes-wsl-clipboard-helper.c. */
+#define FRAME_MAGIC     0x3153455AU  /* "ZES1" */
+#define FRAME_READY     1
+#define FRAME_CLIPBOARD 2            /* payload: UTF-8 text */
+#define FRAME_EMPTY     3            /* clipboard empty or non-text */
+#define FRAME_HEARTBEAT 4
+#define FRAME_CMD_GET   5            /* agent → helper: read clipboard */
+#define FRAME_CMD_SET   6            /* agent → helper: payload = text */
+#define FRAME_REPLY     7            /* helper → agent: seq = command id */
+#define FRAME_ERROR     8            /* helper → agent: command failed */
+
+/* How long the daemon waits for the resident helper to answer a command;
+   below the shell's 2 s socket read timeout. */
+#define HELPER_REPLY_MS 1000
+
+struct helper_frame {
+    uint32_t magic;
+    uint32_t type;
+    uint32_t seq;   /* GetClipboardSequenceNumber() */
+    uint32_t len;   /* payload bytes that follow */
+};
+
+/* Read buffer for the helper's stdout.  Every read() on a WSL interop pipe
+   is a round trip to the Windows side, so headers and small payloads are
+   pulled in HELPER_BUF_SIZE chunks and parsed from memory. */
+#define HELPER_BUF_SIZE 65536
+
+struct helper_reader {
+    int fd;
+    size_t pos;
+    size_t end;
+    long long deadline_ms;   /* while a command waits: when its reply is due */
+    bool timed_out;          /* a read ran past deadline_ms mid-message */
+    char buf[HELPER_BUF_SIZE];
+};
+
 static char helper_path[560];
 
 /* Monotonically increasing counter written to SEQ_FILE; the shell polls
    its mtime to detect selection changes without reading content. */
 static unsigned long seq_counter = 0;
 
-/* Persistent fds for write_primary() daemon hot path.
-   Opened once after daemon() in run_daemon(); reused for all subsequent writes.
-   -1 = not yet open (pre-daemon initial write uses the open/write/close fallback). */
-static int fd_primary = -1;
-static int fd_seq     = -1;
-
 /* PID of the Windows helper child (daemon mode). */
 static pid_t helper_pid = -1;
 
-/* SIGTERM / SIGINT handler — sets the flag that exits the event loop. */
-static void signal_handler(int sig) {
-    (void)sig;
-    running = 0;
-}
-
-/* Resolve cache directory path (argument > XDG_RUNTIME_DIR > /dev/shm > HOME),
-   populate path globals, and create the directory.  Returns 0 on success. */
-static int ensure_cache_dir(const char *dir) {
-    if (dir && dir[0]) {
-        snprintf(cache_dir, sizeof(cache_dir), "%s", dir);
-    } else {
-        /* Cache location priority:
-           1. XDG_RUNTIME_DIR/<uid> — tmpfs, survives logout cleanup by PAM.
-           2. /dev/shm — in-memory tmpfs on Linux; fast for short-lived modes.
-           3. HOME/.cache — persistent fallback for non-standard environments. */
-        const char *runtime = getenv("XDG_RUNTIME_DIR");
-        if (runtime) {
-            snprintf(cache_dir, sizeof(cache_dir), "%s/zsh-edit-select-%d",
-                     runtime, (int)getuid());
-        } else if (access("/dev/shm", W_OK | X_OK) == 0) {
-            snprintf(cache_dir, sizeof(cache_dir),
-                     "/dev/shm/zsh-edit-select-%d", (int)getuid());
-        } else {
-            const char *home = getenv("HOME");
-            if (!home) return -1;
-            snprintf(cache_dir, sizeof(cache_dir),
-                     "%s/.cache/zsh-edit-select", home);
-        }
-    }
-
-    snprintf(primary_path, sizeof(primary_path), "%s/%s", cache_dir, PRIMARY_FILE);
-    snprintf(seq_path, sizeof(seq_path), "%s/%s", cache_dir, SEQ_FILE);
-    snprintf(pid_path, sizeof(pid_path), "%s/%s", cache_dir, PID_FILE);
-
-    struct stat st;
-    if (stat(cache_dir, &st) == -1) {
-        if (mkdir(cache_dir, 0700) == -1 && errno != EEXIST)
-            return -1;
-    }
-    return 0;
-}
+/* Clipboard text from the helper's last CLIPBOARD/EMPTY message (or the
+   last socket SET), served to GET requests.  have_last_clip stays false
+   until the first message so GET can tell "empty" from "unknown". */
+static char *last_clip = NULL;
+static size_t last_clip_len = 0;
+static bool have_last_clip = false;
+
+/* Reader on the daemon helper's stdout (daemon mode). */
+static struct helper_reader helper_rd = { .fd = -1 };
+
+/* Write end of the resident helper's stdin; -1 unless it speaks the
+   framed protocol (a line-protocol helper never reads commands). */
+static int helper_wfd = -1;
+
+/* Reply slot for the one command in flight (see helper_request()).
+   Replies whose id does not match — answers to a command that already
+   timed out — are dropped. */
+static uint32_t helper_cmd_id = 0;
+static bool helper_reply_done = true;
+static bool helper_reply_ok = false;
+static char *helper_reply_data = NULL;
+static size_t helper_reply_len = 0;
 
 /* Resolve the helper .exe path relative to this agent binary.
    argv0 is used to determine the directory. */
@@ -136,68 +168,33 @@ static int resolve_helper_path(const char *argv0) {
     return access(helper_path, X_OK) == 0 ? 0 : -1;
 }
 
-/* Write selection text to PRIMARY cache and the sequence number to SEQ.
-   Uses persistent fds in daemon mode, open/write/close otherwise. */
-static void write_primary(const char *data, size_t len, unsigned long seq) {
-    if (fd_primary >= 0) {
-        /* Persistent-fd hot path: seek to start, write new content, then
-           truncate to correct length.  ftruncate is mandatory — without it,
-           content that shrinks between events (e.g. "hello world" → "hi")
-           leaves stale bytes at the end that the shell reads as part of the
-           new selection.  The (void) casts match the existing style. */
-        if (len > 0 && data) {
-            ssize_t r = pwrite(fd_primary, data, len, 0);
-            (void)r;
-        }
-        (void)ftruncate(fd_primary, (off_t)len);
-
-        /* primary must be fully committed before seq is touched —
-           seq's mtime is the shell's only per-keypress detection signal. */
-        char buf[24];
-        int sn = snprintf(buf, sizeof(buf), "%lu\n", seq);
-        ssize_t r = pwrite(fd_seq, buf, (size_t)sn, 0);
-        (void)r;
-        (void)ftruncate(fd_seq, (off_t)sn);
-        return;
-    }
-
-    /* Fallback path: used for the pre-daemon() initial write (fd_primary is
-       still -1 at that point) and if open() failed after daemon().
-       All short-lived modes (--oneshot, --get-clipboard, --copy-clipboard,
-       --clear-primary) also use this path since they never open persistent fds. */
-    int fd = open(primary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
-    if (fd < 0) return;
-    if (len > 0 && data) {
-        ssize_t r = write(fd, data, len);
-        (void)r;
-    }
-    close(fd);
-
-    fd = open(seq_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
-    if (fd >= 0) {
-        char buf[24];
-        int sn = snprintf(buf, sizeof(buf), "%lu\n", seq);
-        ssize_t r = write(fd, buf, sn);
-        (void)r;
-        close(fd);
-    }
-}
-
 /* ------------------------------------------------------------------ */
 /*  Helper communication: launch and read protocol.                   */
 /* ------------------------------------------------------------------ */
 
-/* Launch the Windows helper with the given arguments.  Returns fd for
-   reading the helper's stdout, or -1 on error.  Sets helper_pid. */
-static int launch_helper(const char *mode) {
+/* Launch the Windows helper with mode and an optional second argument
+   (NULL for none).  Returns fd for reading the helper's stdout, or -1 on
+   error.  Sets helper_pid.  If out_wfd is non-NULL the helper's stdin is
+   a pipe too and *out_wfd receives its (close-on-exec) write end. */
+static int launch_helper(const char *mode, const char *opt, int *out_wfd) {
     int pipefd[2];
+    int inpipe[2] = { -1, -1 };
     if (pipe(pipefd) < 0)
         return -1;
+    if (out_wfd && pipe2(inpipe, O_CLOEXEC) < 0) {
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return -1;
+    }
 
     pid_t pid = fork();
     if (pid < 0) {
         close(pipefd[0]);
         close(pipefd[1]);
+        if (out_wfd) {
+            close(inpipe[0]);
+            close(inpipe[1]);
+        }
         return -1;
     }
 
@@ -208,26 +205,34 @@ static int launch_helper(const char *mode) {
             dup2(pipefd[1], STDOUT_FILENO);
             close(pipefd[1]);
         }
+        /* dup2() clears close-on-exec on the new stdin. */
+        if (out_wfd)
+            dup2(inpipe[0], STDIN_FILENO);
         /* Close stderr in daemon child to avoid noise. */
         int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
         if (devnull >= 0) {
             dup2(devnull, STDERR_FILENO);
             close(devnull);
         }
-        execl(helper_path, helper_path, mode, (char *)NULL);
+        execl(helper_path, helper_path, mode, opt, (char *)NULL);
         _exit(127);
     }
 
     /* Parent. */
     close(pipefd[1]);
+    if (out_wfd) {
+        close(inpipe[0]);
+        *out_wfd = inpipe[1];
+    }
     helper_pid = pid;
     return pipefd[0];
 }
 
 /* Launch the Windows helper with stdin piped FROM us.  Used by
    --copy-clipboard: pipe data to the helper's stdin.
-   Returns the write-end fd, or -1 on error. */
-static int launch_helper_with_stdin(const char *mode) {
+   Returns the write-end fd, or -1 on error, and stores the child in
+   *out_pid (helper_pid is left alone so the daemon helper is not lost). */
+static int launch_helper_with_stdin(const char *mode, pid_t *out_pid) {
     int pipefd[2];
     if (pipe(pipefd) < 0)
         return -1;
@@ -258,46 +263,140 @@ static int launch_helper_with_stdin(const char *mode) {
 
     /* Parent: write end. */
     close(pipefd[0]);
+    *out_pid = pid;
     return pipefd[1];
 }
 
-/* Read a line from fd into buf (max bufsize-1 chars).
-   Returns the number of bytes read (excluding NUL), or -1 on error/EOF.
-   Does NOT include the trailing '\n' in buf. */
-static int read_line(int fd, char *buf, size_t bufsize) {
-    size_t pos = 0;
-    while (pos < bufsize - 1) {
-        char c;
-        ssize_t n = read(fd, &c, 1);
-        if (n <= 0)
-            return -1;
-        if (c == '\n') {
-            buf[pos] = '\0';
-            return (int)pos;
+static long long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* One read() of up to max bytes from the helper pipe into dst.  While
+   r->deadline_ms is set the wait for data is bounded by it, and running
+   out sets r->timed_out.  Returns the byte count, or -1 on EOF/error/
+   timeout. */
+static ssize_t reader_pull(struct helper_reader *r, char *dst, size_t max) {
+    for (;;) {
+        if (r->deadline_ms) {
+            long long left = r->deadline_ms - monotonic_ms();
+            struct pollfd pfd = { .fd = r->fd, .events = POLLIN };
+            int ret = left > 0 ? poll(&pfd, 1, (int)left) : 0;
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret == 0)
+                r->timed_out = true;
+            if (ret <= 0)
+                return -1;
         }
-        buf[pos++] = c;
+        ssize_t n = read(r->fd, dst, max);
+        if (n < 0 && errno == EINTR)
+            continue;
+        return n > 0 ? n : -1;
     }
-    buf[pos] = '\0';
-    return (int)pos;
 }
 
-/* Read exactly `len` bytes from fd into buf.  Returns 0 on success. */
-static int read_exact(int fd, char *buf, size_t len) {
+/* Read exactly `len` bytes from the pipe into buf.  Returns 0 on success. */
+static int read_exact(struct helper_reader *r, char *buf, size_t len) {
     size_t off = 0;
     while (off < len) {
-        ssize_t n = read(fd, buf + off, len - off);
-        if (n <= 0)
+        ssize_t n = reader_pull(r, buf + off, len - off);
+        if (n < 0)
             return -1;
         off += (size_t)n;
     }
     return 0;
 }
 
+/* Block until at least `want` bytes are buffered (want <= HELPER_BUF_SIZE).
+   Returns 0 on success, -1 on EOF/error. */
+static int reader_need(struct helper_reader *r, size_t want) {
+    if (r->end - r->pos >= want)
+        return 0;
+    /* Move the partial message to the front to make room. */
+    memmove(r->buf, r->buf + r->pos, r->end - r->pos);
+    r->end -= r->pos;
+    r->pos = 0;
+    while (r->end < want) {
+        ssize_t n = reader_pull(r, r->buf + r->end, sizeof(r->buf) - r->end);
+        if (n < 0)
+            return -1;
+        r->end += (size_t)n;
+    }
+    return 0;
+}
+
+/* Copy `len` payload bytes into dst: the buffered part first, then the
+   rest straight from the pipe.  Returns 0 on success. */
+static int reader_read(struct helper_reader *r, char *dst, size_t len) {
+    size_t have = r->end - r->pos;
+    if (have > len)
+        have = len;
+    memcpy(dst, r->buf + r->pos, have);
+    r->pos += have;
+    return read_exact(r, dst + have, len - have);
+}
+
+/* Discard `len` payload bytes (the part above MAX_CLIPBOARD_SIZE) so the
+   stream stays in sync.  Returns 0 on success. */
+static int reader_skip(struct helper_reader *r, size_t len) {
+    while (len > 0) {
+        size_t chunk = len < sizeof(r->buf) ? len : sizeof(r->buf);
+        if (reader_need(r, chunk) != 0)
+            return -1;
+        r->pos += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+/* Read a line into buf (max bufsize-1 chars, bufsize <= HELPER_BUF_SIZE).
+   Returns the number of bytes read (excluding NUL), or -1 on error/EOF.
+   Does NOT include the trailing '\n' in buf; the remainder of an overlong
+   line is returned by the next call. */
+static int read_line(struct helper_reader *r, char *buf, size_t bufsize) {
+    size_t scanned = 0;
+    for (;;) {
+        char *start = r->buf + r->pos;
+        size_t have = r->end - r->pos;
+        char *nl = memchr(start + scanned, '\n', have - scanned);
+        size_t n = nl ? (size_t)(nl - start) : have;
+        if (n >= bufsize - 1) {
+            n = bufsize - 1;
+            memcpy(buf, start, n);
+            buf[n] = '\0';
+            r->pos += n;
+            return (int)n;
+        }
+        if (nl) {
+            memcpy(buf, start, n);
+            buf[n] = '\0';
+            r->pos += n + 1;
+            return (int)n;
+        }
+        scanned = have;
+        if (reader_need(r, have + 1) != 0)
+            return -1;
+    }
+}
+
 /* ------------------------------------------------------------------ */
-/*  --oneshot / --get-clipboard: run helper, relay output.            */
+/*  --oneshot / --get-clipboard: ask the daemon, else run helper.     */
 /* ------------------------------------------------------------------ */
-static int run_oneshot(void) {
-    int fd = launch_helper("--get-clipboard");
+static int run_oneshot(const char *cache_dir_arg) {
+    /* A running daemon answers from its last helper message (or one
+       command round trip to its resident helper) without a process launch. */
+    char *data = NULL;
+    size_t len = 0;
+    if (resolve_cache_dir(cache_dir_arg) == 0 &&
+        sock_client_request("GET", NULL, 0, &data, &len) == 0) {
+        if (len > 0) fwrite(data, 1, len, stdout);
+        free(data);
+        return len > 0 ? 0 : 1;
+    }
+
+    int fd = launch_helper("--get-clipboard", NULL, NULL);
     if (fd < 0) {
         /* Fallback to powershell.exe */
         execlp("powershell.exe", "powershell.exe",
@@ -319,37 +418,82 @@ static int run_oneshot(void) {
     return wrote ? 0 : 1;
 }
 
-static int run_get_clipboard(void) {
-    return run_oneshot();
+static int run_get_clipboard(const char *cache_dir_arg) {
+    return run_oneshot(cache_dir_arg);
 }
 
 /* ------------------------------------------------------------------ */
-/*  --copy-clipboard: pipe stdin to helper --set-clipboard.           */
+/*  --copy-clipboard: hand stdin to the daemon, else to a helper.     */
 /* ------------------------------------------------------------------ */
-static int run_copy_clipboard(void) {
-    int wfd = launch_helper_with_stdin("--set-clipboard");
-    if (wfd < 0) {
-        /* Fallback to clip.exe */
-        execlp("clip.exe", "clip.exe", (char *)NULL);
+/* Write the whole buffer to fd.  Returns 0 on success. */
+static int write_all(int fd, const char *data, size_t len) {
+    size_t off = 0;
+    while (off < len) {
+        ssize_t w = write(fd, data + off, len - off);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return -1;
+        off += (size_t)w;
+    }
+    return 0;
+}
+
+/* Fallback without a usable helper: feed the buffer to clip.exe through a
+   pipe (our own stdin has already been consumed). */
+static int run_clip_exe(const char *data, size_t len) {
+    int pipefd[2];
+    if (pipe(pipefd) < 0)
         return 1;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return 1;
+    }
+    if (pid == 0) {
+        close(pipefd[1]);
+        dup2(pipefd[0], STDIN_FILENO);
+        close(pipefd[0]);
+        execlp("clip.exe", "clip.exe", (char *)NULL);
+        _exit(127);
     }
 
-    char buf[4096];
-    ssize_t n;
-    while ((n = read(STDIN_FILENO, buf, sizeof(buf))) > 0) {
-        size_t off = 0;
-        while (off < (size_t)n) {
-            ssize_t w = write(wfd, buf + off, (size_t)n - off);
-            if (w <= 0) goto done;
-            off += (size_t)w;
-        }
+    close(pipefd[0]);
+    int rc = write_all(pipefd[1], data, len);
+    close(pipefd[1]);
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0) return 1;
+    return (rc == 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : 1;
+}
+
+static int run_copy_clipboard(const char *cache_dir_arg) {
+    size_t len = 0;
+    char *data = read_all_stdin(&len);
+    if (!data) return 1;
+
+    /* A running daemon forwards the text to its resident helper. */
+    if (len > 0 && resolve_cache_dir(cache_dir_arg) == 0 &&
+        sock_client_request("SET", data, len, NULL, NULL) == 0) {
+        free(data);
+        return 0;
     }
-done:
+
+    pid_t pid;
+    int wfd = launch_helper_with_stdin("--set-clipboard", &pid);
+    if (wfd < 0) {
+        int rc = run_clip_exe(data, len);
+        free(data);
+        return rc;
+    }
+
+    int rc = write_all(wfd, data, len);
     close(wfd);
+    free(data);
 
     int status;
-    waitpid(helper_pid, &status, 0);
-    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    if (waitpid(pid, &status, 0) < 0) return 1;
+    return (rc == 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : 1;
 }
 
 /* ------------------------------------------------------------------ */
@@ -374,6 +518,429 @@ static int run_clear_primary(void) {
     return 0;
 }
 
+/* ------------------------------------------------------------------ */
+/*  Daemon helper: messages, commands, startup.                       */
+/* ------------------------------------------------------------------ */
+/* Release last_clip, which is either malloc'd (adopted after a SET) or the
+   arena (a helper message), and mark it unknown. */
+static void drop_last_clip(void) {
+    scratch_free(last_clip);
+    last_clip = NULL;
+    last_clip_len = 0;
+    have_last_clip = false;
+}
+
+/* Publish one clipboard message.  content (NULL for EMPTY, else the arena)
+   is adopted as last_clip, releasing the previous one (malloc'd after a
+   SET, or the arena); hash is its zes_hash64().  start_us is when the
+   message began arriving, for the event histogram. */
+static void publish_clip(char *content, size_t len, uint64_t hash,
+                         long long start_us) {
+    /* Always increment seq even when content is identical — a reselect of
+       exactly the same text must still trigger a fresh event in the shell;
+       write_primary_hashed() then only rewrites seq. */
+    seq_counter++;
+    write_primary_hashed(content ? content : "", content ? len : 0,
+                         seq_counter, hash);
+    if (last_clip != content)
+        scratch_free(last_clip);
+    if (content)
+        arena_trim(len + 1);
+    last_clip = content;
+    last_clip_len = content ? len : 0;
+    have_last_clip = true;
+
+    met_events++;
+    met_bytes += last_clip_len;
+    met_record(&met_event, monotonic_us() - start_us);
+}
+
+/* Read a len-byte CLIPBOARD payload into the arena and publish it.  The
+   previous last_clip is dropped first since it may be the arena itself,
+   which a growing reservation can move; a GET in between asks the helper.
+   Bytes above MAX_CLIPBOARD_SIZE are discarded.  Returns 0, or -1 on
+   EOF/error. */
+static int read_clip_payload(struct helper_reader *r, size_t len) {
+    long long start = monotonic_us();
+    size_t keep = len > MAX_CLIPBOARD_SIZE ? MAX_CLIPBOARD_SIZE : len;
+    char *content = NULL;
+    trace_record(TRACE_NOTIFY, NULL, NULL, 0, 0, 0);
+    drop_last_clip();
+    if (keep > 0) {
+        content = arena_reserve(keep + 1);
+        if (!content)
+            return reader_skip(r, len);
+        if (reader_read(r, content, keep) != 0)
+            return -1;
+        content[keep] = '\0';
+    }
+    if (reader_skip(r, len - keep) != 0)
+        return -1;
+    met_record(&met_wait, monotonic_us() - start);
+    uint64_t hash = zes_hash64(content ? content : "", keep);
+    if (trace_fd >= 0)
+        trace_record(TRACE_READ, NULL, content, keep, content ? hash : 0,
+                     monotonic_us() - start);
+    if (len > keep)
+        met_oversize++;
+    publish_clip(content, keep, hash, start);
+    return 0;
+}
+
+/* Read a REPLY/ERROR payload into the reply slot if it answers the command
+   in flight, otherwise discard it.  Returns 0, or -1 on EOF/error. */
+static int read_helper_reply(struct helper_reader *r, const struct helper_frame *fr) {
+    size_t keep = fr->len > MAX_CLIPBOARD_SIZE ? MAX_CLIPBOARD_SIZE : fr->len;
+    bool wanted = !helper_reply_done && fr->seq == helper_cmd_id;
+    char *data = NULL;
+    if (wanted && keep > 0) {
+        data = (char *)malloc(keep + 1);
+        if (data) {
+            if (reader_read(r, data, keep) != 0) {
+                free(data);
+                return -1;
+            }
+            data[keep] = '\0';
+        } else {
+            keep = 0;
+        }
+    } else {
+        keep = 0;
+    }
+    if (reader_skip(r, fr->len - keep) != 0) {
+        free(data);
+        return -1;
+    }
+    if (wanted) {
+        helper_reply_done = true;
+        helper_reply_ok = (fr->type == FRAME_REPLY) && (data || fr->len == 0);
+        helper_reply_data = data;
+        helper_reply_len = keep;
+    }
+    return 0;
+}
+
+/* Read and handle one helper message.  Returns 0, or -1 on EOF/error
+   (helper died, or the framed stream lost sync). */
+static int read_helper_message(struct helper_reader *r, bool framed) {
+    /* A message cut short by a command's deadline cannot be told apart
+       from the next one: nothing more is parsed until the event loop has
+       restarted the helper. */
+    if (r->timed_out)
+        return -1;
+    if (framed) {
+        struct helper_frame fr;
+        if (reader_need(r, sizeof(fr)) != 0)
+            return -1;
+        memcpy(&fr, r->buf + r->pos, sizeof(fr));
+        r->pos += sizeof(fr);
+        if (fr.magic != FRAME_MAGIC)
+            return -1;
+        if (fr.type == FRAME_CLIPBOARD)
+            return read_clip_payload(r, fr.len);
+        if (fr.type == FRAME_EMPTY) {
+            publish_clip(NULL, 0, zes_hash64("", 0), monotonic_us());
+            return 0;
+        }
+        if (fr.type == FRAME_REPLY || fr.type == FRAME_ERROR)
+            return read_helper_reply(r, &fr);
+        /* HEARTBEAT is a liveness signal; unknown types are skipped for
+           forward compatibility. */
+        return reader_skip(r, fr.len);
+    }
+
+    char line[256];
+    if (read_line(r, line, sizeof(line)) < 0)
+        return -1;
+    if (strncmp(line, "CLIPBOARD ", 10) == 0) {
+        /* Parse: CLIPBOARD <seq> <content_len> */
+        unsigned long win_seq;
+        size_t content_len;
+        if (sscanf(line + 10, "%lu %zu", &win_seq, &content_len) != 2)
+            return 0;
+        return read_clip_payload(r, content_len);
+    }
+    if (strncmp(line, "EMPTY ", 6) == 0)
+        publish_clip(NULL, 0, zes_hash64("", 0), monotonic_us());
+    /* HEARTBEAT is a liveness signal; unknown lines are silently ignored
+       for forward compatibility. */
+    return 0;
+}
+
+/* Wait for the helper's READY message.  Returns 0 on success. */
+static int wait_helper_ready(struct helper_reader *r, bool framed) {
+    if (framed) {
+        struct helper_frame fr;
+        if (reader_need(r, sizeof(fr)) != 0)
+            return -1;
+        memcpy(&fr, r->buf + r->pos, sizeof(fr));
+        if (fr.magic != FRAME_MAGIC || fr.type != FRAME_READY)
+            return -1;
+        r->pos += sizeof(fr);
+        return reader_skip(r, fr.len);
+    }
+    char line[256];
+    int len = read_line(r, line, sizeof(line));
+    return (len < 0 || strncmp(line, "READY", 5) != 0) ? -1 : 0;
+}
+
+/* Send one command frame to the resident helper and wait up to
+   HELPER_REPLY_MS for its reply.  The deadline also bounds reading the
+   messages themselves, so a helper stalled mid-message cannot hang the
+   daemon; the event loop then restarts it (restart_daemon_helper()).
+   Clipboard events that arrive first are published as usual.  On success
+   returns 0 and, if out is non-NULL, hands over the reply payload
+   (malloc'd, NULL when empty); returns -1 on ERROR, timeout, or a broken
+   helper, and stops using the channel in the last case. */
+static int helper_request(uint32_t type, const char *data, size_t len,
+                          char **out, size_t *out_len) {
+    if (helper_wfd < 0)
+        return -1;
+
+    struct helper_frame fr = { FRAME_MAGIC, type, ++helper_cmd_id, (uint32_t)len };
+    helper_reply_done = false;
+    helper_reply_ok = false;
+    helper_reply_data = NULL;
+    helper_reply_len = 0;
+
+    struct iovec iov[2] = {
+        { .iov_base = &fr, .iov_len = sizeof(fr) },
+        { .iov_base = (void *)data, .iov_len = len },
+    };
+    size_t total = sizeof(fr) + len, sent = 0;
+    while (sent < total) {
+        ssize_t w = writev(helper_wfd, iov, 2);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0) {
+            close(helper_wfd);
+            helper_wfd = -1;
+            return -1;
+        }
+        sent += (size_t)w;
+        /* Advance the iovecs past what was written. */
+        size_t adv = (size_t)w;
+        for (int i = 0; i < 2; i++) {
+            size_t step = adv < iov[i].iov_len ? adv : iov[i].iov_len;
+            iov[i].iov_base = (char *)iov[i].iov_base + step;
+            iov[i].iov_len -= step;
+            adv -= step;
+        }
+    }
+
+    long long start = monotonic_us();
+    long long deadline = monotonic_ms() + HELPER_REPLY_MS;
+    helper_rd.deadline_ms = deadline;
+    while (!helper_reply_done) {
+        if (helper_rd.pos == helper_rd.end) {
+            long long left = deadline - monotonic_ms();
+            if (left <= 0) {
+                met_timeouts++;
+                break;
+            }
+            struct pollfd pfd = { .fd = helper_rd.fd, .events = POLLIN };
+            int ret = poll(&pfd, 1, (int)left);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret == 0)
+                met_timeouts++;
+            if (ret <= 0)
+                break;
+        }
+        if (read_helper_message(&helper_rd, true) < 0) {
+            /* The event loop sees the hang-up, or restarts the helper of
+               the timed-out stream, on its next pass. */
+            if (helper_rd.timed_out)
+                met_timeouts++;
+            close(helper_wfd);
+            helper_wfd = -1;
+            break;
+        }
+    }
+    helper_rd.deadline_ms = 0;
+
+    met_record(&met_wait, monotonic_us() - start);
+
+    if (!helper_reply_done || !helper_reply_ok) {
+        free(helper_reply_data);
+        helper_reply_data = NULL;
+        /* A late reply to this id is dropped by read_helper_reply(). */
+        helper_reply_done = true;
+        return -1;
+    }
+    if (out) {
+        *out = helper_reply_data;
+        *out_len = helper_reply_len;
+    } else {
+        free(helper_reply_data);
+    }
+    helper_reply_data = NULL;
+    return 0;
+}
+
+/* Launch the helper in --daemon mode and wait for READY.  The framed
+   protocol is tried first; a helper built before it rejects --framed and
+   exits without READY, and is relaunched with the line protocol.  Returns
+   the pipe fd (also in helper_rd) and sets *framed, or returns -1. */
+static int start_daemon_helper(bool *framed) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        *framed = (attempt == 0);
+        int fd = launch_helper("--daemon", *framed ? "--framed" : NULL,
+                               *framed ? &helper_wfd : NULL);
+        if (fd < 0)
+            return -1;
+        helper_rd.fd = fd;
+        helper_rd.pos = helper_rd.end = 0;
+        if (wait_helper_ready(&helper_rd, *framed) == 0)
+            return fd;
+        close(fd);
+        if (helper_wfd >= 0) {
+            close(helper_wfd);
+            helper_wfd = -1;
+        }
+        kill(helper_pid, SIGTERM);
+        waitpid(helper_pid, NULL, 0);
+        helper_pid = -1;
+    }
+    return -1;
+}
+
+/* Replace the resident helper after a command's deadline cut one of its
+   messages short: the rest of that stream cannot be parsed, but the cache,
+   the socket and the shells' connections stay.  The clipboard is unknown
+   until the new helper's next message (GET asks the helper meanwhile).
+   Returns the new pipe fd, or -1 when the helper cannot be started. */
+static int restart_daemon_helper(int old_fd, bool *framed) {
+    close(old_fd);
+    if (helper_wfd >= 0) {
+        close(helper_wfd);
+        helper_wfd = -1;
+    }
+    if (helper_pid > 0) {
+        kill(helper_pid, SIGTERM);
+        waitpid(helper_pid, NULL, 0);
+        helper_pid = -1;
+    }
+    helper_rd.timed_out = false;
+    drop_last_clip();
+    return start_daemon_helper(framed);
+}
+
+/* ------------------------------------------------------------------ */
+/*  Daemon socket API                                                 */
+/* ------------------------------------------------------------------ */
+/* The daemon listens on SOCK_FILE so the shell can read the clipboard from
+ * the daemon's copy of the last helper message instead of fork+exec'ing
+ * this binary and a fresh Windows helper (the slow part) per paste.
+ * One request per connection:
+ *   request:   "<VERB> <len>\n" followed by <len> payload bytes
+ *   response:  "OK <len>\n" followed by <len> payload bytes, or "ERR\n"
+ * Verbs: GET (clipboard text), SET (own CLIPBOARD with the payload),
+ *        CLEAR (clear the PRIMARY cache), OSC52 (payload
+ *        "<frame>\n<text>": the OSC 52 sequence for the shell's tty). */
+
+/* Adopt data as last_clip after a successful set. */
+static void adopt_last_clip(char *data, size_t len) {
+    drop_last_clip();
+    last_clip = data;
+    last_clip_len = len;
+    have_last_clip = true;
+}
+
+/* Set the Windows clipboard: as a SET command on the resident helper's
+   stdin when it speaks the framed protocol, otherwise by piping data to a
+   short-lived helper --set-clipboard, waiting for that helper only
+   (helper_pid stays the daemon helper).  On success last_clip takes the
+   buffer so a GET that races the helper's CLIPBOARD message already sees
+   the new text; on failure the buffer is freed. */
+static bool daemon_set_clipboard(char *data, size_t len) {
+    if (helper_request(FRAME_CMD_SET, data, len, NULL, NULL) == 0) {
+        adopt_last_clip(data, len);
+        return true;
+    }
+
+    pid_t pid;
+    int wfd = launch_helper_with_stdin("--set-clipboard", &pid);
+    if (wfd < 0) {
+        free(data);
+        return false;
+    }
+
+    bool ok = true;
+    size_t off = 0;
+    while (off < len) {
+        ssize_t w = write(wfd, data + off, len - off);
+        if (w > 0) { off += (size_t)w; continue; }
+        if (w < 0 && errno == EINTR) continue;
+        ok = false;
+        break;
+    }
+    close(wfd);
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+        ok = false;
+
+    if (!ok) {
+        free(data);
+        return false;
+    }
+    adopt_last_clip(data, len);
+    return true;
+}
+
+/* Accept one client on the listening socket and serve its request. */
+static void handle_sock_request(int listen_fd) {
+    int cfd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (cfd < 0) return;
+
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 500000 };
+    setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    char verb[16];
+    char *payload = NULL;
+    size_t payload_len = 0;
+    if (sock_read_request(cfd, verb, sizeof(verb), &payload, &payload_len) != 0) {
+        sock_reply(cfd, false, NULL, 0);
+        close(cfd);
+        return;
+    }
+
+    if (strcmp(verb, "GET") == 0) {
+        /* Before the helper's first message there is nothing cached: ask
+           the resident helper, or answer ERR so the shell falls back to
+           --get-clipboard. */
+        char *data = NULL;
+        size_t len = 0;
+        if (!have_last_clip && helper_request(FRAME_CMD_GET, NULL, 0, &data, &len) == 0)
+            adopt_last_clip(data, len);
+        sock_reply(cfd, have_last_clip, last_clip, last_clip_len);
+    } else if (strcmp(verb, "SET") == 0) {
+        /* daemon_set_clipboard() adopts or frees the payload. */
+        bool ok = payload && daemon_set_clipboard(payload, payload_len);
+        payload = NULL;
+        sock_reply(cfd, ok, NULL, 0);
+    } else if (strcmp(verb, "CLEAR") == 0) {
+        /* Same as --clear-primary, without re-reading the seq file. */
+        seq_counter++;
+        write_primary("", 0, seq_counter);
+        sock_reply(cfd, true, NULL, 0);
+    } else if (strcmp(verb, "STATS") == 0) {
+        char buf[MET_TEXT_MAX];
+        size_t n = met_format(buf, sizeof(buf));
+        sock_reply(cfd, true, buf, n);
+    } else if (strcmp(verb, "OSC52") == 0) {
+        osc52_sock_reply(cfd, payload, payload_len);
+    } else {
+        sock_reply(cfd, false, NULL, 0);
+    }
+
+    free(payload);
+    close(cfd);
+}
+
 /* ------------------------------------------------------------------ */
 /*  Daemon mode: launch helper --daemon, read protocol, write cache.  */
 /* ------------------------------------------------------------------ */
@@ -390,6 +957,13 @@ static int run_daemon(const char *cache_dir_arg) {
     seq_counter = (unsigned long)time(NULL);
     write_primary("", 0, seq_counter);
 
+    /* Opt-in event trace (ZES_TRACE), opened while the shell's working
+       directory is still ours. */
+    trace_open();
+
+    /* Keep the shell's readiness pipe across daemon(); see ready_notify(). */
+    ready_fd_take();
+
     if (daemon(0, 0) != 0) {
         perror("daemon");
         return 1;
@@ -398,98 +972,98 @@ static int run_daemon(const char *cache_dir_arg) {
     FILE *f = fopen(pid_path, "w");
     if (f) { fprintf(f, "%d\n", getpid()); fclose(f); }
 
+    if (pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        unlink(pid_path);
+        return 1;
+    }
     signal(SIGTERM, signal_handler);
     signal(SIGINT, signal_handler);
     signal(SIGHUP, signal_handler);
+    /* A --set-clipboard helper that exits early must not kill the daemon. */
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGUSR1, met_signal_handler);
+    met_start_us = monotonic_us();
 
     /* Open persistent fds for write_primary() hot path */
     fd_primary = open(primary_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
     fd_seq     = open(seq_path,    O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
 
-    /* Launch the Windows helper in --daemon mode. */
-    int pipe_fd = launch_helper("--daemon");
+    /* Launch the Windows helper in --daemon mode and wait for READY. */
+    bool framed = false;
+    int pipe_fd = start_daemon_helper(&framed);
     if (pipe_fd < 0) {
-        fprintf(stderr, "Failed to launch Windows helper\n");
+        fprintf(stderr, "Failed to start Windows helper\n");
         goto cleanup;
     }
 
-    /* Wait for the READY signal from the helper. */
-    {
-        char line[256];
-        int len = read_line(pipe_fd, line, sizeof(line));
-        if (len < 0 || strncmp(line, "READY", 5) != 0) {
-            fprintf(stderr, "Helper did not send READY\n");
-            close(pipe_fd);
-            goto cleanup;
-        }
-    }
+    /* Request socket for the shell's GET/SET/CLEAR calls.  -1 is not
+       fatal: the shell falls back to spawning the agent per call. */
+    int sock_fd = sock_listen();
 
-    /* Event loop: poll on the helper's stdout pipe.
-       The helper sends CLIPBOARD/EMPTY/HEARTBEAT messages.
-       We write cache files on each clipboard change. */
+    /* Helper ready and socket listening: release the shell. */
+    ready_notify();
+
+    /* Event loop: poll on the helper's stdout pipe and the request socket.
+       The helper sends CLIPBOARD/EMPTY/HEARTBEAT messages (frames or lines).
+       We write cache files on each clipboard change.  There is no timeout:
+       signals arrive through wake_pipe, and a -1 sock_fd is ignored. */
     while (running) {
-        struct pollfd pfd = { .fd = pipe_fd, .events = POLLIN };
-        int ret = poll(&pfd, 1, 10000);  /* 10s timeout for signal check */
+        struct pollfd pfds[3] = {
+            { .fd = pipe_fd,      .events = POLLIN },
+            { .fd = sock_fd,      .events = POLLIN },
+            { .fd = wake_pipe[0], .events = POLLIN },
+        };
+        int ret = poll(pfds, 3, -1);
+        if (ret > 0 && pfds[2].revents)
+            wake_drain();
+        if (met_dump_pending) {
+            met_dump_pending = 0;
+            met_dump_file();
+        }
 
         if (ret < 0) {
             if (errno == EINTR) continue;
             break;
         }
 
-        if (ret == 0)
-            continue;  /* Timeout — check running flag. */
+        if (sock_fd >= 0 && (pfds[1].revents & POLLIN))
+            handle_sock_request(sock_fd);
 
-        if (pfd.revents & (POLLHUP | POLLERR)) {
+        if (helper_rd.timed_out) {
+            /* A command's deadline cut a message short (a slow reply, a
+               large CLIPBOARD payload still in flight): start over with a
+               fresh helper instead of ending the daemon. */
+            pipe_fd = restart_daemon_helper(pipe_fd, &framed);
+            if (pipe_fd < 0) break;
+            continue;
+        }
+
+        if (pfds[0].revents & (POLLHUP | POLLERR)) {
             /* Helper died or pipe broke. */
             break;
         }
 
-        if (pfd.revents & POLLIN) {
-            char line[256];
-            int len = read_line(pipe_fd, line, sizeof(line));
-            if (len < 0) break;  /* EOF or error — helper died. */
-
-            if (strncmp(line, "CLIPBOARD ", 10) == 0) {
-                /* Parse: CLIPBOARD <seq> <content_len> */
-                unsigned long win_seq;
-                size_t content_len;
-                if (sscanf(line + 10, "%lu %zu", &win_seq, &content_len) != 2)
-                    continue;
-
-                if (content_len > MAX_CLIPBOARD_SIZE)
-                    content_len = MAX_CLIPBOARD_SIZE;
-
-                char *content = NULL;
-                if (content_len > 0) {
-                    content = (char *)malloc(content_len + 1);
-                    if (!content) continue;
-                    if (read_exact(pipe_fd, content, content_len) != 0) {
-                        free(content);
-                        break;
-                    }
-                    content[content_len] = '\0';
-                }
-
-                /* Always increment seq even when content is identical — a
-                   reselect of exactly the same text must still trigger a
-                   fresh event in the shell. */
-                seq_counter++;
-                write_primary(content ? content : "", content_len, seq_counter);
-                free(content);
-
-            } else if (strncmp(line, "EMPTY ", 6) == 0) {
-                seq_counter++;
-                write_primary("", 0, seq_counter);
-
-            } else if (strncmp(line, "HEARTBEAT", 9) == 0) {
-                /* Liveness signal — nothing to do. */
-                continue;
-            }
-            /* Unknown lines are silently ignored for forward compatibility. */
+        if (pfds[0].revents & POLLIN) {
+            /* poll() cannot see messages already sitting in helper_rd, so
+               drain them all before polling again. */
+            int rc;
+            do {
+                rc = read_helper_message(&helper_rd, framed);
+            } while (rc == 0 && helper_rd.pos < helper_rd.end);
+            if (rc < 0) break;  /* EOF or error — helper died. */
         }
     }
 
-    close(pipe_fd);
+    if (pipe_fd >= 0) close(pipe_fd);
+    if (helper_wfd >= 0) {
+        close(helper_wfd);
+        helper_wfd = -1;
+    }
+    if (sock_fd >= 0) {
+        close(sock_fd);
+        unlink(sock_path);
+    }
+    drop_last_clip();
 
     /* Kill the Windows helper child if it is still running. */
     if (helper_pid > 0) {
@@ -500,9 +1074,13 @@ static int run_daemon(const char *cache_dir_arg) {
 cleanup:
     if (fd_primary >= 0) { close(fd_primary); fd_primary = -1; }
     if (fd_seq     >= 0) { close(fd_seq);     fd_seq     = -1; }
+    trace_close();
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
     unlink(primary_path);
     unlink(seq_path);
     unlink(pid_path);
+    unlink(metrics_path);
     return 0;
 }
 
@@ -512,10 +1090,12 @@ cleanup:
 /*  Modes (first matching flag wins):                                 */
 /*    (default)          Daemon: monitor clipboard via Windows helper  */
 /*                       and write changes to cache files.             */
-/*    --oneshot          Print current clipboard text and exit.        */
+/*    --oneshot          Print current clipboard text and exit (asks   */
+/*                       a running daemon first).                      */
 /*    --get-clipboard    Print clipboard text and exit (alias).        */
 /*    --copy-clipboard   Read stdin, set as clipboard.                 */
 /*    --clear-primary    Clear the cache files.                        */
+/*    --stats            Print the running daemon's metrics.           */
 /*    --help / -h        Print usage.                                  */
 /* ------------------------------------------------------------------ */
 int main(int argc, char *argv[]) {
@@ -524,6 +1104,8 @@ int main(int argc, char *argv[]) {
     bool get_clipboard = false;
     bool copy_clipboard = false;
     bool clear_primary = false;
+    bool stats = false;
+    bool osc52 = false;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--oneshot") == 0)
@@ -534,15 +1116,21 @@ int main(int argc, char *argv[]) {
             copy_clipboard = true;
         else if (strcmp(argv[i], "--clear-primary") == 0)
             clear_primary = true;
+        else if (strcmp(argv[i], "--stats") == 0)
+            stats = true;
+        else if (strcmp(argv[i], "--osc52") == 0)
+            osc52 = true;
         else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             fprintf(stderr,
-                "Usage: %s [cache_dir] [--oneshot|--get-clipboard|--copy-clipboard|--clear-primary]\n"
+                "Usage: %s [cache_dir] [--oneshot|--get-clipboard|--copy-clipboard|--clear-primary|--stats|--osc52]\n"
                 "WSL clipboard agent for zsh-edit-select.\n\n"
                 "  (default)         Daemon mode — monitor Windows clipboard\n"
                 "  --oneshot         Print current clipboard and exit\n"
                 "  --get-clipboard   Print clipboard contents and exit\n"
                 "  --copy-clipboard  Read stdin, set as clipboard\n"
-                "  --clear-primary   Clear cache files\n",
+                "  --clear-primary   Clear cache files\n"
+                "  --stats           Print the running daemon's metrics\n"
+                "  --osc52           Read stdin, write it to the terminal as OSC 52\n",
                 argv[0]);
             return 0;
         } else {
@@ -550,6 +1138,11 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if (stats)
+        return run_stats(cache_dir_arg);
+    if (osc52)
+        return run_osc52();
+
     /* Resolve the helper .exe path before dispatching. */
     if (resolve_helper_path(argv[0]) != 0) {
         /* Helper not found — short-lived modes can still fall back to
@@ -561,11 +1154,11 @@ int main(int argc, char *argv[]) {
     }
 
     if (oneshot)
-        return run_oneshot();
+        return run_oneshot(cache_dir_arg);
     if (get_clipboard)
-        return run_get_clipboard();
+        return run_get_clipboard(cache_dir_arg);
     if (copy_clipboard)
-        return run_copy_clipboard();
+        return run_copy_clipboard(cache_dir_arg);
     if (clear_primary) {
         if (cache_dir_arg)
             ensure_cache_dir(cache_dir_arg);
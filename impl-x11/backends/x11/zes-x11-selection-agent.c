@@ -3,152 +3,472 @@
 //
 // X11 XFixes-based clipboard integration agent for zsh-edit-select
 //
-// Compile: gcc -O3 zes-x11-selection-agent.c -o zes-x11-selection-agent -lX11 -lXfixes
-// Usage:   zes-x11-selection-agent [cache_dir] [--oneshot|--get-clipboard|--copy-clipboard|--clear-primary]
+// Compile: gcc -O3 -I../../../common zes-x11-selection-agent.c -o zes-x11-selection-agent -lX11 -lXfixes
+// Usage:   zes-x11-selection-agent [cache_dir] [--oneshot|--get-clipboard|--copy-clipboard|--clear-primary|--stats|--osc52]
+//
+// In daemon mode the agent also listens on <cache_dir>/agent.sock and
+// answers GET/SET/CLEAR requests over its existing X connection, so the
+// shell can paste and copy without spawning a short-lived agent per call.
+// --copy-clipboard <cache_dir> hands its input to that daemon with SET and
+// only forks its own clipboard server when no daemon accepts it.
+//
+// With ZES_SHM_RING=1 in its environment the daemon publishes PRIMARY into
+// a shared-memory ring (<cache_dir>/ring) instead of the primary/seq pair;
+// see the "Shared-memory ring" section below for the layout.
+//
+// A shell that sends WATCH keeps its socket connection open and is pushed
+// each new PRIMARY value while its terminal has focus, so it can wait on
+// that fd (zle -F) instead of stat()ing the seq file on every redraw.
+//
+// ATTACH <display> makes the one daemon also serve another X display (a
+// nested server, an ssh -X forward) from a display-<key> subdirectory of
+// the cache directory; all connections share one epoll loop.  Only X
+// displays: Wayland seats stay with the Wayland agent.  ATTACH needs
+// XSetIOErrorExitHandler (libX11 >= 1.7, -DHAVE_XSETIOERROREXITHANDLER,
+// set by the Makefile); without it the daemon answers ERR.
+//
+// SIGUSR1 makes the daemon write its metrics to <cache_dir>/agent.metrics;
+// --stats [cache_dir] triggers that and prints the result.
+//
+// --osc52 writes stdin to the terminal as an OSC 52 clipboard sequence
+// (tmux/screen framed) without opening the display, for SSH sessions; the
+// daemon's OSC52 verb returns the same sequence to the shell.
 
 #define _GNU_SOURCE
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
 #include <time.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 #include <X11/extensions/Xfixes.h>
 
-/* Cache-directory filenames and safety cap.
-   PRIMARY_FILE / SEQ_FILE: selected text and change counter.
-   PID_FILE: daemon PID for liveness checks.
-   MAX_SELECTION_SIZE: 1 MB cap on selection reads. */
-#define PRIMARY_FILE "primary"
-#define SEQ_FILE "seq"
-#define PID_FILE "agent.pid"
+/* Size caps (cache-file names live in zes-agent-core.h).
+   MAX_SELECTION_SIZE: 1 MB cap on PRIMARY reads (cache file, ring slot).
+   MAX_TRANSFER_SIZE: cap on clipboard text moved by --copy-clipboard,
+   --get-clipboard and the socket API.
+   INCR_CHUNK_SIZE: largest piece fetched or served per X request. */
 #define MAX_SELECTION_SIZE (1024 * 1024)
-
-static volatile sig_atomic_t running = 1;
-static char cache_dir[512];
-static char primary_path[560];
-static char seq_path[560];
-static char pid_path[560];
+#define MAX_TRANSFER_SIZE (64 * 1024 * 1024)
+#define INCR_CHUNK_SIZE (256 * 1024)
+
+/* Shared daemon core: cache layout, publish, hash/history, metrics and the
+   socket API.  "wait" in the metrics is time blocked on the selection
+   owner's conversion reply and INCR chunks.  This agent is the only one
+   with the shared-memory ring. */
+#define MET_AGENT "x11"
+#define ZES_MAX_PAYLOAD MAX_TRANSFER_SIZE
+#define ZES_CORE_RING
+#include "zes-agent-core.h"
 
 /* X11 connection state and interned selection/target atoms. */
 static Display *dpy = NULL;
+/* Set when an extra display's connection is found broken (see "Multiple
+   displays"); selection waits give up at once instead of polling a dead
+   fd until their deadline. */
+static bool dpy_lost = false;
+/* Persistent window reused by daemon-mode selection reads to avoid
+   per-event XCreateSimpleWindow/XDestroyWindow round-trips.
+   Set once after daemon() in run_daemon(); None in short-lived modes. */
+static Window daemon_win = None;
 static Window root;
 static Atom xa_primary;
 static Atom xa_clipboard;
 static Atom xa_utf8_string;
 static Atom xa_targets;
+static Atom xa_incr;
+static Atom xa_text_plain_utf8;
+static Atom xa_text;
 /* Custom property atoms for selection conversion replies.
    ZES_SEL and ZES_CLIP are used instead of PRIMARY/CLIPBOARD directly
    so the agent's conversion requests do not clobber any property that
    another client may have placed on the same window name. */
 static Atom xa_zes_sel;
 static Atom xa_zes_clip;
+/* First XFixes event code on this connection (daemon mode). */
+static int xfixes_event_base = 0;
+/* Text target chosen for the current owner of each selection by one
+   TARGETS query (see selection_target()); owner None means no choice is
+   cached yet. */
+struct owner_target {
+    Window owner;
+    Atom target;
+};
+static struct owner_target primary_target = { None, None };
+static struct owner_target clipboard_target = { None, None };
 /* Monotonically increasing counter written to SEQ_FILE; the shell polls
    its mtime to detect selection changes without reading content. */
 static unsigned long seq_counter = 0;
 
-/* Persistent fds for write_primary() daemon hot path.
-   Opened once after daemon() in run_daemon(); reused for all subsequent writes.
-   -1 = not yet open (pre-daemon initial write uses the open/write/close fallback). */
-static int fd_primary = -1;
-static int fd_seq     = -1;
+/* Opt-in burst coalescing (ZES_COALESCE_MS): a drag in many terminals
+   changes the PRIMARY owner on every motion step.  With coalesce_us > 0
+   the first owner change only arms primary_due_us on the monotonic clock
+   and every change until then is absorbed; the one read at the deadline
+   publishes the final text and still bumps seq, so a reselect after the
+   window fires as before.  0 reads on every notification. */
+static long long coalesce_us = 0;
+static long long primary_due_us = 0;
+
+/* Clipboard owned by the daemon itself after a socket SET request.
+   clip_win is created on the first SET and reused for every later one;
+   clip_data is the buffer served to paste requestors until another client
+   takes CLIPBOARD (SelectionClear), at which point it is freed. */
+static Window clip_win = None;
+static char *clip_data = NULL;
+static size_t clip_data_len = 0;
+
+/* Registry of shells subscribed with WATCH (see notify_watchers).  A
+   shell is focused until it reports otherwise; only focused shells are
+   woken on a publish. */
+#define MAX_WATCHERS 64
+#define WATCH_PUSH_MAX (16 * 1024)
+struct watcher {
+    int fd;
+    bool focused;
+    unsigned int display;   /* slot of the display it watches */
+};
+static struct watcher watchers[MAX_WATCHERS];
+static unsigned int watcher_count = 0;
+
+/* Slot of the display whose state the variables above hold (see
+   "Multiple displays"), and the daemon's epoll set (-1 outside the
+   daemon).  Each registered fd carries its kind in the high 32 bits of
+   epoll_event.data.u64 and a slot number or fd in the low 32. */
+static unsigned int cur_display = 0;
+static int epoll_fd = -1;
+enum { EV_WAKE, EV_X, EV_SOCK, EV_WATCH };
+
+static void epoll_add(int fd, uint32_t kind, uint32_t n) {
+    /* EPOLLRDHUP: an X server closing its end shows up as such before any
+       Xlib call has to find out the hard way. */
+    struct epoll_event ev = { .events = kind == EV_X ? EPOLLIN | EPOLLRDHUP : EPOLLIN };
+    ev.data.u64 = (uint64_t)kind << 32 | n;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
 
-/* SIGTERM / SIGINT handler — sets the flag that exits the event loop. */
-static void signal_handler(int sig) {
-    (void)sig;
-    running = 0;
+/* ------------------------------------------------------------------ */
+/*  Change notification                                               */
+/* ------------------------------------------------------------------ */
+/* Each focused watcher gets one message per publish: "<len>\n" followed by
+   the text when it is at most WATCH_PUSH_MAX bytes, so the shell needs no
+   file read, or "-\n" (read the cache yourself) for larger selections.
+   Unfocused shells, and shells watching another display, are skipped:
+   the plugin discards selections made while its terminal was in the
+   background anyway.  Sends never block; a
+   watcher whose socket is full or gone is dropped, and the shell falls back
+   to reading the cache when it sees the connection close. */
+static void watcher_remove(unsigned int i) {
+    close(watchers[i].fd);
+    watchers[i] = watchers[--watcher_count];
 }
 
-/* Resolve cache directory path (argument > XDG_RUNTIME_DIR > /dev/shm > HOME),
-   populate path globals, and create the directory.  Returns 0 on success. */
-static int ensure_cache_dir(const char *dir) {
-    if (dir && dir[0]) {
-        snprintf(cache_dir, sizeof(cache_dir), "%s", dir);
-    } else {
-        /* Cache location priority:
-           1. XDG_RUNTIME_DIR/<uid> — tmpfs, survives logout cleanup by PAM.
-           2. /dev/shm — in-memory tmpfs on Linux; fast for short-lived modes.
-           3. HOME/.cache — persistent fallback for non-standard environments. */
-        const char *runtime = getenv("XDG_RUNTIME_DIR");
-        if (runtime) {
-            snprintf(cache_dir, sizeof(cache_dir), "%s/zsh-edit-select-%d",
-                     runtime, (int)getuid());
-        } else if (access("/dev/shm", W_OK | X_OK) == 0) {
-            snprintf(cache_dir, sizeof(cache_dir),
-                     "/dev/shm/zsh-edit-select-%d", (int)getuid());
-        } else {
-            const char *home = getenv("HOME");
-            if (!home) return -1;
-            snprintf(cache_dir, sizeof(cache_dir),
-                     "%s/.cache/zsh-edit-select", home);
+static void notify_watchers(const char *data, size_t len) {
+    char hdr[32];
+    struct iovec iov[2];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+
+    bool push = len <= WATCH_PUSH_MAX;
+    int n = push ? snprintf(hdr, sizeof(hdr), "%zu\n", len)
+                 : snprintf(hdr, sizeof(hdr), "-\n");
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = (size_t)n;
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len = push ? len : 0;
+    msg.msg_iovlen = (push && len > 0) ? 2 : 1;
+    size_t total = iov[0].iov_len + iov[1].iov_len;
+
+    unsigned int i = 0;
+    while (i < watcher_count) {
+        if (watchers[i].focused && watchers[i].display == cur_display) {
+            ssize_t w = sendmsg(watchers[i].fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (w != (ssize_t)total) {
+                /* A short or failed send would desynchronise the stream. */
+                watcher_remove(i);
+                continue;
+            }
         }
+        i++;
     }
+}
 
-    snprintf(primary_path, sizeof(primary_path), "%s/%s", cache_dir, PRIMARY_FILE);
-    snprintf(seq_path, sizeof(seq_path), "%s/%s", cache_dir, SEQ_FILE);
-    snprintf(pid_path, sizeof(pid_path), "%s/%s", cache_dir, PID_FILE);
+/* Adopt cfd as a focused watcher of the current display.  Returns false
+   (caller closes cfd) when the registry is full; hung-up watchers are
+   reaped by the event loop.  close() in watcher_remove() also takes the fd
+   out of the epoll set. */
+static bool watcher_add(int cfd) {
+    if (watcher_count == MAX_WATCHERS) return false;
+    watchers[watcher_count].fd = cfd;
+    watchers[watcher_count].focused = true;
+    watchers[watcher_count].display = cur_display;
+    watcher_count++;
+    epoll_add(cfd, EV_WATCH, (uint32_t)cfd);
+    return true;
+}
+
+/* Read focus reports from watcher i: '1' focus-in, '0' focus-out; the
+   last byte wins.  EOF or an error (shell exited) drops it. */
+static void watcher_read(unsigned int i) {
+    char buf[64];
+    ssize_t n = recv(watchers[i].fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return;
+    if (n <= 0) {
+        watcher_remove(i);
+        return;
+    }
+    for (ssize_t k = n - 1; k >= 0; k--) {
+        if (buf[k] == '0' || buf[k] == '1') {
+            watchers[i].focused = buf[k] == '1';
+            break;
+        }
+    }
+}
 
-    struct stat st;
-    if (stat(cache_dir, &st) == -1) {
-        if (mkdir(cache_dir, 0700) == -1 && errno != EEXIST)
-            return -1;
+#define CONV_TIMEOUT_MS 500
+
+/* Ask the owner of selection to convert it to target into prop on w,
+ * then block in poll() on the X connection until the matching
+ * SelectionNotify is queued or a CLOCK_MONOTONIC deadline passes.  The
+ * caller wakes as soon as the reply arrives, and EINTR cannot stretch the
+ * CONV_TIMEOUT_MS budget.  Notifies left on a reused window by an earlier
+ * timed-out conversion are discarded first.  Returns true with *ev filled in
+ * when the notify arrived. */
+static bool convert_and_wait(Window w, Atom selection, Atom target, Atom prop,
+                             XEvent *ev) {
+    while (XCheckTypedWindowEvent(dpy, w, SelectionNotify, ev))
+        ;
+    XConvertSelection(dpy, selection, target, prop, w, CurrentTime);
+    XFlush(dpy);
+    long long start = monotonic_us();
+    long long deadline = start + CONV_TIMEOUT_MS * 1000LL;
+
+    struct pollfd pfd = { .fd = XConnectionNumber(dpy), .events = POLLIN };
+    bool got = false;
+    for (;;) {
+        /* Also reads whatever has already arrived on the socket. */
+        if (XCheckTypedWindowEvent(dpy, w, SelectionNotify, ev)) {
+            got = true;
+            break;
+        }
+        long long now = monotonic_us();
+        if (now >= deadline)
+            break;
+        int ret = poll(&pfd, 1, (int)((deadline - now + 999) / 1000));
+        if ((ret < 0 && errno != EINTR) || dpy_lost)
+            break;
     }
-    return 0;
+    met_record(&met_wait, monotonic_us() - start);
+    if (!got)
+        met_timeouts++;
+    return got;
 }
 
-/* Write selection text to PRIMARY cache and the sequence number to SEQ.
-   Uses persistent fds in daemon mode, open/write/close otherwise. */
-static void write_primary(const char *data, size_t len, unsigned long seq) {
-    if (fd_primary >= 0) {
-        /* Persistent-fd hot path: seek to start, write new content, then
-           truncate to correct length.  ftruncate is mandatory — without it,
-           content that shrinks between events (e.g. "hello world" → "hi")
-           leaves stale bytes at the end that the shell reads as part of the
-           new selection.  The (void) casts match the existing style. */
-        if (len > 0 && data) {
-            ssize_t r = pwrite(fd_primary, data, len, 0);
-            (void)r;
+/* Return the text target to request from owner, the current owner of
+ * selection.  The choice is cached per owner window, so only the first
+ * read after an ownership change pays for the TARGETS query; every later
+ * read of the same owner converts straight to a type it is known to
+ * serve instead of waiting out CONV_TIMEOUT_MS on one it does not.
+ * Owners that do not answer TARGETS, or list no text type, get
+ * UTF8_STRING as before. */
+static Atom selection_target(Window w, Atom selection, Atom prop, Window owner) {
+    struct owner_target *c = (selection == xa_primary) ? &primary_target
+                                                       : &clipboard_target;
+    if (c->owner == owner && c->target != None)
+        return c->target;
+
+    /* Text types in order of preference. */
+    const Atom prefs[] = { xa_utf8_string, xa_text_plain_utf8, XA_STRING, xa_text };
+    size_t best = sizeof(prefs) / sizeof(prefs[0]);
+
+    XEvent ev;
+    if (convert_and_wait(w, selection, xa_targets, prop, &ev) &&
+        ev.xselection.property != None) {
+        Atom actual_type;
+        int actual_format;
+        unsigned long nitems, bytes_after;
+        unsigned char *xdata = NULL;
+        if (XGetWindowProperty(dpy, w, prop, 0, 1024, True, XA_ATOM,
+                               &actual_type, &actual_format, &nitems,
+                               &bytes_after, &xdata) == Success &&
+            actual_type == XA_ATOM && actual_format == 32) {
+            /* Format-32 property data is handed back as longs. */
+            const long *atoms = (const long *)xdata;
+            for (unsigned long i = 0; i < nitems; i++)
+                for (size_t k = 0; k < best; k++)
+                    if ((Atom)atoms[i] == prefs[k]) { best = k; break; }
         }
-        (void)ftruncate(fd_primary, (off_t)len);
-
-        /* primary must be fully committed before seq is touched —
-           seq's mtime is the shell's only per-keypress detection signal. */
-        char buf[24];
-        int n = snprintf(buf, sizeof(buf), "%lu\n", seq);
-        ssize_t r = pwrite(fd_seq, buf, (size_t)n, 0);
-        (void)r;
-        (void)ftruncate(fd_seq, (off_t)n);
-        return;
+        if (xdata) XFree(xdata);
     }
 
-    /* Fallback path: used for the pre-daemon() initial write (fd_primary is
-       still -1 at that point) and if open() failed after daemon().
-       All short-lived modes (--oneshot, --get-clipboard, --copy-clipboard,
-       --clear-primary) also use this path since they never open persistent fds. */
-    int fd = open(primary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
-    if (fd < 0) return;
-    if (len > 0 && data) {
-        ssize_t r = write(fd, data, len);
-        (void)r;
+    c->owner = owner;
+    c->target = (best < sizeof(prefs) / sizeof(prefs[0])) ? prefs[best]
+                                                          : xa_utf8_string;
+    return c->target;
+}
+
+/* Growable buffer for a selection value arriving in pieces. */
+struct sel_buf {
+    char *data;
+    size_t len;
+    size_t cap;
+    bool scratch; /* grow in the daemon's arena instead of the heap */
+};
+
+/* Append the current value of prop on w to b, fetching it INCR_CHUNK_SIZE
+   bytes per GetProperty reply instead of one MAX_SELECTION_SIZE read that
+   could exceed the server's reply limits.  Stops (truncating) at max bytes.
+   *got receives the number of bytes the property held.  Returns false when
+   the property cannot be read. */
+static bool sel_buf_append_property(struct sel_buf *b, Window w, Atom prop,
+                                    size_t max, size_t *got) {
+    size_t total = 0; /* property bytes fetched so far */
+    *got = 0;
+    for (;;) {
+        Atom actual_type;
+        int actual_format;
+        unsigned long nitems, bytes_after;
+        unsigned char *xdata = NULL;
+
+        if (XGetWindowProperty(dpy, w, prop, (long)(total / 4),
+                               INCR_CHUNK_SIZE / 4, False,
+                               AnyPropertyType, &actual_type, &actual_format,
+                               &nitems, &bytes_after, &xdata) != Success)
+            return false;
+        /* Offsets count 32-bit units; a reply carries nitems items of
+           actual_format bits each. */
+        size_t bytes = nitems * (size_t)(actual_format / 8);
+        total += bytes;
+        /* Text targets are format 8; anything else carries no usable bytes. */
+        size_t n = (actual_format == 8) ? nitems : 0;
+        if (n > max - b->len) n = max - b->len;
+        if (b->len + n + 1 > b->cap) {
+            size_t cap = b->cap ? b->cap : 4096;
+            while (cap < b->len + n + 1) cap *= 2;
+            char *nb = b->scratch ? arena_reserve(cap) : realloc(b->data, cap);
+            if (!nb) { if (xdata) XFree(xdata); return false; }
+            b->data = nb;
+            b->cap = cap;
+        }
+        if (n > 0) memcpy(b->data + b->len, xdata, n);
+        b->len += n;
+        b->data[b->len] = '\0';
+        *got += bytes;
+        if (xdata) XFree(xdata);
+        if (bytes_after == 0 || bytes == 0 || b->len >= max)
+            return true;
+    }
+}
+
+/* Block until prop on w receives a new value (the next INCR chunk), or
+   CONV_TIMEOUT_MS passes without one. */
+static bool wait_property_new_value(Window w, Atom prop) {
+    long long deadline = monotonic_us() + CONV_TIMEOUT_MS * 1000LL;
+    struct pollfd pfd = { .fd = XConnectionNumber(dpy), .events = POLLIN };
+    for (;;) {
+        XEvent ev;
+        while (XCheckTypedWindowEvent(dpy, w, PropertyNotify, &ev)) {
+            if (ev.xproperty.atom == prop && ev.xproperty.state == PropertyNewValue)
+                return true;
+        }
+        long long now = monotonic_us();
+        if (now >= deadline) {
+            met_timeouts++;
+            return false;
+        }
+        int ret = poll(&pfd, 1, (int)((deadline - now + 999) / 1000));
+        if ((ret < 0 && errno != EINTR) || dpy_lost)
+            return false;
+    }
+}
+
+/* Read the conversion reply left in prop on w after a SelectionNotify and
+ * delete the property.  Owners of large selections answer with an INCR
+ * property instead of the text (ICCCM 2.7.2): we then delete it to start
+ * the transfer and collect one chunk per PropertyNewValue until the owner
+ * writes a zero-length chunk.  At most max bytes are kept.
+ *
+ * Returns a NUL-terminated buffer, the daemon's arena when scratch or else
+ * malloc'd (release either with scratch_free()), or NULL if the selection
+ * is empty or the transfer fails or stalls. */
+static char *read_selection_property(Window w, Atom prop, size_t max,
+                                     size_t *out_len, bool scratch) {
+    struct sel_buf b = { NULL, 0, 0, scratch };
+    size_t got = 0;
+    *out_len = 0;
+
+    Atom actual_type;
+    int actual_format;
+    unsigned long nitems, bytes_after;
+    unsigned char *xdata = NULL;
+    if (XGetWindowProperty(dpy, w, prop, 0, 0, False, AnyPropertyType,
+                           &actual_type, &actual_format, &nitems,
+                           &bytes_after, &xdata) != Success)
+        return NULL;
+    if (xdata) XFree(xdata);
+
+    if (actual_type != xa_incr) {
+        bool ok = sel_buf_append_property(&b, w, prop, max, &got);
+        XDeleteProperty(dpy, w, prop);
+        if (!ok || b.len == 0) {
+            scratch_free(b.data);
+            return NULL;
+        }
+        if (b.len >= max)
+            met_oversize++;
+        *out_len = b.len;
+        return b.data;
     }
-    close(fd);
 
-    fd = open(seq_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
-    if (fd >= 0) {
-        char buf[24];
-        int n = snprintf(buf, sizeof(buf), "%lu\n", seq);
-        ssize_t r = write(fd, buf, n);
-        (void)r;
-        close(fd);
+    /* PropertyChangeMask must be selected before the delete that tells the
+       owner to send the first chunk.  Notifies left over from an earlier
+       transfer on a reused window are discarded. */
+    XEvent stale;
+    XSelectInput(dpy, w, PropertyChangeMask);
+    while (XCheckTypedWindowEvent(dpy, w, PropertyNotify, &stale))
+        ;
+    XDeleteProperty(dpy, w, prop);
+    XFlush(dpy);
+
+    bool ok = true;
+    for (;;) {
+        long long wait_start = monotonic_us();
+        bool more = wait_property_new_value(w, prop);
+        met_record(&met_wait, monotonic_us() - wait_start);
+        if (!more) { ok = false; break; }
+        ok = sel_buf_append_property(&b, w, prop, max, &got);
+        /* Deleting the chunk asks the owner for the next one. */
+        XDeleteProperty(dpy, w, prop);
+        XFlush(dpy);
+        if (!ok || got == 0 || b.len >= max) break;
+    }
+    XSelectInput(dpy, w, NoEventMask);
+
+    if (!ok || b.len == 0) {
+        scratch_free(b.data);
+        return NULL;
     }
+    if (b.len >= max)
+        met_oversize++;
+    *out_len = b.len;
+    return b.data;
 }
 
 /* Request PRIMARY selection text from the current owner.
@@ -157,7 +477,7 @@ static void write_primary(const char *data, size_t len, unsigned long seq) {
  * then read it back.  The temporary window is necessary because
  * XConvertSelection requires a requestor window to receive the reply.
  *
- * Returns a malloc'd buffer (caller must free) or NULL if no owner,
+ * Returns a buffer to release with scratch_free(), or NULL if no owner,
  * conversion fails, or the 500 ms timeout expires. */
 static char *get_primary_selection(size_t *out_len) {
     Window owner = XGetSelectionOwner(dpy, xa_primary);
@@ -166,55 +486,27 @@ static char *get_primary_selection(size_t *out_len) {
         return NULL;
     }
 
-    Window w = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
-    XConvertSelection(dpy, xa_primary, xa_utf8_string, xa_zes_sel, w, CurrentTime);
-    XFlush(dpy);
+    /* Reuse the persistent daemon window when available; create a temp
+       window only in short-lived modes (--oneshot, --get-clipboard). */
+    bool ephemeral = (daemon_win == None);
+    Window w = ephemeral ? XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0)
+                         : daemon_win;
 
     XEvent ev;
-    bool got_notify = false;
-    {
-        int xfd = XConnectionNumber(dpy);
-        struct pollfd pfd = { .fd = xfd, .events = POLLIN };
-        int elapsed_ms = 0;
-        while (elapsed_ms < 500) {
-            if (XCheckTypedWindowEvent(dpy, w, SelectionNotify, &ev)) {
-                got_notify = true;
-                break;
-            }
-            /* Short initial polls catch the common 1-5 ms roundtrip without
-               overshooting; longer polls after 20 ms reduce syscall rate. */
-            int wait = (elapsed_ms < 20) ? 5 : 20;
-            int ret = poll(&pfd, 1, wait);
-            if (ret < 0 && errno != EINTR) break;
-            elapsed_ms += wait;
-        }
-    }
+    Atom target = selection_target(w, xa_primary, xa_zes_sel, owner);
+    bool got_notify = convert_and_wait(w, xa_primary, target, xa_zes_sel, &ev);
 
     char *data = NULL;
     *out_len = 0;
 
-    if (got_notify && ev.xselection.property != None) {
-        Atom actual_type;
-        int actual_format;
-        unsigned long nitems, bytes_after;
-        unsigned char *xdata = NULL;
+    if (got_notify && ev.xselection.property != None)
+        data = read_selection_property(w, xa_zes_sel, MAX_SELECTION_SIZE,
+                                       out_len, !ephemeral);
+    else if (got_notify)
+        primary_target.owner = None; /* refused: ask for TARGETS again */
 
-        if (XGetWindowProperty(dpy, w, xa_zes_sel, 0, MAX_SELECTION_SIZE / 4, True,
-                               AnyPropertyType, &actual_type, &actual_format,
-                               &nitems, &bytes_after, &xdata) == Success) {
-            if (xdata && nitems > 0) {
-                data = malloc(nitems + 1);
-                if (data) {
-                    memcpy(data, xdata, nitems);
-                    data[nitems] = '\0';
-                    *out_len = nitems;
-                }
-            }
-            if (xdata) XFree(xdata);
-        }
-    }
-
-    XDestroyWindow(dpy, w);
+    if (ephemeral)
+        XDestroyWindow(dpy, w);
     return data;
 }
 
@@ -222,15 +514,29 @@ static char *get_primary_selection(size_t *out_len) {
    unconditionally update cache, incrementing the sequence counter.
    Called on every XFixes owner-change notification. */
 static void check_and_update_primary(void) {
+    long long start = monotonic_us();
     size_t len = 0;
     char *sel = get_primary_selection(&len);
+    if (trace_fd >= 0) {
+        char *target = primary_target.target != None
+            ? XGetAtomName(dpy, primary_target.target) : NULL;
+        trace_record(TRACE_READ, target, sel, len,
+                     sel ? zes_hash64(sel, len) : 0, monotonic_us() - start);
+        if (target) XFree(target);
+    }
 
     /* Always increment seq even when content is identical — a reselect of
        exactly the same text (e.g. double-click same word) must still trigger
        a fresh event in the shell so the plugin can respond to the new gesture. */
     seq_counter++;
     write_primary(sel ? sel : "", sel ? len : 0, seq_counter);
-    free(sel);
+    notify_watchers(sel ? sel : "", sel ? len : 0);
+    hist_record(sel, len);
+    scratch_free(sel);
+
+    met_events++;
+    met_bytes += len;
+    met_record(&met_event, monotonic_us() - start);
 }
 
 /* Print current PRIMARY selection to stdout and exit.
@@ -260,55 +566,30 @@ static char *get_selection(Atom selection, size_t *out_len) {
     }
 
     Atom prop = (selection == xa_primary) ? xa_zes_sel : xa_zes_clip;
-    Window w = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
-    XConvertSelection(dpy, selection, xa_utf8_string, prop, w, CurrentTime);
-    XFlush(dpy);
+    size_t max = (selection == xa_primary) ? MAX_SELECTION_SIZE : MAX_TRANSFER_SIZE;
+    /* Reuse the persistent daemon window when available; create a temp
+       window only in short-lived modes (--oneshot, --get-clipboard). */
+    bool ephemeral = (daemon_win == None);
+    Window w = ephemeral ? XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0)
+                         : daemon_win;
 
     XEvent ev;
-    bool got_notify = false;
-    {
-        int xfd = XConnectionNumber(dpy);
-        struct pollfd pfd = { .fd = xfd, .events = POLLIN };
-        int elapsed_ms = 0;
-        while (elapsed_ms < 500) {
-            if (XCheckTypedWindowEvent(dpy, w, SelectionNotify, &ev)) {
-                got_notify = true;
-                break;
-            }
-            /* Short initial polls catch the common 1-5 ms roundtrip without
-               overshooting; longer polls after 20 ms reduce syscall rate. */
-            int wait = (elapsed_ms < 20) ? 5 : 20;
-            int ret = poll(&pfd, 1, wait);
-            if (ret < 0 && errno != EINTR) break;
-            elapsed_ms += wait;
-        }
-    }
+    Atom target = selection_target(w, selection, prop, owner);
+    bool got_notify = convert_and_wait(w, selection, target, prop, &ev);
 
     char *data = NULL;
     *out_len = 0;
 
-    if (got_notify && ev.xselection.property != None) {
-        Atom actual_type;
-        int actual_format;
-        unsigned long nitems, bytes_after;
-        unsigned char *xdata = NULL;
-
-        if (XGetWindowProperty(dpy, w, prop, 0, MAX_SELECTION_SIZE / 4, True,
-                               AnyPropertyType, &actual_type, &actual_format,
-                               &nitems, &bytes_after, &xdata) == Success) {
-            if (xdata && nitems > 0) {
-                data = malloc(nitems + 1);
-                if (data) {
-                    memcpy(data, xdata, nitems);
-                    data[nitems] = '\0';
-                    *out_len = nitems;
-                }
-            }
-            if (xdata) XFree(xdata);
-        }
+    if (got_notify && ev.xselection.property != None)
+        data = read_selection_property(w, prop, max, out_len, !ephemeral);
+    else if (got_notify) {
+        /* Refused: ask the owner for TARGETS again next time. */
+        if (selection == xa_primary) primary_target.owner = None;
+        else clipboard_target.owner = None;
     }
 
-    XDestroyWindow(dpy, w);
+    if (ephemeral)
+        XDestroyWindow(dpy, w);
     return data;
 }
 
@@ -325,34 +606,110 @@ static int run_get_clipboard(void) {
     return 1;
 }
 
-/* Read all of stdin into a malloc'd buffer.  Used by --copy-clipboard
- * to capture the text to be placed on the clipboard before the agent
- * connects to X and takes ownership. */
-static char *read_all_stdin(size_t *out_len) {
-    size_t capacity = 4096, total = 0;
-    char *buf = malloc(capacity);
-    if (!buf) return NULL;
-
-    while (1) {
-        if (total + 4096 > capacity) {
-            capacity *= 2;
-            if (capacity > MAX_SELECTION_SIZE) break;
-            char *nb = realloc(buf, capacity);
-            if (!nb) { free(buf); *out_len = 0; return NULL; }
-            buf = nb;
+/* In-flight INCR transfers being served (ICCCM 2.7.2).  A requestor asking
+   for more than incr_chunk_size() bytes gets an INCR property holding the
+   total length; each time it deletes the property the next chunk is written,
+   and a zero-length chunk ends the transfer.  Slots whose requestor went
+   quiet for INCR_STALE_MS (window destroyed, client killed) are reused. */
+#define INCR_MAX_XFERS 8
+#define INCR_STALE_MS 5000
+struct incr_xfer {
+    Window requestor;   /* None when the slot is free */
+    Atom property;
+    Atom target;
+    const char *data;
+    size_t len;
+    size_t off;
+    long long last_us;
+};
+static struct incr_xfer incr_xfers[INCR_MAX_XFERS];
+
+/* Largest value written in one ChangeProperty: INCR_CHUNK_SIZE, or less when
+   the server's maximum request size (in 4-byte units) is smaller. */
+static size_t incr_chunk_size(void) {
+    long max_req = XExtendedMaxRequestSize(dpy);
+    if (max_req == 0) max_req = XMaxRequestSize(dpy);
+    size_t bytes = (size_t)max_req * 4 - 256;   /* ChangeProperty header room */
+    return bytes < INCR_CHUNK_SIZE ? bytes : INCR_CHUNK_SIZE;
+}
+
+/* Begin an INCR transfer of data to req's property.  Returns false when
+   every slot is busy, in which case the request is refused. */
+static bool incr_start(XSelectionRequestEvent *req, const char *data, size_t len) {
+    long long now = monotonic_us();
+    struct incr_xfer *x = NULL;
+    for (int i = 0; i < INCR_MAX_XFERS; i++) {
+        if (incr_xfers[i].requestor == None ||
+            now - incr_xfers[i].last_us > INCR_STALE_MS * 1000LL) {
+            x = &incr_xfers[i];
+            break;
         }
-        ssize_t n = read(STDIN_FILENO, buf + total, 4096);
-        if (n > 0) total += n;
-        else break;
     }
-    *out_len = total;
-    return buf;
+    if (!x) return false;
+
+    x->requestor = req->requestor;
+    x->property = req->property;
+    x->target = req->target;
+    x->data = data;
+    x->len = len;
+    x->off = 0;
+    x->last_us = now;
+
+    long total = (long)len;
+    XSelectInput(dpy, req->requestor, PropertyChangeMask);
+    XChangeProperty(dpy, req->requestor, req->property, xa_incr, 32,
+                    PropModeReplace, (unsigned char *)&total, 1);
+    return true;
+}
+
+/* Advance the transfer whose property the requestor just deleted.
+   Returns true if pev belonged to one of our transfers. */
+static bool incr_handle_property(XPropertyEvent *pev) {
+    if (pev->state != PropertyDelete) return false;
+    for (int i = 0; i < INCR_MAX_XFERS; i++) {
+        struct incr_xfer *x = &incr_xfers[i];
+        if (x->requestor != pev->window || x->property != pev->atom)
+            continue;
+        size_t n = x->len - x->off;
+        size_t chunk = incr_chunk_size();
+        if (n > chunk) n = chunk;
+        XChangeProperty(dpy, x->requestor, x->property, x->target, 8,
+                        PropModeReplace, (unsigned char *)x->data + x->off, (int)n);
+        x->off += n;
+        x->last_us = monotonic_us();
+        if (n == 0) {
+            /* Zero-length chunk written: transfer complete. */
+            XSelectInput(dpy, x->requestor, NoEventMask);
+            x->requestor = None;
+        }
+        XFlush(dpy);
+        return true;
+    }
+    return false;
+}
+
+/* Drop transfers reading from data before the buffer is freed. */
+static void incr_cancel(const char *data) {
+    for (int i = 0; i < INCR_MAX_XFERS; i++) {
+        if (incr_xfers[i].requestor != None && incr_xfers[i].data == data)
+            incr_xfers[i].requestor = None;
+    }
+}
+
+/* A paste requestor may destroy its window mid-transfer; the resulting
+   BadWindow from our next ChangeProperty must not take the default Xlib
+   handler's exit() path and kill the daemon.  Other errors still do. */
+static int (*prev_x_error_handler)(Display *, XErrorEvent *) = NULL;
+static int x_error_handler(Display *d, XErrorEvent *e) {
+    if (e->error_code == BadWindow) return 0;
+    return prev_x_error_handler ? prev_x_error_handler(d, e) : 0;
 }
 
 /* Respond to a SelectionRequest event.
  * TARGETS: advertise supported conversion types; required by spec so
  * requestors can skip unsupported formats without timing out.
- * UTF8_STRING / XA_STRING: write text data into the requestor's property. */
+ * UTF8_STRING / XA_STRING: write text data into the requestor's property,
+ * or start an INCR transfer when it does not fit in one request. */
 static int handle_selection_request(XSelectionRequestEvent *req,
                                      const char *data, size_t data_len) {
     XEvent response;
@@ -371,10 +728,15 @@ static int handle_selection_request(XSelectionRequestEvent *req,
                         (unsigned char *)targets, 3);
         response.xselection.property = req->property;
     } else if (req->target == xa_utf8_string || req->target == XA_STRING) {
-        XChangeProperty(dpy, req->requestor, req->property,
-                        req->target, 8, PropModeReplace,
-                        (unsigned char *)data, data_len);
-        response.xselection.property = req->property;
+        if (data_len > incr_chunk_size()) {
+            if (incr_start(req, data, data_len))
+                response.xselection.property = req->property;
+        } else {
+            XChangeProperty(dpy, req->requestor, req->property,
+                            req->target, 8, PropModeReplace,
+                            (unsigned char *)data, data_len);
+            response.xselection.property = req->property;
+        }
     }
 
     XSendEvent(dpy, req->requestor, False, 0, &response);
@@ -382,12 +744,14 @@ static int handle_selection_request(XSelectionRequestEvent *req,
     return 0;
 }
 
-/* Set stdin as the clipboard and serve paste requests from the background.
- * After taking ownership, forks a background child that loops serving
- * SelectionRequest events.  The parent exits immediately so the shell
- * is not blocked.  The child exits when another app clears the selection
- * or after a 50-second idle timeout (to prevent zombies in unusual cases). */
-static int run_copy_clipboard(void) {
+/* Set stdin as the clipboard.  When a daemon is listening on the cache
+ * directory's socket the text is handed to it (SET) and served from its
+ * persistent connection; nothing is forked.  Otherwise this takes ownership
+ * and forks a background child that loops serving SelectionRequest events.
+ * The parent exits immediately so the shell is not blocked.  The child exits
+ * when another app clears the selection or after a 50-second idle timeout
+ * (to prevent zombies in unusual cases). */
+static int run_copy_clipboard(const char *cache_dir_arg) {
     size_t data_len = 0;
     char *data = read_all_stdin(&data_len);
     if (!data || data_len == 0) {
@@ -395,6 +759,12 @@ static int run_copy_clipboard(void) {
         return 1;
     }
 
+    if (resolve_cache_dir(cache_dir_arg) == 0 &&
+        sock_client_request("SET", data, data_len, NULL, NULL) == 0) {
+        free(data);
+        return 0;
+    }
+
     Window w = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
     XSetSelectionOwner(dpy, xa_clipboard, w, CurrentTime);
 
@@ -444,6 +814,8 @@ static int run_copy_clipboard(void) {
                 handle_selection_request(&ev.xselectionrequest, data, data_len);
                 selection_served = true;
                 timeout_count = 0;
+            } else if (ev.type == PropertyNotify) {
+                incr_handle_property(&ev.xproperty);
             } else if (ev.type == SelectionClear) {
                 running = 0;
                 break;
@@ -476,8 +848,447 @@ static int run_clear_primary(void) {
     return 0;
 }
 
+/* Look up root and intern the standard X11 selection atoms for conversion
+   requests on dpy.  Atom values are per server, so every connection the
+   daemon opens needs its own set. */
+static void intern_atoms(void) {
+    root = DefaultRootWindow(dpy);
+    xa_primary = XInternAtom(dpy, "PRIMARY", False);
+    xa_clipboard = XInternAtom(dpy, "CLIPBOARD", False);
+    xa_utf8_string = XInternAtom(dpy, "UTF8_STRING", False);
+    xa_targets = XInternAtom(dpy, "TARGETS", False);
+    xa_incr = XInternAtom(dpy, "INCR", False);
+    xa_text_plain_utf8 = XInternAtom(dpy, "text/plain;charset=utf-8", False);
+    xa_text = XInternAtom(dpy, "TEXT", False);
+    /* ZES_SEL / ZES_CLIP: private property names used as conversion targets.
+       Using unique names avoids clashing with properties written by other
+       apps on windows that happen to share a name. */
+    xa_zes_sel = XInternAtom(dpy, "ZES_SEL", False);
+    xa_zes_clip = XInternAtom(dpy, "ZES_CLIP", False);
+}
+
+/* Handle every event Xlib has queued for the current display.  Called after
+   anything that may have read from the connection, since events already
+   buffered by Xlib do not make its fd readable again. */
+static void drain_x_events(void) {
+    while (!dpy_lost && XPending(dpy) > 0) {
+        XEvent ev;
+        XNextEvent(dpy, &ev);
+        if (ev.type == xfixes_event_base + XFixesSelectionNotify) {
+            XFixesSelectionNotifyEvent *sev = (XFixesSelectionNotifyEvent *)&ev;
+            if (sev->selection == xa_primary) {
+                trace_record(TRACE_NOTIFY, NULL, NULL, 0, 0, 0);
+                if (!coalesce_us)
+                    check_and_update_primary();
+                else if (!primary_due_us)
+                    primary_due_us = monotonic_us() + coalesce_us;
+            }
+        } else if (ev.type == SelectionRequest && clip_data &&
+                   ev.xselectionrequest.owner == clip_win) {
+            handle_selection_request(&ev.xselectionrequest,
+                                     clip_data, clip_data_len);
+        } else if (ev.type == PropertyNotify) {
+            incr_handle_property(&ev.xproperty);
+        } else if (ev.type == SelectionClear &&
+                   ev.xselectionclear.window == clip_win) {
+            /* Another client copied — stop serving our buffer. */
+            incr_cancel(clip_data);
+            free(clip_data);
+            clip_data = NULL;
+            clip_data_len = 0;
+        }
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/*  Multiple displays                                                 */
+/* ------------------------------------------------------------------ */
+/* One daemon serves every X display its user's shells run on — an
+ * Xwayland :0 next to a nested :1, an ssh -X forward — instead of one
+ * daemon per display.  Wayland seats are not joined: they stay with the
+ * Wayland agent, since serving them here would link libwayland into the
+ * X11 agent.  Slot 0 is the display the daemon was started on and
+ * publishes to the cache directory itself.  A shell whose DISPLAY differs
+ * sends ATTACH and is answered with the directory of another slot,
+ * <cache_dir>/display-<key>, holding that display's own primary/seq pair,
+ * agent.pid and agent.sock (whose requests act on that display).  The
+ * history, the metrics and the ring (slot 0 only) stay per process.  Every
+ * connection and socket sits in the one epoll set, so the loop wakes once
+ * per event whatever the number of displays.
+ *
+ * The selection code works on the file-scope connection state, so
+ * display_select() saves it into the current slot and loads another slot's
+ * copy before that display's events or requests are handled.
+ *
+ * A lost extra connection (a forward closing) must not end the daemon.
+ * epoll reports the hang-up on its fd before any Xlib call, and a break
+ * Xlib runs into mid-call reaches x_io_error_handler(), which returns
+ * instead of exiting, and then the per-display XSetIOErrorExitHandler(),
+ * which only sets dpy_lost.  Xlib has flagged the connection by then and
+ * makes no further requests on it, so the call unwinds normally and the
+ * loop drops the slot with a full XCloseDisplay().  Before libX11 1.7
+ * there is no exit handler and a break mid-call is fatal, so that build
+ * refuses ATTACH.  Losing slot 0 still ends the daemon. */
+#define MAX_DISPLAYS 8
+#define DISPLAY_DIR_PREFIX "display-"
+
+/* Saved copy of one display's state.  The fields after sock_fd mirror the
+   file-scope variables of the same names, listed in DISPLAY_STATE. */
+struct x_display {
+    bool used;
+    char name[128];     /* DISPLAY without its screen number */
+    char dir[512];      /* cache directory the slot publishes to */
+    int sock_fd;        /* listening socket, or -1 */
+    Display *dpy;
+    bool dpy_lost;
+    Window root, daemon_win, clip_win;
+    Atom xa_primary, xa_clipboard, xa_utf8_string, xa_targets, xa_incr;
+    Atom xa_text_plain_utf8, xa_text, xa_zes_sel, xa_zes_clip;
+    int xfixes_event_base;
+    struct owner_target primary_target, clipboard_target;
+    unsigned long seq_counter;
+    long long primary_due_us;
+    char *clip_data;
+    size_t clip_data_len;
+    struct incr_xfer incr_xfers[INCR_MAX_XFERS];
+    int fd_primary, fd_seq;
+    char *ring_map;
+    char primary_path[560], seq_path[560], pid_path[560], sock_path[560];
+};
+
+#define DISPLAY_STATE(X)                                                   \
+    X(dpy) X(dpy_lost) X(root) X(daemon_win) X(clip_win)                   \
+    X(xa_primary) X(xa_clipboard) X(xa_utf8_string) X(xa_targets)          \
+    X(xa_incr) X(xa_text_plain_utf8) X(xa_text) X(xa_zes_sel)              \
+    X(xa_zes_clip) X(xfixes_event_base) X(primary_target)                  \
+    X(clipboard_target) X(seq_counter) X(primary_due_us) X(clip_data)      \
+    X(clip_data_len) X(incr_xfers) X(fd_primary) X(fd_seq) X(ring_map)     \
+    X(primary_path) X(seq_path) X(pid_path) X(sock_path)
+#define DISPLAY_SAVE(f) memcpy(&s->f, &f, sizeof(f));
+#define DISPLAY_LOAD(f) memcpy(&f, &s->f, sizeof(f));
+
+static struct x_display displays[MAX_DISPLAYS];
+/* Slot 0's connection, the one whose loss Xlib still exits on. */
+static Display *main_dpy = NULL;
+
+static void display_load(unsigned int i) {
+    struct x_display *s = &displays[i];
+    DISPLAY_STATE(DISPLAY_LOAD)
+    cur_display = i;
+}
+
+static void display_select(unsigned int i) {
+    if (i == cur_display) return;
+    struct x_display *s = &displays[cur_display];
+    DISPLAY_STATE(DISPLAY_SAVE)
+    display_load(i);
+}
+
+/* Flag slot i's connection as broken; the current slot's flag lives in
+   the file-scope variable. */
+static void display_mark_lost(unsigned int i) {
+    if (i == cur_display)
+        dpy_lost = true;
+    else
+        displays[i].dpy_lost = true;
+}
+
+/* Xlib calls this when a connection breaks.  The default handler exits;
+   for an extra display, return and let its exit handler below take over. */
+static int (*prev_x_io_error_handler)(Display *) = NULL;
+static int x_io_error_handler(Display *d) {
+    if (d != main_dpy) return 0;
+    return prev_x_io_error_handler ? prev_x_io_error_handler(d) : 0;
+}
+
+#ifdef HAVE_XSETIOERROREXITHANDLER
+/* Called after x_io_error_handler() for an extra display in place of
+   exit(): mark its slot lost and return into the failed Xlib call. */
+static void x_io_exit_handler(Display *d, void *user_data) {
+    for (unsigned int i = 1; i < MAX_DISPLAYS; i++) {
+        Display *slot_dpy = i == cur_display ? dpy : displays[i].dpy;
+        if (displays[i].used && slot_dpy == d)
+            display_mark_lost(i);
+    }
+}
+#endif
+
+/* Copy DISPLAY without its screen number (":1.0" → ":1"): selections
+   belong to the display, not the screen. */
+static void display_name(char *out, size_t size, const char *name) {
+    snprintf(out, size, "%s", name);
+    char *colon = strrchr(out, ':');
+    char *dot = colon ? strchr(colon, '.') : NULL;
+    if (dot) *dot = '\0';
+}
+
+/* Tear slot i (> 0) down: its watchers, windows, buffers, files and socket
+   go, its connection is closed and its cache directory removed.  A lost
+   connection is closed the same way: Xlib has flagged it, or flags it on
+   the first request XCloseDisplay() sends, and only frees it from then on.
+   Leaves slot 0 selected. */
+static void display_drop(unsigned int i) {
+    display_select(i);
+    for (unsigned int w = watcher_count; w-- > 0;) {
+        if (watchers[w].display == i)
+            watcher_remove(w);
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, ConnectionNumber(dpy), NULL);
+    incr_cancel(clip_data);
+    if (!dpy_lost) {
+        if (clip_win != None) XDestroyWindow(dpy, clip_win);
+        if (daemon_win != None) XDestroyWindow(dpy, daemon_win);
+    }
+    XCloseDisplay(dpy);
+    free(clip_data);
+    if (fd_primary >= 0) close(fd_primary);
+    if (fd_seq >= 0) close(fd_seq);
+
+    struct x_display *s = &displays[i];
+    if (s->sock_fd >= 0) close(s->sock_fd);
+    unlink(primary_path);
+    unlink(seq_path);
+    unlink(pid_path);
+    unlink(sock_path);
+    rmdir(s->dir);
+    memset(s, 0, sizeof(*s));
+    /* The globals still hold the dropped display: load, do not save. */
+    display_load(0);
+}
+
+/* Return the slot serving DISPLAY name, opening the display and its cache
+   directory on first use, or -1 when it cannot be opened, lacks XFixes, or
+   every slot is taken.  The caller's slot is selected again on return. */
+static int display_attach(const char *name) {
+    char norm[sizeof(displays[0].name)];
+    display_name(norm, sizeof(norm), name);
+    int slot = -1;
+    for (unsigned int i = 0; i < MAX_DISPLAYS; i++) {
+        if (displays[i].used && strcmp(displays[i].name, norm) == 0)
+            return (int)i;
+        if (!displays[i].used && slot < 0)
+            slot = (int)i;
+    }
+#ifndef HAVE_XSETIOERROREXITHANDLER
+    /* Losing the display mid-call would end the daemon. */
+    slot = -1;
+#endif
+    if (slot < 0 || !norm[0]) return -1;
+
+    Display *d = XOpenDisplay(norm);
+    if (!d) return -1;
+#ifdef HAVE_XSETIOERROREXITHANDLER
+    XSetIOErrorExitHandler(d, x_io_exit_handler, NULL);
+#endif
+    int event_base, error_base;
+    if (!XFixesQueryExtension(d, &event_base, &error_base)) {
+        XCloseDisplay(d);
+        return -1;
+    }
+
+    /* The key keeps the directory name to [A-Za-z0-9._-]. */
+    char key[sizeof(norm)];
+    size_t k = 0;
+    for (; norm[k]; k++) {
+        char c = norm[k];
+        bool plain = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+                     (c >= '0' && c <= '9') || c == '.' || c == '-';
+        key[k] = plain ? c : '_';
+    }
+    key[k] = '\0';
+
+    struct x_display *s = &displays[slot];
+    memset(s, 0, sizeof(*s));
+    snprintf(s->dir, sizeof(s->dir), "%s/" DISPLAY_DIR_PREFIX "%s", cache_dir, key);
+    if (mkdir(s->dir, 0700) != 0 && errno != EEXIST) {
+        XCloseDisplay(d);
+        return -1;
+    }
+    s->used = true;
+    snprintf(s->name, sizeof(s->name), "%s", norm);
+    s->sock_fd = -1;
+    s->dpy = d;
+    s->xfixes_event_base = event_base;
+    s->fd_primary = s->fd_seq = -1;
+    /* The slot's own paths, so write_primary()'s fallback and the
+       teardown never touch the base directory's files. */
+    snprintf(s->primary_path, sizeof(s->primary_path), "%s/%s", s->dir, PRIMARY_FILE);
+    snprintf(s->seq_path, sizeof(s->seq_path), "%s/%s", s->dir, SEQ_FILE);
+    snprintf(s->pid_path, sizeof(s->pid_path), "%s/%s", s->dir, PID_FILE);
+    snprintf(s->sock_path, sizeof(s->sock_path), "%s/%s", s->dir, SOCK_FILE);
+
+    unsigned int from = cur_display;
+    display_select((unsigned int)slot);
+
+    intern_atoms();
+    XFixesSelectSelectionInput(dpy, root, xa_primary,
+                               XFixesSetSelectionOwnerNotifyMask);
+    daemon_win = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
+
+    fd_primary = open(primary_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    fd_seq = open(seq_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    FILE *f = fopen(pid_path, "w");
+    if (f) { fprintf(f, "%d\n", getpid()); fclose(f); }
+    s->sock_fd = sock_listen_at(sock_path);
+
+    seq_counter = (unsigned long)time(NULL);
+    check_and_update_primary();
+    drain_x_events();
+
+    epoll_add(ConnectionNumber(dpy), EV_X, (uint32_t)slot);
+    if (s->sock_fd >= 0)
+        epoll_add(s->sock_fd, EV_SOCK, (uint32_t)slot);
+
+    if (dpy_lost) {
+        display_drop((unsigned int)slot);
+        display_select(from);
+        return -1;
+    }
+    display_select(from);
+    return slot;
+}
+
+/* ------------------------------------------------------------------ */
+/*  Daemon socket API                                                 */
+/* ------------------------------------------------------------------ */
+/* The daemon listens on SOCK_FILE so the shell can read and write the
+ * clipboard over the daemon's existing X connection instead of fork+exec'ing
+ * this binary (and re-opening the display, re-interning atoms) per paste.
+ * One request per connection:
+ *   request:   "<VERB> <len>\n" followed by <len> payload bytes
+ *   response:  "OK <len>\n" followed by <len> payload bytes, or "ERR\n"
+ * Verbs: GET (clipboard text), SET (own CLIPBOARD with the payload),
+ *        CLEAR (clear PRIMARY), HIST (payload "k": history entry k,
+ *        0 = newest; ERR when out of range), WATCH (answered "OK 0"; the
+ *        connection then stays open: the daemon pushes each PRIMARY
+ *        publish to it while focused, and the shell writes '1'/'0' on
+ *        focus-in/-out), OSC52 (payload "<frame>\n<text>": the OSC 52
+ *        sequence for the shell to write to its tty), ATTACH (payload a
+ *        DISPLAY: the cache directory serving it, see "Multiple
+ *        displays"; ERR when the daemon cannot open it).
+ * Each slot's socket answers for its own display. */
+
+/* Take CLIPBOARD ownership with the daemon's persistent clip_win.  On
+   success the buffer is adopted (the previous one is freed); on failure
+   the caller's buffer is freed. */
+static bool daemon_set_clipboard(char *data, size_t len) {
+    if (clip_win == None)
+        clip_win = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
+    XSetSelectionOwner(dpy, xa_clipboard, clip_win, CurrentTime);
+    if (XGetSelectionOwner(dpy, xa_clipboard) != clip_win) {
+        free(data);
+        return false;
+    }
+    XFlush(dpy);
+    incr_cancel(clip_data);
+    free(clip_data);
+    clip_data = data;
+    clip_data_len = len;
+    return true;
+}
+
+/* Accept one client on the listening socket and serve its request. */
+static void handle_sock_request(int listen_fd) {
+    int cfd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (cfd < 0) return;
+
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 500000 };
+    setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    char verb[16];
+    char *payload = NULL;
+    size_t payload_len = 0;
+    if (sock_read_request(cfd, verb, sizeof(verb), &payload, &payload_len) != 0) {
+        sock_reply(cfd, false, NULL, 0);
+        close(cfd);
+        return;
+    }
+
+    if (strcmp(verb, "GET") == 0) {
+        if (clip_data) {
+            /* We are the owner — converting to ourselves would stall this
+               loop until the 500 ms timeout, so answer from the buffer. */
+            sock_reply(cfd, true, clip_data, clip_data_len);
+        } else {
+            size_t len = 0;
+            char *data = get_selection(xa_clipboard, &len);
+            hist_record(data, len);
+            sock_reply(cfd, true, data, data ? len : 0);
+            scratch_free(data);
+        }
+    } else if (strcmp(verb, "SET") == 0) {
+        /* daemon_set_clipboard() adopts or frees the payload. */
+        bool ok = payload && daemon_set_clipboard(payload, payload_len);
+        payload = NULL;
+        if (ok) hist_record(clip_data, clip_data_len);
+        sock_reply(cfd, ok, NULL, 0);
+    } else if (strcmp(verb, "CLEAR") == 0) {
+        /* The resulting XFixes notification writes the empty cache entry. */
+        XSetSelectionOwner(dpy, xa_primary, None, CurrentTime);
+        XFlush(dpy);
+        sock_reply(cfd, true, NULL, 0);
+    } else if (strcmp(verb, "HIST") == 0) {
+        unsigned long k = payload ? strtoul(payload, NULL, 10) : 0;
+        if (k < hist_count)
+            sock_reply(cfd, true, hist_arena + hist[k].off, hist[k].len);
+        else
+            sock_reply(cfd, false, NULL, 0);
+    } else if (strcmp(verb, "STATS") == 0) {
+        char buf[MET_TEXT_MAX];
+        size_t n = met_format(buf, sizeof(buf));
+        sock_reply(cfd, true, buf, n);
+    } else if (strcmp(verb, "OSC52") == 0) {
+        osc52_sock_reply(cfd, payload, payload_len);
+    } else if (strcmp(verb, "ATTACH") == 0) {
+        int slot = payload ? display_attach(payload) : -1;
+        if (slot >= 0)
+            sock_reply(cfd, true, displays[slot].dir, strlen(displays[slot].dir));
+        else
+            sock_reply(cfd, false, NULL, 0);
+    } else if (strcmp(verb, "WATCH") == 0) {
+        if (watcher_add(cfd)) {
+            sock_reply(cfd, true, NULL, 0);
+            free(payload);
+            return;
+        }
+        sock_reply(cfd, false, NULL, 0);
+    } else {
+        sock_reply(cfd, false, NULL, 0);
+    }
+
+    free(payload);
+    close(cfd);
+}
+
+/* Coalescing deadline of slot i (0 = none); the current slot's lives in
+   the file-scope variable. */
+static long long display_due_us(unsigned int i) {
+    return i == cur_display ? primary_due_us : displays[i].primary_due_us;
+}
+
+/* Serve slot i: one socket request when sock_ready, then its queued X
+   events (the request may have read some), then the coalesced PRIMARY
+   read once its deadline has passed.  An extra display whose connection
+   broke before or during the service is dropped instead. */
+static void display_service(unsigned int i, bool sock_ready) {
+    display_select(i);
+    if (!dpy_lost) {
+        if (sock_ready && displays[i].sock_fd >= 0)
+            handle_sock_request(displays[i].sock_fd);
+        drain_x_events();
+        if (primary_due_us && monotonic_us() >= primary_due_us) {
+            primary_due_us = 0;
+            check_and_update_primary();
+            drain_x_events();
+        }
+    }
+    if (dpy_lost)
+        display_drop(i);
+}
+
 /* Daemon mode: validate XFixes, set up cache, daemonise, subscribe to
-   PRIMARY owner-change events, and enter the poll-based event loop
+   PRIMARY owner-change events, and enter the epoll-based event loop
    writing selection changes to cache until SIGTERM. */
 static int run_daemon(const char *cache_dir_arg) {
     if (ensure_cache_dir(cache_dir_arg) != 0) {
@@ -485,7 +1296,7 @@ static int run_daemon(const char *cache_dir_arg) {
         return 1;
     }
 
-    int xfixes_event_base, xfixes_error_base;
+    int xfixes_error_base;
     if (!XFixesQueryExtension(dpy, &xfixes_event_base, &xfixes_error_base)) {
         fprintf(stderr, "XFixes extension not available\n");
         return 1;
@@ -498,6 +1309,24 @@ static int run_daemon(const char *cache_dir_arg) {
                                 XFixesSetSelectionOwnerNotifyMask);
     XFlush(dpy);
 
+    /* Opt-in shared-memory ring.  Mapped before daemon() so the initial
+       publish below already lands in it; the MAP_SHARED mapping survives
+       the fork.  Without the opt-in (or if mapping fails) a ring left by a
+       previous daemon is removed so readers fall back to the file layout. */
+    const char *ring_env = getenv("ZES_SHM_RING");
+    if (!(ring_env && strcmp(ring_env, "1") == 0 && ring_open() == 0))
+        unlink(ring_path);
+
+    /* Opt-in coalescing window, clamped to one second. */
+    const char *coalesce_env = getenv("ZES_COALESCE_MS");
+    long coalesce_ms = coalesce_env ? strtol(coalesce_env, NULL, 10) : 0;
+    if (coalesce_ms > 0)
+        coalesce_us = (coalesce_ms > 1000 ? 1000 : coalesce_ms) * 1000LL;
+
+    /* Opt-in event trace (ZES_TRACE), opened while the shell's working
+       directory is still ours. */
+    trace_open();
+
     /* Write empty cache files before daemonising so the shell never tries
        to read a non-existent file during the startup window.
        seq is seeded to time(NULL) so it is monotonically increasing across
@@ -505,6 +1334,9 @@ static int run_daemon(const char *cache_dir_arg) {
     seq_counter = (unsigned long)time(NULL);
     write_primary("", 0, seq_counter);
 
+    /* Keep the shell's readiness pipe across daemon(); see ready_notify(). */
+    ready_fd_take();
+
     if (daemon(0, 0) != 0) {
         perror("daemon");
         return 1;
@@ -513,48 +1345,141 @@ static int run_daemon(const char *cache_dir_arg) {
     FILE *f = fopen(pid_path, "w");
     if (f) { fprintf(f, "%d\n", getpid()); fclose(f); }
 
+    if (pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        unlink(pid_path);
+        return 1;
+    }
     signal(SIGTERM, signal_handler);
     signal(SIGINT, signal_handler);
     signal(SIGHUP, signal_handler);
+    signal(SIGUSR1, met_signal_handler);
+    /* Closing a lost extra display writes to its dead socket once. */
+    signal(SIGPIPE, SIG_IGN);
+    met_start_us = monotonic_us();
+
+    /* Open persistent fds for write_primary() hot path (file layout only) */
+    if (!ring_map) {
+        fd_primary = open(primary_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        fd_seq     = open(seq_path,    O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    }
 
-    /* Open persistent fds for write_primary() hot path */
-    fd_primary = open(primary_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
-    fd_seq     = open(seq_path,    O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    /* Create a persistent window for selection conversion requests.
+       Reused by get_primary_selection() and get_selection() to avoid
+       per-event XCreateSimpleWindow/XDestroyWindow round-trips. */
+    daemon_win = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
+
+    /* Request socket for the shell's GET/SET/CLEAR calls.  -1 is not
+       fatal: the shell falls back to spawning the agent per call. */
+    int sock_fd = sock_listen();
 
     /* Do an initial read before entering the event loop to populate the
        cache with the current selection state. */
     check_and_update_primary();
 
-    /* poll()-based event loop: XNextEvent() blocks indefinitely and with
-       glibc's signal() (SA_RESTART), SIGTERM cannot interrupt it.  Using
-       poll() with a 1-second timeout ensures clean shutdown within 1s.
-       XPending() drains Xlib's internal buffer before we call poll() again
-       — data may have arrived during a previous read() that filled Xlib's
-       buffer with multiple events. */
-    {
-        int xfd = XConnectionNumber(dpy);
-        while (running) {
-            struct pollfd pfd = { .fd = xfd, .events = POLLIN };
-            int ret = poll(&pfd, 1, 1000);
-            if (ret < 0 && errno != EINTR) break;
-            while (XPending(dpy) > 0) {
-                XEvent ev;
-                XNextEvent(dpy, &ev);
-                if (ev.type == xfixes_event_base + XFixesSelectionNotify) {
-                    XFixesSelectionNotifyEvent *sev = (XFixesSelectionNotifyEvent *)&ev;
-                    if (sev->selection == xa_primary) {
-                        check_and_update_primary();
+    /* Slot 0 is this display, published to the cache directory itself;
+       ATTACH adds the others (see "Multiple displays"). */
+    main_dpy = dpy;
+    displays[0].used = true;
+    display_name(displays[0].name, sizeof(displays[0].name), getenv("DISPLAY"));
+    snprintf(displays[0].dir, sizeof(displays[0].dir), "%s", cache_dir);
+    displays[0].sock_fd = sock_fd;
+    prev_x_io_error_handler = XSetIOErrorHandler(x_io_error_handler);
+
+    /* epoll-based event loop: XNextEvent() blocks indefinitely and with
+       glibc's signal() (SA_RESTART), SIGTERM cannot interrupt it.
+       epoll_wait() blocks with no timeout — the daemon does not wake while
+       idle — and the signal handlers reach it through wake_pipe.  Every
+       display's X connection and socket and every watcher share the set;
+       a display is serviced only when one of its fds is ready, and
+       drain_x_events() empties Xlib's queue each time, since events it
+       already buffered do not make the fd readable again. */
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        running = 0;
+    } else {
+        epoll_add(wake_pipe[0], EV_WAKE, 0);
+        epoll_add(XConnectionNumber(dpy), EV_X, 0);
+        if (sock_fd >= 0)
+            epoll_add(sock_fd, EV_SOCK, 0);
+    }
+
+    /* First selection published and socket listening: release the shell. */
+    ready_notify();
+
+    while (running) {
+        /* No timeout unless a coalesced read is due. */
+        long long due = 0;
+        for (unsigned int i = 0; i < MAX_DISPLAYS; i++) {
+            long long d = displays[i].used ? display_due_us(i) : 0;
+            if (d && (!due || d < due)) due = d;
+        }
+        int timeout = -1;
+        if (due) {
+            long long left = due - monotonic_us();
+            timeout = left > 0 ? (int)((left + 999) / 1000) : 0;
+        }
+
+        struct epoll_event evs[16];
+        int n = epoll_wait(epoll_fd, evs, 16, timeout);
+        if (n < 0 && errno != EINTR) break;
+        uint32_t x_ready = 0, sock_ready = 0;   /* bit per slot */
+        for (int k = 0; k < n; k++) {
+            uint32_t kind = (uint32_t)(evs[k].data.u64 >> 32);
+            uint32_t arg = (uint32_t)evs[k].data.u64;
+            if (kind == EV_WAKE) {
+                wake_drain();
+            } else if (kind == EV_X) {
+                /* A hung-up extra display is dropped without reading it. */
+                if (arg > 0 && (evs[k].events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)))
+                    display_mark_lost(arg);
+                x_ready |= 1u << arg;
+            } else if (kind == EV_SOCK) {
+                sock_ready |= 1u << arg;
+            } else if (kind == EV_WATCH) {
+                /* Looked up by fd: watcher_remove() moves entries. */
+                for (unsigned int i = 0; i < watcher_count; i++) {
+                    if (watchers[i].fd == (int)arg) {
+                        watcher_read(i);
+                        break;
                     }
                 }
             }
         }
+        if (met_dump_pending) {
+            met_dump_pending = 0;
+            met_dump_file();
+        }
+        long long now = monotonic_us();
+        for (unsigned int i = 0; i < MAX_DISPLAYS; i++) {
+            if (!displays[i].used) continue;
+            long long d = display_due_us(i);
+            if (((x_ready | sock_ready) >> i & 1) || (d && now >= d))
+                display_service(i, sock_ready >> i & 1);
+        }
     }
 
+    for (unsigned int i = 1; i < MAX_DISPLAYS; i++) {
+        if (displays[i].used)
+            display_drop(i);
+    }
+    if (epoll_fd >= 0) { close(epoll_fd); epoll_fd = -1; }
+
+    while (watcher_count > 0) watcher_remove(watcher_count - 1);
+    if (sock_fd >= 0) { close(sock_fd); unlink(sock_path); }
+    if (clip_win != None) { XDestroyWindow(dpy, clip_win); clip_win = None; }
+    if (daemon_win != None) { XDestroyWindow(dpy, daemon_win); daemon_win = None; }
+    free(clip_data);
+    clip_data = NULL;
     if (fd_primary >= 0) { close(fd_primary); fd_primary = -1; }
     if (fd_seq     >= 0) { close(fd_seq);     fd_seq     = -1; }
+    ring_close();
+    trace_close();
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
     unlink(primary_path);
     unlink(seq_path);
     unlink(pid_path);
+    unlink(metrics_path);
     return 0;
 }
 
@@ -567,21 +1492,20 @@ static int run_daemon(const char *cache_dir_arg) {
  *   --get-clipboard    Print clipboard (CLIPBOARD selection) text and exit.
  *   --copy-clipboard   Read stdin, take clipboard ownership, serve paste requests.
  *   --clear-primary    Clear PRIMARY by setting its owner to None.
+ *   --stats            Print the running daemon's metrics (no X connection).
  *   --help / -h        Print usage to stderr and exit.
  *
- * A positional non-flag argument is interpreted as cache_dir (daemon / unused
- * by short-lived modes which derive paths from XDG_RUNTIME_DIR or HOME). */
+ * A positional non-flag argument is interpreted as cache_dir (daemon, and
+ * --copy-clipboard to find the daemon socket; other short-lived modes ignore
+ * it).  Without one, paths derive from XDG_RUNTIME_DIR, /dev/shm or HOME. */
 int main(int argc, char *argv[]) {
-    if (!getenv("DISPLAY")) {
-        fprintf(stderr, "DISPLAY not set\n");
-        return 1;
-    }
-
     const char *cache_dir_arg = NULL;
     bool oneshot = false;
     bool get_clipboard = false;
     bool copy_clipboard = false;
     bool clear_primary = false;
+    bool stats = false;
+    bool osc52 = false;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--oneshot") == 0)
@@ -592,15 +1516,21 @@ int main(int argc, char *argv[]) {
             copy_clipboard = true;
         else if (strcmp(argv[i], "--clear-primary") == 0)
             clear_primary = true;
+        else if (strcmp(argv[i], "--stats") == 0)
+            stats = true;
+        else if (strcmp(argv[i], "--osc52") == 0)
+            osc52 = true;
         else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             fprintf(stderr,
-                "Usage: %s [cache_dir] [--oneshot|--get-clipboard|--copy-clipboard|--clear-primary]\n"
+                "Usage: %s [cache_dir] [--oneshot|--get-clipboard|--copy-clipboard|--clear-primary|--stats|--osc52]\n"
                 "X11 selection monitor and clipboard helper for zsh-edit-select.\n\n"
                 "  (default)         Daemon mode — monitor PRIMARY selection\n"
                 "  --oneshot         Print current PRIMARY and exit\n"
                 "  --get-clipboard   Print clipboard contents and exit\n"
                 "  --copy-clipboard  Read stdin, set as clipboard\n"
-                "  --clear-primary   Clear PRIMARY selection\n",
+                "  --clear-primary   Clear PRIMARY selection\n"
+                "  --stats           Print the running daemon's metrics\n"
+                "  --osc52           Read stdin, write it to the terminal as OSC 52\n",
                 argv[0]);
             return 0;
         } else {
@@ -608,23 +1538,25 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if (stats)
+        return run_stats(cache_dir_arg);
+    if (osc52)
+        return run_osc52();
+
+    if (!getenv("DISPLAY")) {
+        fprintf(stderr, "DISPLAY not set\n");
+        return 1;
+    }
+
     dpy = XOpenDisplay(NULL);
     if (!dpy) {
         fprintf(stderr, "Cannot open X display\n");
         return 1;
     }
 
-    /* Intern the standard X11 selection atoms for conversion requests. */
-    root = DefaultRootWindow(dpy);
-    xa_primary = XInternAtom(dpy, "PRIMARY", False);
-    xa_clipboard = XInternAtom(dpy, "CLIPBOARD", False);
-    xa_utf8_string = XInternAtom(dpy, "UTF8_STRING", False);
-    xa_targets = XInternAtom(dpy, "TARGETS", False);
-    /* ZES_SEL / ZES_CLIP: private property names used as conversion targets.
-       Using unique names avoids clashing with properties written by other
-       apps on windows that happen to share a name. */
-    xa_zes_sel = XInternAtom(dpy, "ZES_SEL", False);
-    xa_zes_clip = XInternAtom(dpy, "ZES_CLIP", False);
+    prev_x_error_handler = XSetErrorHandler(x_error_handler);
+
+    intern_atoms();
 
     int ret = 0;
     if (oneshot)
@@ -632,7 +1564,7 @@ int main(int argc, char *argv[]) {
     else if (get_clipboard)
         ret = run_get_clipboard();
     else if (copy_clipboard)
-        ret = run_copy_clipboard();
+        ret = run_copy_clipboard(cache_dir_arg);
     else if (clear_primary)
         ret = run_clear_primary();
     else